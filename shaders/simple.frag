@@ -2,9 +2,12 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
 
+layout (binding = 1) uniform sampler2D uTexture;
+
 layout (location = 0) in vec4 vColor;
+layout (location = 1) in vec2 vTexcoord;
 layout (location = 0) out vec4 uFragColor;
 
 void main() {
-   uFragColor = vColor;
+   uFragColor = vColor * texture(uTexture, vTexcoord);
 }
@@ -2,22 +2,56 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
 
+// USE_PUSH_CONSTANTS is defined when building the push-constant variant
+
+#ifdef USE_PUSH_CONSTANTS
+layout(push_constant) uniform PerDraw {
+  mat4 viewProj;
+} pc;
+#endif
+
 layout(std140, binding = 0) uniform buf {
-  mat4 MVP;
-  vec4 position[3];
-  vec4 color[3];
+  mat4 viewProj;
 } ubuf;
 
+// per-instance world transform, from the instance buffer
+// (it also expands the quantized positions of the mesh)
+layout (location = 0) in mat4 inWorld;
+
+// quantized mesh vertex, normalized by the vertex fetch
+layout (location = 4) in vec4 inPosition;   // snorm16, in the mesh bounds
+layout (location = 5) in vec2 inNormal;     // snorm16, octahedral
+layout (location = 6) in vec4 inColor;      // unorm8
+
 layout (location = 0) out vec4 vColor;
+layout (location = 1) out vec2 vTexcoord;
+layout (location = 2) out vec3 vNormal;
 
 out gl_PerVertex {
   vec4 gl_Position;
 };
 
+vec3 decode_octahedral(vec2 e) {
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  if (n.z < 0.0) {
+    n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+  }
+  return normalize(n);
+}
+
 void main() 
 {
-  gl_Position = ubuf.MVP * ubuf.position[gl_VertexIndex];
-  vColor = ubuf.color[gl_VertexIndex];
+#ifdef USE_PUSH_CONSTANTS
+  mat4 viewProj = pc.viewProj;
+#else
+  mat4 viewProj = ubuf.viewProj;
+#endif
+
+  gl_Position = viewProj * inWorld * vec4(inPosition.xyz, 1.0);
+  vColor = inColor;
+  vTexcoord = 0.5 * inPosition.xy + 0.5;
+  // object space, inWorld also holds the quantization scale
+  vNormal = decode_octahedral(inNormal);
 
   // GL->VK conventions
   gl_Position.y = -gl_Position.y;
@@ -0,0 +1,439 @@
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "capture.h"
+#include "deletion_queue.h"
+#include "frame_scheduler.h"
+#include "profiler.h"
+#include "setup.h"
+
+// ============================================================================
+
+/* Return true for the 8 bits formats with blue stored first */
+static
+bool is_bgra_format(const VkFormat format) {
+  return (format == VK_FORMAT_B8G8R8A8_UNORM)
+      || (format == VK_FORMAT_B8G8R8A8_SRGB);
+}
+
+// ----------------------------------------------------------------------------
+
+static
+bool is_readable_format(const VkFormat format) {
+  return is_bgra_format(format)
+      || (format == VK_FORMAT_R8G8B8A8_UNORM)
+      || (format == VK_FORMAT_R8G8B8A8_SRGB);
+}
+
+// ----------------------------------------------------------------------------
+
+/* Convert tightly packed RGBA / BGRA texels to RGB */
+static
+void convert_to_rgb(const uint8_t *texels,
+                    const uint32_t count,
+                    const bool bBGRA,
+                    std::vector<uint8_t> &rgb)
+{
+  const uint32_t r = (bBGRA) ? 2u : 0u;
+  const uint32_t b = (bBGRA) ? 0u : 2u;
+
+  rgb.resize(3u * count);
+  for (uint32_t i = 0u; i < count; ++i) {
+    rgb[3u*i + 0u] = texels[4u*i + r];
+    rgb[3u*i + 1u] = texels[4u*i + 1u];
+    rgb[3u*i + 2u] = texels[4u*i + b];
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+static
+bool write_ppm(const char *filename,
+               const uint32_t width,
+               const uint32_t height,
+               const std::vector<uint8_t> &rgb)
+{
+  FILE *fd = fopen(filename, "wb");
+  if (!fd) {
+    return false;
+  }
+
+  fprintf(fd, "P6\n%u %u\n255\n", width, height);
+  const bool res = (fwrite(rgb.data(), 1u, rgb.size(), fd) == rgb.size());
+  fclose(fd);
+
+  return res;
+}
+
+// ----------------------------------------------------------------------------
+
+/* Read a binary PPM file with 8 bits channels (comments are not supported) */
+static
+bool read_ppm(const char *filename,
+              uint32_t &width,
+              uint32_t &height,
+              std::vector<uint8_t> &rgb)
+{
+  FILE *fd = fopen(filename, "rb");
+  if (!fd) {
+    return false;
+  }
+
+  unsigned int maxval = 0u;
+  bool res = (fscanf(fd, "P6 %u %u %u", &width, &height, &maxval) == 3)
+          && (maxval == 255u)
+          && (fgetc(fd) != EOF);    // single whitespace before the texels
+
+  if (res) {
+    rgb.resize(3u * width * height);
+    res = (fread(rgb.data(), 1u, rgb.size(), fd) == rgb.size());
+  }
+  fclose(fd);
+
+  return res;
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+* Compare a capture with the golden image, texels whose channels differ by
+* more than tolerance are counted as errors.
+* @return true when the images match.
+*/
+static
+bool compare_golden(const AppOptions &options,
+                    const uint32_t width,
+                    const uint32_t height,
+                    const std::vector<uint8_t> &rgb)
+{
+  const char *filename = options.golden.c_str();
+
+  uint32_t golden_width = 0u;
+  uint32_t golden_height = 0u;
+  std::vector<uint8_t> golden;
+
+  if (!read_ppm(filename, golden_width, golden_height, golden)) {
+    fprintf(stderr, "Capture error : cannot read the golden image \"%s\".\n", filename);
+    return false;
+  }
+
+  if ((golden_width != width) || (golden_height != height)) {
+    fprintf(stderr, "Capture error : golden image is %ux%u, capture is %ux%u.\n",
+            golden_width, golden_height, width, height);
+    return false;
+  }
+
+  uint32_t errors = 0u;
+  uint32_t max_diff = 0u;
+  for (uint32_t i = 0u; i < width * height; ++i) {
+    uint32_t diff = 0u;
+    for (uint32_t c = 0u; c < 3u; ++c) {
+      const int d = abs(int(rgb[3u*i + c]) - int(golden[3u*i + c]));
+      diff = (uint32_t(d) > diff) ? uint32_t(d) : diff;
+    }
+    max_diff = (diff > max_diff) ? diff : max_diff;
+    errors += (diff > options.goldenTolerance) ? 1u : 0u;
+  }
+
+  if (errors > 0u) {
+    fprintf(stderr, "Capture error : %u texel(s) differ from \"%s\" "
+                    "(max difference %u, tolerance %u).\n",
+            errors, filename, max_diff, options.goldenTolerance);
+    return false;
+  }
+
+  fprintf(stdout, "capture : matches \"%s\" (max difference %u)\n", filename, max_diff);
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+
+static
+void destroy_readback(VulkanContext &ctx, FrameCapture::Readback &readback) {
+  vkFreeCommandBuffers(ctx.device, ctx.cmdPool, 1u, &readback.cmd);
+  vkDestroyBuffer(ctx.device, readback.buffer, nullptr);
+  vkFreeMemory(ctx.device, readback.mem, nullptr);
+}
+
+// ----------------------------------------------------------------------------
+
+/* Write and compare a readback completed by the GPU */
+static
+void resolve_readback(VulkanContext &ctx, FrameCapture::Readback &readback) {
+  PROFILE_FUNCTION();
+
+  FrameCapture &capture = *ctx.capture;
+  const AppOptions &options = ctx.app.options;
+
+  void *texels = nullptr;
+  VkResult err = vkMapMemory(ctx.device, readback.mem, 0u, VK_WHOLE_SIZE, 0u, &texels);
+  assert(!err);
+
+  std::vector<uint8_t> rgb;
+  convert_to_rgb(static_cast<const uint8_t*>(texels),
+                 readback.width * readback.height,
+                 is_bgra_format(readback.format),
+                 rgb);
+
+  vkUnmapMemory(ctx.device, readback.mem);
+  ++capture.resolved;
+
+  if (!options.capture.empty()) {
+    if (write_ppm(options.capture.c_str(), readback.width, readback.height, rgb)) {
+      fprintf(stdout, "capture : frame %u written to \"%s\"\n",
+              readback.frame, options.capture.c_str());
+      ++capture.written;
+    } else {
+      fprintf(stderr, "Capture error : cannot write \"%s\".\n", options.capture.c_str());
+    }
+  }
+
+  if (!options.golden.empty()
+   && !compare_golden(options, readback.width, readback.height, rgb)) {
+    ++capture.mismatches;
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+bool capture_requested(const AppOptions &options) {
+  return !options.capture.empty() || !options.golden.empty();
+}
+
+// ----------------------------------------------------------------------------
+
+void init_capture(VulkanContext &ctx) {
+  assert(ctx.capture == nullptr);
+  ctx.capture = new FrameCapture();
+
+  const AppOptions &options = ctx.app.options;
+
+  /* Capture the last frame of a bounded run by default */
+  if (options.captureFrame != kCaptureLastFrame) {
+    ctx.capture->captureFrame = options.captureFrame;
+  } else if (options.frames > 0u) {
+    ctx.capture->captureFrame = options.frames - 1u;
+  }
+
+  if ((options.frames > 0u) && (ctx.capture->captureFrame >= options.frames)) {
+    fprintf(stderr, "Capture warning : frame %u is past the last frame rendered.\n",
+            ctx.capture->captureFrame);
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+void release_capture(VulkanContext &ctx) {
+  if (ctx.capture == nullptr) {
+    return;
+  }
+
+  // submitted readbacks are owned by the deletion queue
+  for (auto &readback : ctx.capture->pending) {
+    destroy_readback(ctx, readback);
+  }
+
+  delete ctx.capture;
+  ctx.capture = nullptr;
+}
+
+// ----------------------------------------------------------------------------
+
+VkCommandBuffer record_capture(VulkanContext &ctx, const SurfaceContext &surface) {
+  FrameCapture &capture = *ctx.capture;
+
+  const uint32_t frame = capture.frame++;
+  if (!capture_requested(ctx.app.options) || (frame != capture.captureFrame)) {
+    return VK_NULL_HANDLE;
+  }
+
+  PROFILE_FUNCTION();
+
+  if (!(ctx.swapchainUsage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)) {
+    fprintf(stderr, "Capture error : swapchain images cannot be copied.\n");
+    return VK_NULL_HANDLE;
+  }
+  if (!is_readable_format(ctx.format)) {
+    fprintf(stderr, "Capture error : unsupported swapchain format (%d).\n", ctx.format);
+    return VK_NULL_HANDLE;
+  }
+
+  VkResult err;
+
+  FrameCapture::Readback readback;
+  readback.frame = frame;
+  readback.format = ctx.format;
+  readback.width = surface.width;
+  readback.height = surface.height;
+
+  /* Host buffer receiving the tightly packed texels */
+  VkBufferCreateInfo bufferInfo;
+  memset(&bufferInfo, 0, sizeof(bufferInfo));
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = 4u * readback.width * readback.height;
+  bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  err = vkCreateBuffer(ctx.device, &bufferInfo, nullptr, &readback.buffer);
+  assert(!err);
+
+  VkMemoryRequirements memReqs;
+  vkGetBufferMemoryRequirements(ctx.device, readback.buffer, &memReqs);
+
+  VkMemoryAllocateInfo allocInfo;
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.pNext = nullptr;
+  allocInfo.allocationSize = memReqs.size;
+  allocInfo.memoryTypeIndex = 0u;
+
+  /* Cached memory is faster to read from the host */
+  const VkFlags coherent = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                         | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  bool res = retrieve_memory_type_index(ctx.properties.memory,
+                                        memReqs.memoryTypeBits,
+                                        coherent | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+                                        &allocInfo.memoryTypeIndex)
+          || retrieve_memory_type_index(ctx.properties.memory,
+                                        memReqs.memoryTypeBits,
+                                        coherent,
+                                        &allocInfo.memoryTypeIndex);
+  assert(res);
+
+  err = vkAllocateMemory(ctx.device, &allocInfo, nullptr, &readback.mem);
+  assert(!err);
+
+  err = vkBindBufferMemory(ctx.device, readback.buffer, readback.mem, 0u);
+  assert(!err);
+
+  /* Copy commands */
+  VkCommandBufferAllocateInfo cmdInfo;
+  cmdInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  cmdInfo.pNext = nullptr;
+  cmdInfo.commandPool = ctx.cmdPool;
+  cmdInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  cmdInfo.commandBufferCount = 1u;
+
+  err = vkAllocateCommandBuffers(ctx.device, &cmdInfo, &readback.cmd);
+  assert(!err);
+
+  VkCommandBufferBeginInfo beginInfo;
+  memset(&beginInfo, 0, sizeof(beginInfo));
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  err = vkBeginCommandBuffer(readback.cmd, &beginInfo);
+  assert(!err);
+
+  const VkImage image = surface.swapchainBuffers[surface.imageIndex].image;
+
+  /* The render pass leaves the image ready to present */
+  VkImageMemoryBarrier barrier;
+  memset(&barrier, 0, sizeof(barrier));
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.levelCount = 1u;
+  barrier.subresourceRange.layerCount = 1u;
+
+  vkCmdPipelineBarrier(readback.cmd,
+                       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       0u, 0u, nullptr, 0u, nullptr, 1u, &barrier);
+
+  VkBufferImageCopy region;
+  memset(&region, 0, sizeof(region));
+  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.imageSubresource.layerCount = 1u;
+  region.imageExtent.width = readback.width;
+  region.imageExtent.height = readback.height;
+  region.imageExtent.depth = 1u;
+
+  vkCmdCopyImageToBuffer(readback.cmd,
+                         image,
+                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                         readback.buffer,
+                         1u, &region);
+
+  /* Back to presentation, the semaphore wait of the present orders it */
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  barrier.dstAccessMask = 0u;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+  /* Make the copy visible to the host */
+  VkBufferMemoryBarrier hostBarrier;
+  memset(&hostBarrier, 0, sizeof(hostBarrier));
+  hostBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  hostBarrier.buffer = readback.buffer;
+  hostBarrier.size = VK_WHOLE_SIZE;
+
+  vkCmdPipelineBarrier(readback.cmd,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+                       0u, 0u, nullptr, 1u, &hostBarrier, 1u, &barrier);
+
+  err = vkEndCommandBuffer(readback.cmd);
+  assert(!err);
+
+  capture.pending.push_back(readback);
+
+  return readback.cmd;
+}
+
+// ----------------------------------------------------------------------------
+
+void end_capture_frame(VulkanContext &ctx, const uint64_t value) {
+  FrameCapture &capture = *ctx.capture;
+
+  if (capture.pending.empty()) {
+    return;
+  }
+
+  /* Written, compared and destroyed once the GPU has completed the copy */
+  const FrameCapture::Readback readback = capture.pending.front();
+  capture.pending.pop_front();
+  capture.lastValue = value;
+
+  defer_deletion(ctx, value, [&ctx, readback] {
+    FrameCapture::Readback completed = readback;
+    resolve_readback(ctx, completed);
+    destroy_readback(ctx, completed);
+  });
+}
+
+// ----------------------------------------------------------------------------
+
+bool finish_captures(VulkanContext &ctx) {
+  PROFILE_FUNCTION();
+
+  FrameCapture &capture = *ctx.capture;
+
+  if (capture.lastValue > 0u) {
+    wait_frame_value(ctx, capture.lastValue);
+    collect_deletions(ctx);
+  }
+
+  /* A golden comparison fails when the frame was never read back */
+  if (!ctx.app.options.golden.empty() && (capture.resolved == 0u)) {
+    fprintf(stderr, "Capture error : frame %u was not captured.\n", capture.captureFrame);
+    return false;
+  }
+
+  return capture.mismatches == 0u;
+}
+
+// ============================================================================
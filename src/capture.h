@@ -0,0 +1,63 @@
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#include <deque>
+#include <string>
+
+#include "common.h"
+
+/**
+* Asynchronous readback of presented frames.
+* The swapchain image of a captured frame is copied to a host visible buffer
+* by a command buffer submitted after its draws. The readback is retired to
+* the deletion queue with its frame value : once completed by the GPU, a few
+* frames later and without waiting on the frame ring, it is written as a
+* binary PPM file and / or compared with a golden image, then destroyed.
+*/
+struct FrameCapture {
+  struct Readback {
+    uint32_t frame;         // index of the captured frame
+    VkFormat format;
+    uint32_t width;
+    uint32_t height;
+    VkBuffer buffer;
+    VkDeviceMemory mem;
+    VkCommandBuffer cmd;
+  };
+
+  uint32_t frame = 0u;      // index of the next frame
+  uint32_t captureFrame = 0u;
+  std::deque<Readback> pending;   // recorded, not submitted yet
+  uint64_t lastValue = 0u;        // frame value of the last readback submitted
+
+  uint32_t resolved = 0u;     // readbacks completed
+  uint32_t written = 0u;      // files written
+  uint32_t mismatches = 0u;   // comparisons failed
+};
+
+/* Return true when the options request a readback */
+bool capture_requested(const AppOptions &options);
+
+/**/
+void init_capture(VulkanContext &ctx);
+
+/* Destroy the readbacks not submitted, the device must be idle */
+void release_capture(VulkanContext &ctx);
+
+/**
+* Record the readback of the image acquired by a surface when the current
+* frame is captured, to submit after its draw commands.
+* @return the command buffer, or VK_NULL_HANDLE when the frame is not captured.
+*/
+VkCommandBuffer record_capture(VulkanContext &ctx, const SurfaceContext &surface);
+
+/* Retire the readback of the frame with the value of its submission */
+void end_capture_frame(VulkanContext &ctx, const uint64_t value);
+
+/**
+* Wait for the pending readbacks and process them.
+* @return false when a capture differs from the golden image.
+*/
+bool finish_captures(VulkanContext &ctx);
+
+#endif  // CAPTURE_H_
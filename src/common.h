@@ -5,13 +5,38 @@
 #include "vulkan/vulkan.h"
 
 #include "linmath.h"
+#include "options.h"
+
+struct DeletionQueue;
+struct DrawList;
+struct EntityStore;
+struct FrameCapture;
+struct FrameScheduler;
+struct FrameTiming;
+struct MeshStore;
+struct OcclusionCuller;
+struct PipelineManager;
+struct RenderGraph;
+struct SamplerCache;
+struct SceneGraph;
+struct StagingRing;
+typedef uint64_t PipelineHandle;
+typedef uint32_t SceneNodeId;
+typedef uint32_t EntityId;
+typedef uint32_t MeshHandle;
+typedef uint32_t MaterialHandle;
+
+/* Wrapper to store matrices in containers */
+struct Matrix {
+  mat4x4 m;
+};
 
 
-/* Handle to the XCB window manager data */
+/* Handle to the XCB window manager data, shared by the windows */
 struct XCBHandler {
   xcb_connection_t *connection;
   xcb_screen_t *screen;
-  xcb_window_t window;
+  xcb_intern_atom_reply_t *atom_wm_protocols;
   xcb_intern_atom_reply_t *atom_wm_delete_window;
 };
 
@@ -35,6 +60,21 @@ struct VulkanExtensionFP {
   PFN_vkGetSwapchainImagesKHR                   fpGetSwapchainImagesKHR = nullptr;
   PFN_vkAcquireNextImageKHR                     fpAcquireNextImageKHR = nullptr;
   PFN_vkQueuePresentKHR                         fpQueuePresentKHR = nullptr;
+
+  // Debug utils (optional)
+  PFN_vkCreateDebugUtilsMessengerEXT            fpCreateDebugUtilsMessengerEXT = nullptr;
+  PFN_vkDestroyDebugUtilsMessengerEXT           fpDestroyDebugUtilsMessengerEXT = nullptr;
+};
+
+/* Capabilities enabled from the optional extensions supported by the driver */
+struct VulkanCapabilities {
+  bool physicalDeviceProperties2 = false;
+  bool debugUtils = false;
+  bool timelineSemaphore = false;
+  bool memoryBudget = false;
+  bool presentId = false;
+  bool presentWait = false;
+  bool pipelineStatistics = false;    // core feature, pipelineStatisticsQuery
 };
 
 /**/
@@ -42,6 +82,44 @@ struct SwapchainBuffer {
   VkImage image = VK_NULL_HANDLE;
   VkImageView view = VK_NULL_HANDLE;
   VkCommandBuffer cmd = VK_NULL_HANDLE;
+  VkPipeline pipeline = VK_NULL_HANDLE;   // pipeline bound when recording cmd
+  uint32_t uniformSlice = 0u;             // uniform slice bound when recording cmd
+  uint64_t drawVersion = 0u;              // draw list version recorded in cmd
+};
+
+/* Sampled image, with its mip chain */
+struct Texture {
+  VkImage image = VK_NULL_HANDLE;
+  VkDeviceMemory mem = VK_NULL_HANDLE;
+  VkImageView view = VK_NULL_HANDLE;
+  VkFormat format = VK_FORMAT_UNDEFINED;
+  uint32_t width = 0u;
+  uint32_t height = 0u;
+  uint32_t mipLevels = 0u;
+};
+
+/**
+* Presentation state of a window : its surface, swapchain and the render
+* graph drawing into it.
+* Surfaces share the device, pipelines and scene data of the VulkanContext,
+* their frames are submitted and presented together.
+*/
+struct SurfaceContext {
+  xcb_window_t window = 0u;
+  VkSurfaceKHR surface = VK_NULL_HANDLE;
+  uint32_t width = 0u;
+  uint32_t height = 0u;
+
+  /* Swapchain (buffers used for rendering and display) */
+  VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+  VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+  SwapchainBuffer *swapchainBuffers = nullptr;
+  uint32_t numSwapchainImages = 0u;
+  std::vector<uint64_t> imageValues;    // last frame value submitted per image
+  uint32_t imageIndex = 0u;             // image acquired by the current frame
+
+  /* Passes of the frame, with the swapchain images imported */
+  RenderGraph *renderGraph = nullptr;
 };
 
 /* Vulkan's context data */
@@ -52,36 +130,56 @@ struct VulkanContext {
     App() : width(0u), height(0u) {}
     uint32_t width;
     uint32_t height;
+    AppOptions options;
   } app;
 
+  /* Camera, and the node of the mesh rotated by the inputs */
   struct Scene {
     mat4x4 projection;
     mat4x4 view;
-    mat4x4 model;
+    uint32_t cameraSlices = ~0u;    // uniform slices to update with the camera
+    SceneNodeId triangle = 0u;
+    MeshHandle mesh = 0u;           // drawn mesh, the triangle by default
   } scene;
 
+  /* Transform hierarchy, driving the transforms of the entities */
+  SceneGraph *sceneGraph = nullptr;
+
+  /* Entities by archetype, and the instances drawn from them each frame */
+  EntityStore *entityStore = nullptr;
+  DrawList *drawList = nullptr;
+
+  /* Geometry resident on the device */
+  MeshStore *meshStore = nullptr;
+
   /**/
   VkInstance inst = VK_NULL_HANDLE;
   VkPhysicalDevice gpu = VK_NULL_HANDLE;
+
+  /* Layers enabled on both the instance and the device */
+  std::vector<char const*> layer_names;
+  VkDebugUtilsMessengerEXT debugMessenger = VK_NULL_HANDLE;
   
-  /* Surface (screen presentation context) */
-  VkSurfaceKHR surface = VK_NULL_HANDLE;
+  /**
+  * Surfaces (screen presentation contexts), one per window, created once.
+  * The first one is the primary surface : its frames are captured and
+  * their presentation is waited for.
+  */
+  std::vector<SurfaceContext> surfaces;
+
+  /* Format and usage shared by the swapchains of every surface */
   VkFormat format;
   VkColorSpaceKHR color_space;
+  VkImageUsageFlags swapchainUsage = 0u;
 
-  /* Swapchain (buffers used for rendering and display) */
-  VkSwapchainKHR swapchain = VK_NULL_HANDLE;
-  SwapchainBuffer *swapchainBuffers = nullptr;
-  uint32_t numSwapchainImages;
-
-  /* Depth buffer */
+  /* Presentation choices made by the present policy */
   struct {
-    VkImage image = VK_NULL_HANDLE;
-    VkFormat format;
-    VkImageView view = VK_NULL_HANDLE;
-    VkMemoryAllocateInfo allocateInfo;
-    VkDeviceMemory mem;
-  } depth;
+    uint32_t framesInFlight = 1u;
+  } present;
+
+  /* Multisampling and depth format of the render targets */
+  VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+  VkFormat depthFormat = VK_FORMAT_UNDEFINED;
 
   /**/
   VkDevice device = VK_NULL_HANDLE;
@@ -99,32 +197,58 @@ struct VulkanContext {
   /* Extensions entry points */
   std::vector<char const*> device_extension_names;
   VulkanExtensionFP ext;
+  VulkanCapabilities caps;
 
   /**/
   VkCommandBuffer initCmdBuffer = VK_NULL_HANDLE;
   VkCommandPool cmdPool = VK_NULL_HANDLE;
   VkDescriptorSetLayout descLayout = VK_NULL_HANDLE;
   VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
-  VkRenderPass renderPass = VK_NULL_HANDLE;
+  VkRenderPass renderPass = VK_NULL_HANDLE;   // main pass of the primary surface
   VkPipelineCache pipelineCache = VK_NULL_HANDLE;
-  VkPipeline pipeline = VK_NULL_HANDLE;
-  VkFramebuffer *framebuffers = nullptr;
+  PipelineManager *pipelineManager = nullptr;
+  PipelineHandle pipelineHandle = 0u;
+  VkPipeline pipeline = VK_NULL_HANDLE;   // resolved from pipelineHandle
+
+  /* CPU / GPU frame pacing, and resources retired with a frame */
+  FrameScheduler *frameScheduler = nullptr;
+  FrameTiming *frameTiming = nullptr;
+  DeletionQueue *deletionQueue = nullptr;
+
+  /* Uploads to device local memory */
+  StagingRing *stagingRing = nullptr;
+
+  /* Readbacks of presented frames */
+  FrameCapture *capture = nullptr;
+
+  /* Hi-Z of the previous frames, tested by the culling pass */
+  OcclusionCuller *occlusion = nullptr;
+
+  /* Texture sampled by the fragment shader, and shared samplers */
+  Texture texture;
+  VkSampler sampler = VK_NULL_HANDLE;
+  SamplerCache *samplerCache = nullptr;
 
   VkDescriptorPool descPool = VK_NULL_HANDLE;
   VkDescriptorSet descSet = VK_NULL_HANDLE;
 
-  /**/
+  /* Camera data sent through push constants when it fits the device limit */
   struct {
-    VkShaderModule vert_module;
-    VkShaderModule frag_module;
-  } shader;
-
-  /* Buffer used to store UniformData for geometry */
+    bool enabled = false;
+    uint32_t size = 0u;
+    mat4x4 viewProj;
+  } pushConstants;
+
+  /**
+  * Device local buffer used to store UniformData for geometry, one slice per
+  * frame in flight, updated through the staging ring.
+  */
   struct {
       VkBuffer buffer = VK_NULL_HANDLE;
       VkDeviceMemory mem = VK_NULL_HANDLE;
       VkMemoryAllocateInfo memAllocInfo;
       VkDescriptorBufferInfo descBufferInfo;
+      VkDeviceSize sliceSize = 0u;
   } uniformData;
 };
 
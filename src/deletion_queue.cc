@@ -0,0 +1,82 @@
+#include <cassert>
+
+#include "deletion_queue.h"
+#include "frame_scheduler.h"
+#include "profiler.h"
+
+// ============================================================================
+
+void init_deletion_queue(VulkanContext &ctx) {
+  assert(ctx.deletionQueue == nullptr);
+  ctx.deletionQueue = new DeletionQueue();
+}
+
+// ----------------------------------------------------------------------------
+
+void release_deletion_queue(VulkanContext &ctx) {
+  if (ctx.deletionQueue == nullptr) {
+    return;
+  }
+
+  for (auto &entry : ctx.deletionQueue->entries) {
+    entry.destroy();
+  }
+
+  delete ctx.deletionQueue;
+  ctx.deletionQueue = nullptr;
+}
+
+// ----------------------------------------------------------------------------
+
+void defer_deletion(VulkanContext &ctx, const uint64_t value, std::function<void()> destroy) {
+  assert(ctx.deletionQueue != nullptr);
+  DeletionQueue &dq = *ctx.deletionQueue;
+
+  std::lock_guard<std::mutex> lock(dq.mutex);
+
+  // values are mostly retired in order, keep the queue sorted from its back
+  auto it = dq.entries.end();
+  while ((it != dq.entries.begin()) && ((it - 1)->value > value)) {
+    --it;
+  }
+  dq.entries.insert(it, DeletionQueue::Entry{value, std::move(destroy)});
+}
+
+// ----------------------------------------------------------------------------
+
+void defer_deletion(VulkanContext &ctx, std::function<void()> destroy) {
+  // before the first frame, nothing has been submitted with the scheduler
+  const uint64_t value = (ctx.frameScheduler != nullptr) ? ctx.frameScheduler->submittedValue
+                                                         : 0u;
+  defer_deletion(ctx, value, std::move(destroy));
+}
+
+// ----------------------------------------------------------------------------
+
+void collect_deletions(VulkanContext &ctx) {
+  DeletionQueue &dq = *ctx.deletionQueue;
+
+  std::deque<DeletionQueue::Entry> completed;
+  {
+    std::lock_guard<std::mutex> lock(dq.mutex);
+
+    if (dq.entries.empty()) {
+      return;
+    }
+
+    const uint64_t value = poll_frame_value(ctx);
+    while (!dq.entries.empty() && (dq.entries.front().value <= value)) {
+      completed.push_back(std::move(dq.entries.front()));
+      dq.entries.pop_front();
+    }
+  }
+
+  PROFILE_FUNCTION();
+
+  // destroyed out of the lock, as they can retire other resources
+  for (auto &entry : completed) {
+    entry.destroy();
+  }
+}
+
+// ============================================================================
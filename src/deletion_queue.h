@@ -0,0 +1,39 @@
+#ifndef DELETION_QUEUE_H_
+#define DELETION_QUEUE_H_
+
+#include <deque>
+#include <functional>
+#include <mutex>
+
+#include "common.h"
+
+/**
+* Resources retired with the frame value they were last used in, and
+* destroyed once the GPU has completed it (see frame_scheduler.h).
+*/
+struct DeletionQueue {
+  struct Entry {
+    uint64_t value;
+    std::function<void()> destroy;
+  };
+
+  std::mutex mutex;
+  std::deque<Entry> entries;    // sorted by value
+};
+
+/**/
+void init_deletion_queue(VulkanContext &ctx);
+
+/* Destroy every pending resource, the device must be idle */
+void release_deletion_queue(VulkanContext &ctx);
+
+/* Retire a resource last used by the submission signaling value */
+void defer_deletion(VulkanContext &ctx, const uint64_t value, std::function<void()> destroy);
+
+/* Retire a resource last used by the frames submitted so far */
+void defer_deletion(VulkanContext &ctx, std::function<void()> destroy);
+
+/* Destroy the resources whose value has been completed by the GPU */
+void collect_deletions(VulkanContext &ctx);
+
+#endif  // DELETION_QUEUE_H_
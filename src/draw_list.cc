@@ -0,0 +1,631 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "vulkan/vulkan.h"
+#include "draw_list.h"
+#include "mesh.h"
+#include "occlusion.h"
+#include "pipeline.h"
+#include "profiler.h"
+#include "setup.h"
+
+// ============================================================================
+
+/* Frustum planes (a, b, c, d) of a view projection, pointing inward */
+static
+void extract_frustum_planes(mat4x4 m, vec4 planes[6u]) {
+  // rows of the column-major matrix
+  vec4 rows[4u];
+  for (uint32_t r = 0u; r < 4u; ++r) {
+    for (uint32_t c = 0u; c < 4u; ++c) {
+      rows[r][c] = m[c][r];
+    }
+  }
+
+  for (uint32_t i = 0u; i < 3u; ++i) {
+    vec4_add(planes[2u * i + 0u], rows[3u], rows[i]);
+    vec4_sub(planes[2u * i + 1u], rows[3u], rows[i]);
+  }
+
+  for (uint32_t i = 0u; i < 6u; ++i) {
+    const float len = sqrtf(  planes[i][0u] * planes[i][0u]
+                            + planes[i][1u] * planes[i][1u]
+                            + planes[i][2u] * planes[i][2u]);
+    vec4_scale(planes[i], planes[i], 1.0f / len);
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+/* Return true when a bounding sphere is at least partially inside the frustum */
+static
+bool is_sphere_visible(const vec4 planes[6u], const vec4 center, const float radius) {
+  for (uint32_t i = 0u; i < 6u; ++i) {
+    const float d = planes[i][0u] * center[0u]
+                  + planes[i][1u] * center[1u]
+                  + planes[i][2u] * center[2u]
+                  + planes[i][3u];
+    if (d < -radius) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+
+/* Largest axis scale of a transform, bounding how it stretches lengths */
+static
+float max_axis_scale(mat4x4 world) {
+  float scale = 0.0f;
+  for (uint32_t c = 0u; c < 3u; ++c) {
+    const float s = world[c][0u] * world[c][0u]
+                  + world[c][1u] * world[c][1u]
+                  + world[c][2u] * world[c][2u];
+    scale = std::max(scale, s);
+  }
+  return sqrtf(scale);
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+* Coarsest LOD of a mesh whose error, scaled to pixels, stays under
+* kLodPixelError. The current LOD is kept until the error crosses the
+* threshold by the hysteresis margin, so instances lying around it do not
+* pop between two levels every frame.
+*/
+static
+uint32_t select_lod(const Mesh &mesh, const uint32_t current, const float pixelsPerUnit) {
+  const float refine = kLodPixelError * (1.0f + kLodHysteresis);
+  const float coarsen = kLodPixelError * (1.0f - kLodHysteresis);
+  const uint32_t count = static_cast<uint32_t>(mesh.lods.size());
+
+  uint32_t lod = std::min(current, count - 1u);
+  while ((lod > 0u) && (mesh.lods[lod].error * pixelsPerUnit > refine)) {
+    --lod;
+  }
+  while ((lod + 1u < count) && (mesh.lods[lod + 1u].error * pixelsPerUnit < coarsen)) {
+    ++lod;
+  }
+  return lod;
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+* Quantized view depth of a point, its clip w. The bits of a positive float
+* are ordered as its value, their upper bits are kept. Points behind the
+* camera get 0.
+*/
+static
+uint32_t quantize_depth(mat4x4 viewProj, const vec4 center) {
+  const float w = viewProj[0u][3u] * center[0u]
+                + viewProj[1u][3u] * center[1u]
+                + viewProj[2u][3u] * center[2u]
+                + viewProj[3u][3u];
+  if (!(w > 0.0f)) {
+    return 0u;
+  }
+  uint32_t bits;
+  memcpy(&bits, &w, sizeof(bits));
+  return bits >> (32u - kDrawKeyDepthBits);
+}
+
+// ----------------------------------------------------------------------------
+
+static
+uint64_t draw_key(const uint32_t pipelineSlot,
+                  const MaterialHandle material,
+                  const MeshHandle mesh,
+                  const uint32_t lod,
+                  const uint32_t depth)
+{
+  assert(pipelineSlot < (1u << kDrawKeyPipelineBits));
+  assert(material < (1u << kDrawKeyMaterialBits));
+  assert(mesh < (1u << kDrawKeyMeshBits));
+  assert(lod < (1u << kDrawKeyLodBits));
+
+  uint64_t key = pipelineSlot;
+  key = (key << kDrawKeyMaterialBits) | material;
+  key = (key << kDrawKeyMeshBits) | mesh;
+  key = (key << kDrawKeyLodBits) | lod;
+  key = (key << kDrawKeyDepthBits) | depth;
+  return key;
+}
+
+// ----------------------------------------------------------------------------
+
+/* Key without its depth, equal for the instances of a batch */
+static
+uint64_t draw_state(const uint64_t key) {
+  return key >> kDrawKeyDepthBits;
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+* LSD radix sort of the items by key, one byte per pass. The histograms of
+* every byte are built by a single read of the keys, and the passes whose
+* byte is the same for every item are skipped : with few pipelines and
+* materials, most of the upper bytes are.
+* Return the number of passes run.
+*/
+static
+uint32_t radix_sort_items(std::vector<DrawList::Item> &items,
+                          std::vector<DrawList::Item> &scratch)
+{
+  const uint32_t kPasses = sizeof(uint64_t);
+  const uint32_t count = static_cast<uint32_t>(items.size());
+
+  uint32_t histograms[kPasses][256u];
+  memset(histograms, 0, sizeof(histograms));
+
+  for (const auto &item : items) {
+    for (uint32_t p = 0u; p < kPasses; ++p) {
+      ++histograms[p][(item.key >> (8u * p)) & 0xffu];
+    }
+  }
+
+  scratch.resize(count);
+  DrawList::Item *src = items.data();
+  DrawList::Item *dst = scratch.data();
+  uint32_t passes = 0u;
+
+  for (uint32_t p = 0u; p < kPasses; ++p) {
+    uint32_t *histogram = histograms[p];
+
+    const uint32_t byte = (count > 0u) ? (src[0u].key >> (8u * p)) & 0xffu : 0u;
+    if (histogram[byte] == count) {
+      continue;
+    }
+
+    // exclusive prefix sum, the bucket offsets
+    uint32_t offset = 0u;
+    for (uint32_t b = 0u; b < 256u; ++b) {
+      const uint32_t n = histogram[b];
+      histogram[b] = offset;
+      offset += n;
+    }
+
+    for (uint32_t i = 0u; i < count; ++i) {
+      dst[histogram[(src[i].key >> (8u * p)) & 0xffu]++] = src[i];
+    }
+    std::swap(src, dst);
+    ++passes;
+  }
+
+  /* After an odd number of passes the sorted items are in scratch */
+  if (src != items.data()) {
+    items.swap(scratch);
+  }
+
+  return passes;
+}
+
+// ----------------------------------------------------------------------------
+
+/* Binds recorded in a command buffer, to skip those already made */
+struct DrawBindState {
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VkDescriptorSet descSet = VK_NULL_HANDLE;
+  VkBuffer vertexBuffers[kMaxVertexBindings] = {};
+  VkDeviceSize vertexOffsets[kMaxVertexBindings] = {};
+  VkBuffer indexBuffer = VK_NULL_HANDLE;
+  VkDeviceSize indexOffset = 0u;
+};
+
+// ----------------------------------------------------------------------------
+
+static
+void bind_pipeline(DrawList &list,
+                   DrawBindState &state,
+                   VkCommandBuffer cmd,
+                   VkPipeline pipeline)
+{
+  if (state.pipeline == pipeline) {
+    ++list.stats.bindsSkipped[DRAW_BIND_PIPELINE];
+    return;
+  }
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+  state.pipeline = pipeline;
+  ++list.stats.bindsIssued[DRAW_BIND_PIPELINE];
+}
+
+// ----------------------------------------------------------------------------
+
+static
+void bind_descriptor_set(VulkanContext &ctx,
+                         DrawBindState &state,
+                         VkCommandBuffer cmd,
+                         VkDescriptorSet descSet,
+                         const uint32_t dynamicOffset)
+{
+  DrawList &list = *ctx.drawList;
+
+  /* The dynamic offset is the same for the whole command buffer */
+  if (state.descSet == descSet) {
+    ++list.stats.bindsSkipped[DRAW_BIND_DESCRIPTOR_SET];
+    return;
+  }
+  vkCmdBindDescriptorSets(
+    cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, ctx.pipelineLayout, 0u, 1u, &descSet, 1u, &dynamicOffset
+  );
+  state.descSet = descSet;
+  ++list.stats.bindsIssued[DRAW_BIND_DESCRIPTOR_SET];
+}
+
+// ----------------------------------------------------------------------------
+
+static
+void bind_vertex_buffer(DrawList &list,
+                        DrawBindState &state,
+                        VkCommandBuffer cmd,
+                        const uint32_t binding,
+                        VkBuffer buffer,
+                        const VkDeviceSize offset)
+{
+  assert(binding < kMaxVertexBindings);
+
+  if ((state.vertexBuffers[binding] == buffer)
+   && (state.vertexOffsets[binding] == offset)) {
+    ++list.stats.bindsSkipped[DRAW_BIND_VERTEX_BUFFER];
+    return;
+  }
+  vkCmdBindVertexBuffers(cmd, binding, 1u, &buffer, &offset);
+  state.vertexBuffers[binding] = buffer;
+  state.vertexOffsets[binding] = offset;
+  ++list.stats.bindsIssued[DRAW_BIND_VERTEX_BUFFER];
+}
+
+// ----------------------------------------------------------------------------
+
+static
+void bind_index_buffer(DrawList &list,
+                       DrawBindState &state,
+                       VkCommandBuffer cmd,
+                       VkBuffer buffer,
+                       const VkDeviceSize offset,
+                       const VkIndexType type)
+{
+  /* Meshes keep the same index type for a buffer and offset */
+  if ((state.indexBuffer == buffer) && (state.indexOffset == offset)) {
+    ++list.stats.bindsSkipped[DRAW_BIND_INDEX_BUFFER];
+    return;
+  }
+  vkCmdBindIndexBuffer(cmd, buffer, offset, type);
+  state.indexBuffer = buffer;
+  state.indexOffset = offset;
+  ++list.stats.bindsIssued[DRAW_BIND_INDEX_BUFFER];
+}
+
+// ----------------------------------------------------------------------------
+
+void init_draw_list(VulkanContext &ctx) {
+  PROFILE_FUNCTION();
+
+  assert(ctx.drawList == nullptr);
+  ctx.drawList = new DrawList();
+  DrawList &list = *ctx.drawList;
+
+  VkResult err;
+
+  list.sliceSize = kMaxDrawInstances * sizeof(InstanceData);
+
+  /* No slot holds an entity yet */
+  list.slotStamps.assign(kMaxDrawInstances * kMaxFramesInFlight, 0u);
+
+  /* Written by the host, read once per frame by the vertex shader */
+  VkBufferCreateInfo bufferInfo;
+  memset(&bufferInfo, 0, sizeof(bufferInfo));
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = list.sliceSize * kMaxFramesInFlight;
+  bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  err = vkCreateBuffer(ctx.device, &bufferInfo, nullptr, &list.buffer);
+  assert(!err);
+
+  VkMemoryRequirements memReqs;
+  vkGetBufferMemoryRequirements(ctx.device, list.buffer, &memReqs);
+
+  VkMemoryAllocateInfo allocInfo;
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.pNext = nullptr;
+  allocInfo.allocationSize = memReqs.size;
+  allocInfo.memoryTypeIndex = 0u;
+
+  bool res = retrieve_memory_type_index(
+    ctx.properties.memory,
+    memReqs.memoryTypeBits,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+    &allocInfo.memoryTypeIndex
+  );
+  assert(res);
+
+  err = vkAllocateMemory(ctx.device, &allocInfo, nullptr, &list.mem);
+  assert(!err);
+
+  err = vkBindBufferMemory(ctx.device, list.buffer, list.mem, 0u);
+  assert(!err);
+
+  /* Mapped for the lifetime of the list */
+  err = vkMapMemory(ctx.device, list.mem, 0u, VK_WHOLE_SIZE, 0u, (void**)&list.mapped);
+  assert(!err);
+}
+
+// ----------------------------------------------------------------------------
+
+void release_draw_list(VulkanContext &ctx) {
+  if (ctx.drawList == nullptr) {
+    return;
+  }
+  DrawList &list = *ctx.drawList;
+
+  if (list.stats.frames > 0u) {
+    const double frames = list.stats.frames;
+    fprintf(stdout, "draw list : %.1f visible, %.1f culled, %.1f batch(es), "
+                    "%.1f instance write(s) per frame\n",
+            list.stats.visible / frames,
+            list.stats.culled / frames,
+            list.stats.batches / frames,
+            list.stats.instanceWrites / frames);
+
+    /* Share of the visible instances drawn at each LOD */
+    if (list.stats.visible > 0u) {
+      fprintf(stdout, "draw lods :");
+      for (uint32_t i = 0u; i < kMaxMeshLods; ++i) {
+        if (list.stats.lodInstances[i] > 0u) {
+          fprintf(stdout, " lod%u %.1f%%", i, 100.0 * list.stats.lodInstances[i] / list.stats.visible);
+        }
+      }
+      fprintf(stdout, ", %llu switch(es)\n", (unsigned long long)list.stats.lodSwitches);
+    }
+  }
+  if (list.stats.recordings > 0u) {
+    static const char* kBindNames[kDrawBindKindCount] = {
+      "pipeline", "descriptor set", "vertex buffer", "index buffer"
+    };
+    fprintf(stdout, "draw binds : %u recording(s), %.1f radix pass(es) per frame\n",
+            list.stats.recordings,
+            list.stats.sortPasses / double(std::max(list.stats.frames, 1u)));
+    for (uint32_t i = 0u; i < kDrawBindKindCount; ++i) {
+      fprintf(stdout, "  %-16s : %llu issued, %llu skipped\n",
+              kBindNames[i],
+              (unsigned long long)list.stats.bindsIssued[i],
+              (unsigned long long)list.stats.bindsSkipped[i]);
+    }
+  }
+  if (list.stats.overflows > 0u) {
+    fprintf(stderr, "dev warning : %u frame(s) exceeded %u instances.\n",
+            list.stats.overflows, kMaxDrawInstances);
+  }
+
+  vkUnmapMemory(ctx.device, list.mem);
+  vkDestroyBuffer(ctx.device, list.buffer, nullptr);
+  vkFreeMemory(ctx.device, list.mem, nullptr);
+
+  delete ctx.drawList;
+  ctx.drawList = nullptr;
+}
+
+// ----------------------------------------------------------------------------
+
+MaterialHandle add_draw_material(VulkanContext &ctx,
+                                 PipelineHandle pipeline,
+                                 VkDescriptorSet descSet)
+{
+  DrawList &list = *ctx.drawList;
+
+  /* Materials sharing a pipeline share its slot, and sort next to each other */
+  uint32_t slot = 0u;
+  while ((slot < list.pipelines.size()) && (list.pipelines[slot].handle != pipeline)) {
+    ++slot;
+  }
+  if (slot == list.pipelines.size()) {
+    assert(slot < (1u << kDrawKeyPipelineBits));
+    list.pipelines.push_back(DrawList::PipelineSlot{
+      pipeline, resolve_pipeline(ctx, pipeline)
+    });
+  }
+
+  assert(list.materials.size() < (1u << kDrawKeyMaterialBits));
+  list.materials.push_back(DrawMaterial{slot, descSet});
+
+  return static_cast<MaterialHandle>(list.materials.size() - 1u);
+}
+
+// ----------------------------------------------------------------------------
+
+void build_draw_list(VulkanContext &ctx, mat4x4 viewProj, const uint32_t slice) {
+  PROFILE_FUNCTION();
+
+  DrawList &list = *ctx.drawList;
+  EntityStore &store = *ctx.entityStore;
+
+  /* Pick up the pipelines compiled since the last frame */
+  for (auto &slot : list.pipelines) {
+    VkPipeline pipeline = resolve_pipeline(ctx, slot.handle);
+    if (pipeline != slot.pipeline) {
+      slot.pipeline = pipeline;
+      ++list.version;
+    }
+  }
+
+  /* Cull */
+  vec4 planes[6u];
+  extract_frustum_planes(viewProj, planes);
+
+  /* Pixels covered by a unit length at unit view depth */
+  const float pixelsAtUnitDepth = 0.5f * ctx.surfaces.front().height
+                                * fabsf(ctx.scene.projection[1u][1u]);
+
+  /* Hi-Z read back from the last frame drawn with this slot */
+  const bool bOcclusion = begin_occlusion_test(ctx, slice);
+
+  list.items.clear();
+  uint32_t culled = 0u;
+
+  for (uint32_t a = 0u; a < store.archetypes.size(); ++a) {
+    Archetype &archetype = store.archetypes[a];
+    if ((archetype.mask & kDrawableComponents) != kDrawableComponents) {
+      continue;
+    }
+
+    const uint32_t count = static_cast<uint32_t>(archetype.entities.size());
+    for (uint32_t row = 0u; row < count; ++row) {
+      mat4x4 &world = archetype.transforms[row].m;
+      const BoundingSphere &bounds = archetype.bounds[row];
+
+      vec4 center = { bounds.center[0u], bounds.center[1u], bounds.center[2u], 1.0f };
+      vec4 world_center;
+      mat4x4_mul_vec4(world_center, world, center);
+
+      const float scale = max_axis_scale(world);
+      const bool bVisible = is_sphere_visible(planes, world_center, bounds.radius * scale)
+        && !(bOcclusion && is_sphere_occluded(ctx, slice, world_center, bounds.radius * scale));
+      archetype.visible[row] = bVisible;
+
+      if (!bVisible) {
+        ++culled;
+        continue;
+      }
+
+      /* LOD from the view depth of the bounds center */
+      vec4 view_center;
+      mat4x4_mul_vec4(view_center, ctx.scene.view, world_center);
+      const float depth = -view_center[2u];
+
+      const MeshHandle mesh = archetype.meshes[row];
+      const uint32_t previous = archetype.lods[row];
+      const uint32_t lod = (depth > 0.0f)
+        ? select_lod(get_mesh(ctx, mesh), previous, scale * pixelsAtUnitDepth / depth)
+        : 0u;
+      archetype.lods[row] = static_cast<uint8_t>(lod);
+      list.stats.lodSwitches += (lod != previous) ? 1u : 0u;
+      ++list.stats.lodInstances[lod];
+
+      const MaterialHandle material = archetype.materials[row];
+      assert(material < list.materials.size());
+
+      const uint64_t key = draw_key(list.materials[material].pipelineSlot,
+                                    material,
+                                    mesh,
+                                    lod,
+                                    quantize_depth(viewProj, world_center));
+      list.items.push_back(DrawList::Item{key, a, row});
+    }
+  }
+
+  /* The slot's next readback is drawn from this camera */
+  end_occlusion_test(ctx, slice, viewProj);
+
+  /* Sort */
+  list.stats.sortPasses += radix_sort_items(list.items, list.scratch);
+
+  /* Fill */
+  if (list.items.size() > kMaxDrawInstances) {
+    list.items.resize(kMaxDrawInstances);
+    ++list.stats.overflows;
+  }
+
+  InstanceData *instances = reinterpret_cast<InstanceData*>(
+    list.mapped + slice * list.sliceSize
+  );
+  uint64_t *stamps = list.slotStamps.data() + slice * kMaxDrawInstances;
+
+  std::vector<DrawList::Batch> batches;
+  batches.reserve(list.batches.size());
+
+  for (uint32_t i = 0u; i < list.items.size(); ++i) {
+    const DrawList::Item &item = list.items[i];
+    const Archetype &archetype = store.archetypes[item.archetype];
+
+    /* The slot is kept when it already holds this transform of the entity */
+    const uint64_t stamp = archetype.stamps[item.row];
+    if (stamps[i] != stamp) {
+      /* The mesh positions are dequantized by the instance transform */
+      // linmath takes non-const matrices
+      Matrix world = archetype.transforms[item.row];
+      Matrix dequantize = get_mesh(ctx, archetype.meshes[item.row]).dequantize;
+      mat4x4_mul(instances[i].world, world.m, dequantize.m);
+      stamps[i] = stamp;
+      ++list.stats.instanceWrites;
+    }
+
+    /* Instances of a batch only differ by depth */
+    if (batches.empty() || (draw_state(list.items[i - 1u].key) != draw_state(item.key))) {
+      const MaterialHandle material = archetype.materials[item.row];
+      batches.push_back(DrawList::Batch{
+        list.materials[material].pipelineSlot, material, archetype.meshes[item.row],
+        archetype.lods[item.row], i, 0u
+      });
+    }
+    ++batches.back().instanceCount;
+  }
+
+  /* Draw commands are recorded again only when the batches differ */
+  const bool bChanged = (batches.size() != list.batches.size())
+    || !std::equal(batches.begin(), batches.end(), list.batches.begin(),
+         [](const DrawList::Batch &a, const DrawList::Batch &b) {
+           return (a.pipelineSlot == b.pipelineSlot)
+               && (a.material == b.material) && (a.mesh == b.mesh)
+               && (a.lod == b.lod)
+               && (a.firstInstance == b.firstInstance)
+               && (a.instanceCount == b.instanceCount);
+         });
+  if (bChanged) {
+    list.batches.swap(batches);
+    ++list.version;
+  }
+
+  ++list.stats.frames;
+  list.stats.visible += list.items.size();
+  list.stats.culled += culled;
+  list.stats.batches += list.batches.size();
+}
+
+// ----------------------------------------------------------------------------
+
+void record_draw_list(VulkanContext &ctx, VkCommandBuffer cmd, const uint32_t slice) {
+  DrawList &list = *ctx.drawList;
+  ++list.stats.recordings;
+
+  if (list.batches.empty()) {
+    return;
+  }
+
+  /* Nothing is bound at the start of the command buffer */
+  DrawBindState state;
+
+  /* the uniform slice of the frame slot */
+  const uint32_t dynamicOffset = slice * ctx.uniformData.sliceSize;
+
+  /* Instance data of the frame slot */
+  const VkDeviceSize offset = slice * list.sliceSize;
+
+  /* Batches are sorted by state, consecutive ones mostly share their binds */
+  for (const auto &batch : list.batches) {
+    VkPipeline pipeline = list.pipelines[batch.pipelineSlot].pipeline;
+    if (pipeline == VK_NULL_HANDLE) {
+      // still compiling, drawn once resolved
+      continue;
+    }
+    const DrawMaterial &material = list.materials[batch.material];
+    const Mesh &mesh = get_mesh(ctx, batch.mesh);
+
+    bind_pipeline(list, state, cmd, pipeline);
+    bind_descriptor_set(ctx, state, cmd, material.descSet, dynamicOffset);
+    bind_vertex_buffer(list, state, cmd, 0u, list.buffer, offset);
+    bind_vertex_buffer(list, state, cmd, kMeshVertexBinding, mesh.buffer, 0u);
+    bind_index_buffer(list, state, cmd, mesh.buffer, mesh.indexOffset, mesh.indexType);
+
+    const MeshLod &lod = mesh.lods[batch.lod];
+    vkCmdDrawIndexed(cmd, lod.indexCount, batch.instanceCount, lod.firstIndex, 0, batch.firstInstance);
+  }
+}
+
+// ============================================================================
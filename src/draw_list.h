@@ -0,0 +1,149 @@
+#ifndef DRAW_LIST_H_
+#define DRAW_LIST_H_
+
+#include <vector>
+
+#include "common.h"
+#include "entity.h"
+#include "frame_scheduler.h"
+#include "mesh_format.h"
+
+/* Instances the buffer can hold per frame, extra ones are not drawn */
+const uint32_t kMaxDrawInstances = 16384u;
+
+/* Vertex buffer bindings tracked while recording (0 is the instances) */
+const uint32_t kMaxVertexBindings = 4u;
+
+/**
+* Layout of the 64-bit draw keys, from the most to the least significant
+* bits : pipeline slot, material, mesh, LOD, then depth. Sorting the keys
+* groups the draws by pipeline first, the most expensive state to change,
+* and orders the instances of a batch front to back.
+*/
+const uint32_t kDrawKeyDepthBits    = 21u;
+const uint32_t kDrawKeyLodBits      = 3u;
+const uint32_t kDrawKeyMeshBits     = 16u;
+const uint32_t kDrawKeyMaterialBits = 16u;
+const uint32_t kDrawKeyPipelineBits = 8u;
+static_assert((1u << kDrawKeyLodBits) >= kMaxMeshLods, "LOD does not fit the draw keys");
+
+/* Largest projected error of a LOD, in pixels, before a finer one is drawn */
+const float kLodPixelError = 1.0f;
+
+/* Relative margin around kLodPixelError to cross before switching LOD */
+const float kLodHysteresis = 0.25f;
+
+/* Per-instance data read by the vertex shader (instance rate attributes) */
+struct InstanceData {
+  mat4x4 world;
+};
+
+/* State bound by a material : a pipeline and its descriptor set */
+struct DrawMaterial {
+  uint32_t pipelineSlot;            // index in DrawList::pipelines
+  VkDescriptorSet descSet;
+};
+
+/* Kinds of binds counted while recording */
+enum DrawBindKind {
+  DRAW_BIND_PIPELINE,
+  DRAW_BIND_DESCRIPTOR_SET,
+  DRAW_BIND_VERTEX_BUFFER,
+  DRAW_BIND_INDEX_BUFFER,
+
+  kDrawBindKindCount
+};
+
+/**
+* Instances drawn by the frame, built from the entity store in three linear
+* stages :
+*  - cull : test the bounding sphere of every drawable entity against the
+*    camera frustum, writing its visibility component, then select the LOD
+*    of the visible ones from their projected error,
+*  - sort : radix sort the visible entities by draw key,
+*  - fill : write their instance data in sorted order into the slice of the
+*    frame slot, merging the instances of the same state into a single batch.
+*    Each slice keeps the stamp of the data written to its slots, a slot is
+*    only rewritten when it holds another entity or an older transform.
+* The draw commands, recorded from the batches, are only re-recorded when
+* the batches change. Recording skips the binds of a state already bound.
+*/
+struct DrawList {
+  struct Item {
+    uint64_t key;
+    uint32_t archetype;
+    uint32_t row;
+  };
+
+  struct Batch {
+    uint32_t pipelineSlot;
+    MaterialHandle material;
+    MeshHandle mesh;
+    uint32_t lod;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+  };
+
+  /* Pipelines used by the materials, resolved every frame */
+  struct PipelineSlot {
+    PipelineHandle handle;
+    VkPipeline pipeline;            // null while compiling
+  };
+
+  std::vector<PipelineSlot> pipelines;
+  std::vector<DrawMaterial> materials;      // indexed by MaterialHandle
+
+  std::vector<Item> items;
+  std::vector<Item> scratch;                // radix sort ping-pong buffer
+  std::vector<Batch> batches;
+
+  /* Incremented each time the batches or their pipelines change */
+  uint64_t version = 1u;
+
+  /* Instance buffer, persistently mapped, one slice per frame slot */
+  VkBuffer buffer = VK_NULL_HANDLE;
+  VkDeviceMemory mem = VK_NULL_HANDLE;
+  uint8_t *mapped = nullptr;
+  VkDeviceSize sliceSize = 0u;
+
+  /* Entity stamp written to each instance slot, per slice (0 when unset) */
+  std::vector<uint64_t> slotStamps;
+
+  struct {
+    uint32_t frames = 0u;
+    uint64_t visible = 0u;
+    uint64_t culled = 0u;
+    uint64_t batches = 0u;
+    uint64_t instanceWrites = 0u;
+    uint32_t overflows = 0u;    // frames with more than kMaxDrawInstances
+    uint32_t sortPasses = 0u;   // radix passes run, out of 8 per frame
+    uint64_t lodInstances[kMaxMeshLods] = {};
+    uint64_t lodSwitches = 0u;
+    uint32_t recordings = 0u;
+    uint64_t bindsIssued[kDrawBindKindCount] = {};
+    uint64_t bindsSkipped[kDrawBindKindCount] = {};
+  } stats;
+};
+
+/* Create the instance buffer */
+void init_draw_list(VulkanContext &ctx);
+
+/* Report the culling and bind statistics, and destroy the instance buffer */
+void release_draw_list(VulkanContext &ctx);
+
+/**
+* Register a material drawn with a pipeline and a descriptor set, whose
+* layout must be ctx.pipelineLayout. The first material registered is the
+* default one (handle 0) of the entities.
+*/
+MaterialHandle add_draw_material(VulkanContext &ctx,
+                                 PipelineHandle pipeline,
+                                 VkDescriptorSet descSet);
+
+/* Cull, sort and fill the instances of the frame into the slice */
+void build_draw_list(VulkanContext &ctx, mat4x4 viewProj, const uint32_t slice);
+
+/* Record the draws of the batches, reading the instances of the slice */
+void record_draw_list(VulkanContext &ctx, VkCommandBuffer cmd, const uint32_t slice);
+
+#endif  // DRAW_LIST_H_
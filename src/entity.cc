@@ -0,0 +1,173 @@
+#include <cassert>
+
+#include "entity.h"
+
+// ============================================================================
+
+static const uint32_t kNoArchetype = UINT32_MAX;
+
+// ----------------------------------------------------------------------------
+
+/* Return the archetype of a component set, creating it on first use */
+static
+uint32_t find_archetype(EntityStore &store, const ComponentMask mask) {
+  for (uint32_t i = 0u; i < store.archetypes.size(); ++i) {
+    if (store.archetypes[i].mask == mask) {
+      return i;
+    }
+  }
+
+  store.archetypes.push_back(Archetype());
+  store.archetypes.back().mask = mask;
+  return static_cast<uint32_t>(store.archetypes.size() - 1u);
+}
+
+// ----------------------------------------------------------------------------
+
+static
+const EntityStore::Record& entity_record(const EntityStore &store,
+                                         const EntityId entity,
+                                         const ComponentMask component) {
+  assert(entity < store.records.size());
+  const EntityStore::Record &record = store.records[entity];
+  assert(record.archetype != kNoArchetype);
+  assert(store.archetypes[record.archetype].mask & component);
+  (void)component;
+  return record;
+}
+
+// ----------------------------------------------------------------------------
+
+void init_entity_store(VulkanContext &ctx) {
+  assert(ctx.entityStore == nullptr);
+  ctx.entityStore = new EntityStore();
+}
+
+// ----------------------------------------------------------------------------
+
+void release_entity_store(VulkanContext &ctx) {
+  delete ctx.entityStore;
+  ctx.entityStore = nullptr;
+}
+
+// ----------------------------------------------------------------------------
+
+EntityId create_entity(EntityStore &store, const ComponentMask mask) {
+  /* Reuse the ids of destroyed entities */
+  EntityId entity;
+  if (!store.freeIds.empty()) {
+    entity = store.freeIds.back();
+    store.freeIds.pop_back();
+  } else {
+    entity = static_cast<EntityId>(store.records.size());
+    store.records.push_back(EntityStore::Record());
+  }
+
+  const uint32_t index = find_archetype(store, mask);
+  Archetype &archetype = store.archetypes[index];
+
+  store.records[entity].archetype = index;
+  store.records[entity].row = static_cast<uint32_t>(archetype.entities.size());
+
+  archetype.entities.push_back(entity);
+  archetype.stamps.push_back(++store.lastStamp);
+
+  if (mask & COMPONENT_TRANSFORM) {
+    Matrix identity;
+    mat4x4_identity(identity.m);
+    archetype.transforms.push_back(identity);
+  }
+  if (mask & COMPONENT_BOUNDS) {
+    archetype.bounds.push_back(BoundingSphere{{0.0f, 0.0f, 0.0f}, 0.0f});
+  }
+  if (mask & COMPONENT_RENDERABLE) {
+    archetype.meshes.push_back(0u);
+    archetype.materials.push_back(0u);
+  }
+  if (mask & COMPONENT_VISIBILITY) {
+    archetype.visible.push_back(1u);
+  }
+  if (mask & COMPONENT_LOD) {
+    archetype.lods.push_back(0u);
+  }
+
+  return entity;
+}
+
+// ----------------------------------------------------------------------------
+
+/* Move the last element of an array in place of row, then shrink it */
+template<typename T>
+static
+void swap_remove(std::vector<T> &array, const uint32_t row) {
+  if (array.empty()) {
+    return;
+  }
+  array[row] = array.back();
+  array.pop_back();
+}
+
+// ----------------------------------------------------------------------------
+
+void destroy_entity(EntityStore &store, const EntityId entity) {
+  assert(entity < store.records.size());
+  EntityStore::Record &record = store.records[entity];
+  assert(record.archetype != kNoArchetype);
+
+  Archetype &archetype = store.archetypes[record.archetype];
+  const uint32_t row = record.row;
+
+  /* The last entity of the archetype takes the row */
+  const EntityId moved = archetype.entities.back();
+  store.records[moved].row = row;
+
+  swap_remove(archetype.entities, row);
+  swap_remove(archetype.stamps, row);
+  swap_remove(archetype.transforms, row);
+  swap_remove(archetype.bounds, row);
+  swap_remove(archetype.meshes, row);
+  swap_remove(archetype.materials, row);
+  swap_remove(archetype.visible, row);
+  swap_remove(archetype.lods, row);
+
+  record.archetype = kNoArchetype;
+  store.freeIds.push_back(entity);
+}
+
+// ----------------------------------------------------------------------------
+
+void set_entity_transform(EntityStore &store, const EntityId entity, mat4x4 world) {
+  const EntityStore::Record &record = entity_record(store, entity, COMPONENT_TRANSFORM);
+  Archetype &archetype = store.archetypes[record.archetype];
+  mat4x4_dup(archetype.transforms[record.row].m, world);
+  archetype.stamps[record.row] = ++store.lastStamp;
+}
+
+// ----------------------------------------------------------------------------
+
+void set_entity_bounds(EntityStore &store, const EntityId entity, const BoundingSphere &bounds) {
+  const EntityStore::Record &record = entity_record(store, entity, COMPONENT_BOUNDS);
+  store.archetypes[record.archetype].bounds[record.row] = bounds;
+}
+
+// ----------------------------------------------------------------------------
+
+void set_entity_renderable(EntityStore &store,
+                           const EntityId entity,
+                           const MeshHandle mesh,
+                           const MaterialHandle material)
+{
+  const EntityStore::Record &record = entity_record(store, entity, COMPONENT_RENDERABLE);
+  Archetype &archetype = store.archetypes[record.archetype];
+  archetype.meshes[record.row] = mesh;
+  archetype.materials[record.row] = material;
+  archetype.stamps[record.row] = ++store.lastStamp;
+}
+
+// ----------------------------------------------------------------------------
+
+uint32_t entity_count(const EntityStore &store) {
+  return static_cast<uint32_t>(store.records.size() - store.freeIds.size());
+}
+
+// ============================================================================
@@ -0,0 +1,95 @@
+#ifndef ENTITY_H_
+#define ENTITY_H_
+
+#include <vector>
+
+#include "common.h"
+
+const EntityId kNoEntity = UINT32_MAX;
+
+/* Components an entity can have, one SoA array each */
+enum ComponentBits {
+  COMPONENT_TRANSFORM  = 1u << 0u,    // world transform
+  COMPONENT_BOUNDS     = 1u << 1u,    // bounding sphere, in object space
+  COMPONENT_RENDERABLE = 1u << 2u,    // mesh and material handles
+  COMPONENT_VISIBILITY = 1u << 3u,    // visibility of the current frame
+  COMPONENT_LOD        = 1u << 4u,    // level of detail drawn, kept between frames
+};
+typedef uint32_t ComponentMask;
+
+/* Components needed by an entity to be culled and drawn */
+const ComponentMask kDrawableComponents =   COMPONENT_TRANSFORM
+                                          | COMPONENT_BOUNDS
+                                          | COMPONENT_RENDERABLE
+                                          | COMPONENT_VISIBILITY
+                                          | COMPONENT_LOD;
+
+/**/
+struct BoundingSphere {
+  vec3 center;
+  float radius;
+};
+
+/**
+* Entities sharing the same set of components, stored as parallel arrays
+* indexed by row. Arrays of components not in the mask stay empty.
+*/
+struct Archetype {
+  ComponentMask mask = 0u;
+  std::vector<EntityId> entities;           // owner of each row
+  std::vector<uint64_t> stamps;             // changed with the instance data
+  std::vector<Matrix> transforms;
+  std::vector<BoundingSphere> bounds;
+  std::vector<MeshHandle> meshes;
+  std::vector<MaterialHandle> materials;
+  std::vector<uint8_t> visible;
+  std::vector<uint8_t> lods;
+};
+
+/**
+* Entities grouped by archetype, so the render stages (cull, sort, instance
+* fill) iterate contiguous component arrays instead of chasing pointers.
+* Destroying an entity moves the last row of its archetype in its place,
+* rows are then only stable until the next destruction.
+*/
+struct EntityStore {
+  struct Record {
+    uint32_t archetype;     // UINT32_MAX once destroyed
+    uint32_t row;
+  };
+
+  std::vector<Archetype> archetypes;
+  std::vector<Record> records;              // indexed by EntityId
+  std::vector<EntityId> freeIds;
+
+  /* Last stamp given, unique to each change of transform or mesh */
+  uint64_t lastStamp = 0u;
+};
+
+/**/
+void init_entity_store(VulkanContext &ctx);
+
+/**/
+void release_entity_store(VulkanContext &ctx);
+
+/**
+* Create an entity with a set of components, in default state : identity
+* transform, empty bounds, handles 0, visible and at LOD 0.
+*/
+EntityId create_entity(EntityStore &store, const ComponentMask mask);
+
+/**/
+void destroy_entity(EntityStore &store, const EntityId entity);
+
+/* Component setters, the entity must have the component */
+void set_entity_transform(EntityStore &store, const EntityId entity, mat4x4 world);
+void set_entity_bounds(EntityStore &store, const EntityId entity, const BoundingSphere &bounds);
+void set_entity_renderable(EntityStore &store,
+                           const EntityId entity,
+                           const MeshHandle mesh,
+                           const MaterialHandle material);
+
+/* Number of entities alive */
+uint32_t entity_count(const EntityStore &store);
+
+#endif  // ENTITY_H_
@@ -0,0 +1,155 @@
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include "vulkan/vulkan.h"
+#include "extensions.h"
+#include "hash.h"
+
+// ============================================================================
+
+static
+void build_index(ExtensionIndex &index) {
+  index.lookup.clear();
+  index.lookup.reserve(index.properties.size());
+
+  for (uint32_t i = 0u; i < index.properties.size(); ++i) {
+    const uint64_t key = hash_string(index.properties[i].extensionName);
+    index.lookup.insert(std::make_pair(key, i));
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+void index_instance_extensions(ExtensionIndex &index) {
+  VkResult err;
+
+  uint32_t count = 0u;
+  err = vkEnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
+  assert(!err);
+
+  index.properties.resize(count);
+  err = vkEnumerateInstanceExtensionProperties(nullptr, &count, index.properties.data());
+  assert(!err);
+
+  build_index(index);
+}
+
+// ----------------------------------------------------------------------------
+
+void index_device_extensions(VkPhysicalDevice gpu, ExtensionIndex &index) {
+  VkResult err;
+
+  uint32_t count = 0u;
+  err = vkEnumerateDeviceExtensionProperties(gpu, nullptr, &count, nullptr);
+  assert(!err);
+
+  index.properties.resize(count);
+  err = vkEnumerateDeviceExtensionProperties(gpu, nullptr, &count, index.properties.data());
+  assert(!err);
+
+  build_index(index);
+}
+
+// ----------------------------------------------------------------------------
+
+bool has_extension(const ExtensionIndex &index, const char *name) {
+  auto it = index.lookup.find(hash_string(name));
+  if (it == index.lookup.end()) {
+    return false;
+  }
+
+  // guard against hash collisions
+  if (!strcmp(index.properties[it->second].extensionName, name)) {
+    return true;
+  }
+  for (const auto &ext : index.properties) {
+    if (!strcmp(ext.extensionName, name)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+* Return true when a requested extension is found along with its
+* dependencies, requested too or already enabled.
+*/
+static
+bool is_extension_granted(const ExtensionIndex &index,
+                          const std::vector<ExtensionRequest> &requests,
+                          const std::vector<char const*> &enabled,
+                          const ExtensionRequest &req,
+                          const uint32_t depth = 0u)
+{
+  if (!has_extension(index, req.name)) {
+    return false;
+  }
+  if (req.dependency == nullptr) {
+    return true;
+  }
+  for (const auto &name : enabled) {
+    if (!strcmp(name, req.dependency)) {
+      return true;
+    }
+  }
+  // bounded in case of a dependency cycle
+  for (const auto &dep : requests) {
+    if (!strcmp(dep.name, req.dependency)) {
+      return (depth < requests.size())
+          && is_extension_granted(index, requests, enabled, dep, depth + 1u);
+    }
+  }
+  return false;
+}
+
+// ----------------------------------------------------------------------------
+
+bool negotiate_extensions(const ExtensionIndex &index,
+                          const std::vector<ExtensionRequest> &requests,
+                          std::vector<char const*> &enabled)
+{
+  bool bMissing = false;
+
+  /* Decided before appending, a dependency may be requested after its dependent */
+  std::vector<bool> granted(requests.size());
+  for (size_t i = 0u; i < requests.size(); ++i) {
+    granted[i] = is_extension_granted(index, requests, enabled, requests[i]);
+  }
+
+  for (size_t i = 0u; i < requests.size(); ++i) {
+    const ExtensionRequest &req = requests[i];
+
+    if (granted[i]) {
+      // use Vulkan's constant extension name pointers
+      enabled.push_back(req.name);
+    } else if (req.required) {
+      fprintf(stderr, "Vulkan error : extension %s not found%s%s.\n", req.name,
+              (req.dependency != nullptr) ? " or missing its dependency " : "",
+              (req.dependency != nullptr) ? req.dependency : "");
+      bMissing = true;
+    }
+
+    if (req.capability != nullptr) {
+      *req.capability = granted[i];
+    }
+  }
+
+  return !bMissing;
+}
+
+// ----------------------------------------------------------------------------
+
+void print_vk_capabilities(const VulkanCapabilities &caps) {
+  fprintf(stdout, "Vulkan capabilities :\n");
+  fprintf(stdout, "  debug utils        : %d\n", caps.debugUtils);
+  fprintf(stdout, "  timeline semaphore : %d\n", caps.timelineSemaphore);
+  fprintf(stdout, "  present id         : %d\n", caps.presentId);
+  fprintf(stdout, "  present wait       : %d\n", caps.presentWait);
+  fprintf(stdout, "  memory budget      : %d\n", caps.memoryBudget);
+  fprintf(stdout, "  pipeline stats     : %d\n", caps.pipelineStatistics);
+}
+
+// ============================================================================
@@ -0,0 +1,48 @@
+#ifndef EXTENSIONS_H_
+#define EXTENSIONS_H_
+
+#include <unordered_map>
+#include <vector>
+
+#include "common.h"
+
+/* Available extensions, indexed by the hash of their name */
+struct ExtensionIndex {
+  std::vector<VkExtensionProperties> properties;
+  std::unordered_map<uint64_t, uint32_t> lookup;   // name hash -> properties index
+};
+
+/**
+* Extension to enable, optional ones set their capability flag when found.
+* An extension with a dependency is only enabled along with it.
+*/
+struct ExtensionRequest {
+  const char *name;
+  bool required;
+  bool *capability;         // can be null
+  const char *dependency;   // can be null (omitted)
+};
+
+/* Index the extensions exposed by the loader / implicit layers */
+void index_instance_extensions(ExtensionIndex &index);
+
+/* Index the extensions exposed by a physical device */
+void index_device_extensions(VkPhysicalDevice gpu, ExtensionIndex &index);
+
+/**/
+bool has_extension(const ExtensionIndex &index, const char *name);
+
+/**
+* Append the found requested extensions to enabled, when their dependency is
+* enabled or granted by the same requests, and set the capability of the
+* optional ones.
+* @return false if at least one required extension is missing.
+*/
+bool negotiate_extensions(const ExtensionIndex &index,
+                          const std::vector<ExtensionRequest> &requests,
+                          std::vector<char const*> &enabled);
+
+/* Print the capabilities enabled from optional extensions */
+void print_vk_capabilities(const VulkanCapabilities &caps);
+
+#endif  // EXTENSIONS_H_
@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include "vulkan/vulkan.h"
+#include "frame_scheduler.h"
+#include "frame_timing.h"
+#include "profiler.h"
+
+// ============================================================================
+
+static
+VkSemaphore create_semaphore(VulkanContext &ctx, const void *pNext) {
+  VkSemaphoreCreateInfo info;
+  info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  info.pNext = pNext;
+  info.flags = 0u;
+
+  VkSemaphore semaphore;
+  VkResult err = vkCreateSemaphore(ctx.device, &info, nullptr, &semaphore);
+  assert(!err);
+
+  return semaphore;
+}
+
+// ----------------------------------------------------------------------------
+
+void init_frame_scheduler(VulkanContext &ctx) {
+  PROFILE_FUNCTION();
+
+  assert(ctx.frameScheduler == nullptr);
+  ctx.frameScheduler = new FrameScheduler();
+  FrameScheduler &fs = *ctx.frameScheduler;
+
+  VkResult err;
+
+  /* Timeline entrypoints, only when the extension has been enabled */
+  if (ctx.caps.timelineSemaphore) {
+    fs.fpGetSemaphoreCounterValueKHR = (PFN_vkGetSemaphoreCounterValueKHR)
+      ctx.ext.fpGetDeviceProcAddr(ctx.device, "vkGetSemaphoreCounterValueKHR");
+    fs.fpWaitSemaphoresKHR = (PFN_vkWaitSemaphoresKHR)
+      ctx.ext.fpGetDeviceProcAddr(ctx.device, "vkWaitSemaphoresKHR");
+  }
+  fs.useTimeline =  (fs.fpGetSemaphoreCounterValueKHR != nullptr)
+                 && (fs.fpWaitSemaphoresKHR != nullptr);
+
+  /* Frames in flight chosen by the present policy */
+  fs.numSlots = std::max(1u, std::min(ctx.present.framesInFlight, kMaxFramesInFlight));
+
+  if (fs.useTimeline) {
+    VkSemaphoreTypeCreateInfoKHR type_info;
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+    type_info.pNext = nullptr;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+    type_info.initialValue = 0u;
+
+    fs.timeline = create_semaphore(ctx, &type_info);
+  }
+
+  /* Frame slots */
+  VkFenceCreateInfo fence_info;
+  fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fence_info.pNext = nullptr;
+  fence_info.flags = 0u;
+
+  const uint32_t surface_count = static_cast<uint32_t>(ctx.surfaces.size());
+  assert(surface_count <= kMaxWindows);
+
+  for (auto &slot : fs.slots) {
+    for (uint32_t i = 0u; i < kMaxWindows; ++i) {
+      slot.imageAcquired[i] = (i < surface_count) ? create_semaphore(ctx, nullptr)
+                                                  : VK_NULL_HANDLE;
+    }
+    slot.renderComplete = create_semaphore(ctx, nullptr);
+
+    if (!fs.useTimeline) {
+      err = vkCreateFence(ctx.device, &fence_info, nullptr, &slot.fence);
+      assert(!err);
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+void release_frame_scheduler(VulkanContext &ctx) {
+  if (ctx.frameScheduler == nullptr) {
+    return;
+  }
+  FrameScheduler &fs = *ctx.frameScheduler;
+
+  wait_frame_value(ctx, fs.submittedValue);
+
+  for (auto &slot : fs.slots) {
+    for (auto &semaphore : slot.imageAcquired) {
+      if (semaphore != VK_NULL_HANDLE) {
+        vkDestroySemaphore(ctx.device, semaphore, nullptr);
+      }
+    }
+    vkDestroySemaphore(ctx.device, slot.renderComplete, nullptr);
+    if (slot.fence != VK_NULL_HANDLE) {
+      vkDestroyFence(ctx.device, slot.fence, nullptr);
+    }
+  }
+
+  if (fs.timeline != VK_NULL_HANDLE) {
+    vkDestroySemaphore(ctx.device, fs.timeline, nullptr);
+  }
+
+  delete ctx.frameScheduler;
+  ctx.frameScheduler = nullptr;
+}
+
+// ----------------------------------------------------------------------------
+
+uint64_t poll_frame_value(VulkanContext &ctx) {
+  FrameScheduler &fs = *ctx.frameScheduler;
+
+  if (fs.completedValue == fs.submittedValue) {
+    return fs.completedValue;
+  }
+
+  VkResult err;
+
+  if (fs.useTimeline) {
+    uint64_t value = 0u;
+    err = fs.fpGetSemaphoreCounterValueKHR(ctx.device, fs.timeline, &value);
+    assert(!err);
+    fs.completedValue = std::max(fs.completedValue, value);
+  } else {
+    // submissions complete in order, the latest signaled fence gives the value
+    for (const auto &slot : fs.slots) {
+      if (  (slot.value > fs.completedValue)
+         && (vkGetFenceStatus(ctx.device, slot.fence) == VK_SUCCESS)) {
+        fs.completedValue = slot.value;
+      }
+    }
+  }
+
+  return fs.completedValue;
+}
+
+// ----------------------------------------------------------------------------
+
+void wait_frame_value(VulkanContext &ctx, const uint64_t value) {
+  FrameScheduler &fs = *ctx.frameScheduler;
+
+  assert(value <= fs.submittedValue);
+  if (value <= fs.completedValue) {
+    return;
+  }
+
+  PROFILE_FUNCTION();
+
+  VkResult err;
+
+  if (fs.useTimeline) {
+    VkSemaphoreWaitInfoKHR info;
+    info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+    info.pNext = nullptr;
+    info.flags = 0u;
+    info.semaphoreCount = 1u;
+    info.pSemaphores = &fs.timeline;
+    info.pValues = &value;
+
+    err = fs.fpWaitSemaphoresKHR(ctx.device, &info, UINT64_MAX);
+    assert(!err);
+  } else {
+    // a slot is reused once its value is completed, so the value is still
+    // owned by a slot, or covered by the next one submitted
+    const FrameSlot *pSlot = nullptr;
+    for (const auto &slot : fs.slots) {
+      if ((slot.value >= value) && (!pSlot || (slot.value < pSlot->value))) {
+        pSlot = &slot;
+      }
+    }
+    assert(pSlot != nullptr);
+
+    err = vkWaitForFences(ctx.device, 1u, &pSlot->fence, VK_TRUE, UINT64_MAX);
+    assert(!err);
+  }
+
+  fs.completedValue = std::max(fs.completedValue, value);
+}
+
+// ----------------------------------------------------------------------------
+
+FrameSlot& begin_frame(VulkanContext &ctx) {
+  FrameScheduler &fs = *ctx.frameScheduler;
+  FrameSlot &slot = fs.slots[fs.slotIndex];
+
+  /* Resources of the slot (semaphores, uniform slice) are free to reuse */
+  wait_frame_value(ctx, slot.value);
+
+  if (!fs.useTimeline && (slot.value > 0u)) {
+    VkResult err = vkResetFences(ctx.device, 1u, &slot.fence);
+    assert(!err);
+  }
+
+  return slot;
+}
+
+// ----------------------------------------------------------------------------
+
+void wait_swapchain_image(VulkanContext &ctx,
+                          const SurfaceContext &surface,
+                          const uint32_t image_index) {
+  assert(image_index < surface.imageValues.size());
+  wait_frame_value(ctx, surface.imageValues[image_index]);
+}
+
+// ----------------------------------------------------------------------------
+
+uint64_t submit_frame(VulkanContext &ctx,
+                      VkCommandBuffer upload_cmd,
+                      VkCommandBuffer readback_cmd)
+{
+  PROFILE_FUNCTION();
+
+  FrameScheduler &fs = *ctx.frameScheduler;
+  FrameSlot &slot = fs.slots[fs.slotIndex];
+
+  const uint64_t value = fs.submittedValue + 1u;
+  const uint32_t surface_count = static_cast<uint32_t>(ctx.surfaces.size());
+
+  /* Color output waits for the image of every surface to be acquired */
+  VkPipelineStageFlags wait_stages[kMaxWindows];
+  uint64_t wait_values[kMaxWindows];
+  for (uint32_t i = 0u; i < surface_count; ++i) {
+    wait_stages[i] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    wait_values[i] = 0u;    // binary semaphores ignore it
+  }
+
+  /* GPU timestamps enclose the frame commands */
+  VkCommandBuffer begin_cmd, end_cmd;
+  get_frame_timing_cmds(ctx, begin_cmd, end_cmd);
+
+  /* Uploads are executed before the draws of the frame, readbacks after */
+  VkCommandBuffer frame_cmds[kMaxWindows + 4u];
+  uint32_t frame_cmd_count = 0u;
+  frame_cmds[frame_cmd_count++] = begin_cmd;
+  frame_cmds[frame_cmd_count++] = upload_cmd;
+  for (const auto &surface : ctx.surfaces) {
+    frame_cmds[frame_cmd_count++] = surface.swapchainBuffers[surface.imageIndex].cmd;
+  }
+  frame_cmds[frame_cmd_count++] = readback_cmd;
+  frame_cmds[frame_cmd_count++] = end_cmd;
+
+  VkCommandBuffer cmds[kMaxWindows + 4u];
+  uint32_t cmd_count = 0u;
+  for (uint32_t i = 0u; i < frame_cmd_count; ++i) {
+    if (frame_cmds[i] != VK_NULL_HANDLE) {
+      cmds[cmd_count++] = frame_cmds[i];
+    }
+  }
+
+  /* The batched presentation waits on a single semaphore */
+  VkSemaphore signal_semaphores[2u] = { slot.renderComplete, fs.timeline };
+  const uint64_t signal_values[2u] = { 0u, value };   // binary semaphores ignore it
+
+  VkTimelineSemaphoreSubmitInfoKHR timeline_info;
+  timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+  timeline_info.pNext = nullptr;
+  timeline_info.waitSemaphoreValueCount = surface_count;
+  timeline_info.pWaitSemaphoreValues = wait_values;
+  timeline_info.signalSemaphoreValueCount = 2u;
+  timeline_info.pSignalSemaphoreValues = signal_values;
+
+  VkSubmitInfo info;
+  memset(&info, 0, sizeof(info));
+  info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  info.pNext = (fs.useTimeline) ? &timeline_info : nullptr;
+  info.waitSemaphoreCount = surface_count;
+  info.pWaitSemaphores = slot.imageAcquired;
+  info.pWaitDstStageMask = wait_stages;
+  info.commandBufferCount = cmd_count;
+  info.pCommandBuffers = cmds;
+  info.signalSemaphoreCount = (fs.useTimeline) ? 2u : 1u;
+  info.pSignalSemaphores = signal_semaphores;
+
+  VkResult err = vkQueueSubmit(ctx.queue, 1u, &info, slot.fence);
+  assert(!err);
+
+  fs.submittedValue = value;
+  for (auto &surface : ctx.surfaces) {
+    surface.imageValues[surface.imageIndex] = value;
+  }
+  slot.value = value;
+
+  return value;
+}
+
+// ----------------------------------------------------------------------------
+
+void end_frame(VulkanContext &ctx) {
+  FrameScheduler &fs = *ctx.frameScheduler;
+  fs.slotIndex = (fs.slotIndex + 1u) % fs.numSlots;
+}
+
+// ============================================================================
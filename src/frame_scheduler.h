@@ -0,0 +1,73 @@
+#ifndef FRAME_SCHEDULER_H_
+#define FRAME_SCHEDULER_H_
+
+#include "common.h"
+
+/* Number of frames the CPU can record ahead of the GPU */
+const uint32_t kMaxFramesInFlight = 2u;
+
+/* Synchronization objects of a frame in flight */
+struct FrameSlot {
+  VkSemaphore imageAcquired[kMaxWindows];       // signaled by each surface's swapchain
+  VkSemaphore renderComplete = VK_NULL_HANDLE;  // waited by the presentation
+  VkFence fence = VK_NULL_HANDLE;               // binary fallback only
+  uint64_t value = 0u;                          // value of the slot's last submit
+};
+
+/**
+* Paces the CPU on the GPU with monotonically increasing values, each queue
+* submission signals the next one on a single timeline semaphore.
+* Without VK_KHR_timeline_semaphore, each slot has a fence signaled with its
+* submission instead.
+*/
+struct FrameScheduler {
+  bool useTimeline = false;
+  VkSemaphore timeline = VK_NULL_HANDLE;
+
+  uint64_t submittedValue = 0u;   // last value submitted
+  uint64_t completedValue = 0u;   // last value known to be completed
+
+  FrameSlot slots[kMaxFramesInFlight];
+  uint32_t slotIndex = 0u;
+  uint32_t numSlots = kMaxFramesInFlight;   // frames in flight of the present policy
+
+  PFN_vkGetSemaphoreCounterValueKHR fpGetSemaphoreCounterValueKHR = nullptr;
+  PFN_vkWaitSemaphoresKHR           fpWaitSemaphoresKHR = nullptr;
+};
+
+/* Create the frame slots and the timeline semaphore, when available */
+void init_frame_scheduler(VulkanContext &ctx);
+
+/**/
+void release_frame_scheduler(VulkanContext &ctx);
+
+/* Return the last value completed by the GPU, without blocking */
+uint64_t poll_frame_value(VulkanContext &ctx);
+
+/* Block until the GPU has completed a value */
+void wait_frame_value(VulkanContext &ctx, const uint64_t value);
+
+/* Wait until the current slot is available, and return it */
+FrameSlot& begin_frame(VulkanContext &ctx);
+
+/* Wait until the last submission using a swapchain image is completed */
+void wait_swapchain_image(VulkanContext &ctx,
+                          const SurfaceContext &surface,
+                          const uint32_t image_index);
+
+/**
+* Submit the command buffers of the image acquired by every surface in a
+* single batch, preceded by the upload command buffer and followed by the
+* readback command buffer when not null, waiting for the slot's acquires and
+* signaling its render semaphore and the next value. The frame timestamps
+* commands enclose them.
+* @return the value signaled by the submission.
+*/
+uint64_t submit_frame(VulkanContext &ctx,
+                      VkCommandBuffer upload_cmd = VK_NULL_HANDLE,
+                      VkCommandBuffer readback_cmd = VK_NULL_HANDLE);
+
+/* Move to the next slot, once the frame is presented */
+void end_frame(VulkanContext &ctx);
+
+#endif  // FRAME_SCHEDULER_H_
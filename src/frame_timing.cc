@@ -0,0 +1,488 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "frame_timing.h"
+#include "profiler.h"
+
+// ============================================================================
+
+/* Weight of the last frame in the moving averages */
+static const double kTimingSmoothing = 0.1;
+
+/* Longest late latch sleep, in case of a wrong prediction */
+static const uint64_t kMaxLatchDelay_us = 50000u;
+
+// ----------------------------------------------------------------------------
+
+static
+double moving_average(const double average, const double sample) {
+  return (average > 0.0) ? average + kTimingSmoothing * (sample - average)
+                         : sample;
+}
+
+// ----------------------------------------------------------------------------
+
+/* Presentation state of a pending frame */
+enum PresentStatus {
+  PRESENT_PENDING,    // not presented yet
+  PRESENT_DONE,       // presented on every surface
+  PRESENT_LOST,       // swapchain or device lost, its sample is dropped
+};
+
+// ----------------------------------------------------------------------------
+
+/* Poll the presentation of the frame with the present id value */
+static
+PresentStatus poll_frame_present(VulkanContext &ctx, const uint64_t value) {
+#ifdef VK_KHR_present_wait
+  FrameTiming &timing = *ctx.frameTiming;
+  if (timing.fpWaitForPresentKHR != nullptr) {
+    // every surface is presented with the same id, the frame is presented
+    // once the last one is ; a null timeout only polls
+    for (const auto &surface : ctx.surfaces) {
+      VkResult res = timing.fpWaitForPresentKHR(ctx.device, surface.swapchain, value, 0u);
+      switch (res) {
+        case VK_SUCCESS:
+        case VK_SUBOPTIMAL_KHR:
+        break;
+
+        case VK_TIMEOUT:
+          return PRESENT_PENDING;
+
+        // VK_ERROR_OUT_OF_DATE_KHR, VK_ERROR_SURFACE_LOST_KHR, VK_ERROR_DEVICE_LOST..
+        default:
+          return PRESENT_LOST;
+      }
+    }
+    return PRESENT_DONE;
+  }
+#endif
+  return (value <= poll_frame_value(ctx)) ? PRESENT_DONE : PRESENT_PENDING;
+}
+
+// ----------------------------------------------------------------------------
+
+static
+bool present_wait_enabled(const FrameTiming &timing) {
+#ifdef VK_KHR_present_wait
+  return timing.fpWaitForPresentKHR != nullptr;
+#else
+  return false;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+
+/* Read the GPU time of the last frame submitted with the current slot */
+static
+void read_gpu_timestamps(VulkanContext &ctx) {
+  FrameTiming &timing = *ctx.frameTiming;
+  const uint32_t slot = ctx.frameScheduler->slotIndex;
+
+  if (!timing.useTimestamps || (timing.slotValues[slot] == 0u)) {
+    return;
+  }
+
+  uint64_t ticks[2u];
+  VkResult res = vkGetQueryPoolResults(ctx.device, timing.queryPool,
+                                       2u * slot, 2u,
+                                       sizeof(ticks), ticks, sizeof(ticks[0u]),
+                                       VK_QUERY_RESULT_64_BIT);
+  if (res != VK_SUCCESS) {
+    return;
+  }
+
+  const double gpu_ms = 1e-6 * timing.timestampPeriod_ns * double(ticks[1u] - ticks[0u]);
+  timing.gpuFrame_ms = moving_average(timing.gpuFrame_ms, gpu_ms);
+
+  for (auto &frame : timing.pending) {
+    if (frame.value == timing.slotValues[slot]) {
+      frame.gpu_ms = gpu_ms;
+    }
+  }
+  timing.slotValues[slot] = 0u;
+}
+
+// ----------------------------------------------------------------------------
+
+/* Accumulate the pipeline statistics of the last frame submitted with the current slot */
+static
+void read_pipeline_statistics(VulkanContext &ctx) {
+  FrameTiming &timing = *ctx.frameTiming;
+  const uint32_t slot = ctx.frameScheduler->slotIndex;
+
+  if (!timing.usePipelineStatistics || (timing.statisticsValues[slot] == 0u)) {
+    return;
+  }
+
+  const uint32_t count = timing.statisticsPerSlot;
+  std::vector<uint64_t> results(count * kFramePipelineStatisticCount);
+  const VkDeviceSize stride = kFramePipelineStatisticCount * sizeof(uint64_t);
+
+  VkResult res = vkGetQueryPoolResults(ctx.device, timing.statisticsPool,
+                                       count * slot, count,
+                                       results.size() * sizeof(uint64_t), results.data(),
+                                       stride, VK_QUERY_RESULT_64_BIT);
+  timing.statisticsValues[slot] = 0u;
+  if (res != VK_SUCCESS) {
+    return;
+  }
+
+  /* Surfaces are summed, as their frames are */
+  for (uint32_t i = 0u; i < count; ++i) {
+    for (uint32_t j = 0u; j < kFramePipelineStatisticCount; ++j) {
+      timing.stats.statistics[j] += results[i * kFramePipelineStatisticCount + j];
+    }
+    timing.stats.pixels += uint64_t(ctx.surfaces[i].width) * ctx.surfaces[i].height;
+  }
+  timing.stats.statisticsFrames += 1u;
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+* Account the latency of the frames presented since the last call.
+* Presents are polled at the start of each frame, so the time of presentation
+* is the start of the first frame seeing it : the latency measured is an upper
+* bound, quantized to the frame starts (late by up to a frame time).
+*/
+static
+void collect_presents(VulkanContext &ctx) {
+  FrameTiming &timing = *ctx.frameTiming;
+
+  const uint64_t now_us = profiler_now_us();
+
+  while (!timing.pending.empty()) {
+    const FrameTiming::Frame &frame = timing.pending.front();
+
+    const PresentStatus status = poll_frame_present(ctx, frame.value);
+    if (status == PRESENT_PENDING) {
+      break;
+    }
+    if (status == PRESENT_LOST) {
+      timing.pending.pop_front();
+      continue;
+    }
+
+    const uint64_t presented_us = now_us - frame.input_us;
+
+    timing.stats.frames += 1u;
+    timing.stats.update_us += frame.update_us - frame.input_us;
+    timing.stats.submit_us += frame.submit_us - frame.input_us;
+    timing.stats.presented_us += presented_us;
+    timing.stats.maxPresented_us = std::max(timing.stats.maxPresented_us, presented_us);
+    if (frame.gpu_ms > 0.0) {
+      timing.stats.gpuFrames += 1u;
+      timing.stats.gpu_ms += frame.gpu_ms;
+    }
+
+    timing.pending.pop_front();
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+static
+VkCommandBuffer record_timestamp_cmd(VulkanContext &ctx,
+                                     const uint32_t query,
+                                     const bool bBegin)
+{
+  FrameTiming &timing = *ctx.frameTiming;
+
+  VkResult err;
+
+  VkCommandBufferAllocateInfo cmdInfo;
+  cmdInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  cmdInfo.pNext = nullptr;
+  cmdInfo.commandPool = ctx.cmdPool;
+  cmdInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  cmdInfo.commandBufferCount = 1u;
+
+  VkCommandBuffer cmd;
+  err = vkAllocateCommandBuffers(ctx.device, &cmdInfo, &cmd);
+  assert(!err);
+
+  VkCommandBufferBeginInfo beginInfo;
+  memset(&beginInfo, 0, sizeof(beginInfo));
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+  err = vkBeginCommandBuffer(cmd, &beginInfo);
+  assert(!err);
+
+  // the slot queries are reset before each frame
+  if (bBegin) {
+    vkCmdResetQueryPool(cmd, timing.queryPool, query, 2u);
+  }
+  /**
+  * The frame starts once color output, waiting on the image acquisitions,
+  * is unblocked : the wait for vsync is not counted as GPU frame time.
+  */
+  vkCmdWriteTimestamp(cmd,
+                      (bBegin) ? VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+                               : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                      timing.queryPool,
+                      (bBegin) ? query : query + 1u);
+
+  err = vkEndCommandBuffer(cmd);
+  assert(!err);
+
+  return cmd;
+}
+
+// ============================================================================
+
+void init_frame_timing(VulkanContext &ctx) {
+  PROFILE_FUNCTION();
+
+  assert(ctx.frameTiming == nullptr);
+  ctx.frameTiming = new FrameTiming();
+  FrameTiming &timing = *ctx.frameTiming;
+
+#ifdef VK_KHR_present_wait
+  if (ctx.caps.presentWait) {
+    timing.fpWaitForPresentKHR = (PFN_vkWaitForPresentKHR)
+      ctx.ext.fpGetDeviceProcAddr(ctx.device, "vkWaitForPresentKHR");
+  }
+#endif
+
+  /* Timestamps are only supported by some queue families */
+  const VkQueueFamilyProperties &queue = ctx.properties.queue[ctx.selected_queue_index];
+  timing.useTimestamps = (queue.timestampValidBits > 0u);
+  timing.timestampPeriod_ns = ctx.properties.gpu.limits.timestampPeriod;
+
+  std::fill(timing.slotValues, timing.slotValues + kMaxFramesInFlight, 0u);
+  std::fill(timing.statisticsValues, timing.statisticsValues + kMaxFramesInFlight, 0u);
+
+  VkResult err;
+
+  /* Pipeline statistics, counted by the draw command buffers of each surface */
+  timing.usePipelineStatistics = ctx.caps.pipelineStatistics;
+  timing.statisticsPerSlot = static_cast<uint32_t>(ctx.surfaces.size());
+
+  if (timing.usePipelineStatistics) {
+    VkQueryPoolCreateInfo poolInfo;
+    memset(&poolInfo, 0, sizeof(poolInfo));
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    poolInfo.queryCount = timing.statisticsPerSlot * kMaxFramesInFlight;
+    poolInfo.pipelineStatistics = kFramePipelineStatistics;
+
+    err = vkCreateQueryPool(ctx.device, &poolInfo, nullptr, &timing.statisticsPool);
+    assert(!err);
+  } else {
+    fprintf(stderr, "dev warning : no pipeline statistics support, GPU metrics are not counted.\n");
+  }
+
+  if (!timing.useTimestamps) {
+    fprintf(stderr, "dev warning : no timestamp support, GPU frame times are not measured.\n");
+    return;
+  }
+
+  VkQueryPoolCreateInfo poolInfo;
+  memset(&poolInfo, 0, sizeof(poolInfo));
+  poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  poolInfo.queryCount = 2u * kMaxFramesInFlight;
+
+  err = vkCreateQueryPool(ctx.device, &poolInfo, nullptr, &timing.queryPool);
+  assert(!err);
+
+  /* Recorded once, they always write the queries of their slot */
+  for (uint32_t i = 0u; i < kMaxFramesInFlight; ++i) {
+    timing.beginCmds[i] = record_timestamp_cmd(ctx, 2u * i, true);
+    timing.endCmds[i] = record_timestamp_cmd(ctx, 2u * i, false);
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+void release_frame_timing(VulkanContext &ctx) {
+  if (ctx.frameTiming == nullptr) {
+    return;
+  }
+  FrameTiming &timing = *ctx.frameTiming;
+
+  if (timing.stats.frames > 0u) {
+    const double n = timing.stats.frames;
+    fprintf(stdout, "latency : from input, update %.2f ms, submit %.2f ms, %s at most %.2f ms "
+                    "(max %.2f ms, %u frames)\n",
+            1e-3 * timing.stats.update_us / n,
+            1e-3 * timing.stats.submit_us / n,
+            (present_wait_enabled(timing)) ? "present" : "GPU completion",
+            1e-3 * timing.stats.presented_us / n,
+            1e-3 * timing.stats.maxPresented_us,
+            timing.stats.frames);
+  }
+  if (timing.stats.gpuFrames > 0u) {
+    fprintf(stdout, "latency : GPU frame %.2f ms, late latch delay %.2f ms on average\n",
+            timing.stats.gpu_ms / timing.stats.gpuFrames,
+            1e-3 * timing.stats.latch_us / std::max(timing.stats.frames, 1u));
+  }
+
+  if (timing.stats.statisticsFrames > 0u) {
+    const double n = timing.stats.statisticsFrames;
+    const uint64_t *s = timing.stats.statistics;
+    fprintf(stdout, "pipeline stats : %.0f primitives, %.0f vertex invocations "
+                    "(%.2f per primitive), clipping %.0f in / %.0f out, per frame\n",
+            s[0u] / n, s[1u] / n, s[1u] / std::max(double(s[0u]), 1.0),
+            s[2u] / n, s[3u] / n);
+    fprintf(stdout, "pipeline stats : %.0f fragment invocations per frame, "
+                    "%.2f per pixel (%u frames)\n",
+            s[4u] / n, s[4u] / std::max(double(timing.stats.pixels), 1.0),
+            timing.stats.statisticsFrames);
+  }
+
+  if (timing.usePipelineStatistics) {
+    vkDestroyQueryPool(ctx.device, timing.statisticsPool, nullptr);
+  }
+
+  if (timing.useTimestamps) {
+    vkFreeCommandBuffers(ctx.device, ctx.cmdPool, kMaxFramesInFlight, timing.beginCmds);
+    vkFreeCommandBuffers(ctx.device, ctx.cmdPool, kMaxFramesInFlight, timing.endCmds);
+    vkDestroyQueryPool(ctx.device, timing.queryPool, nullptr);
+  }
+
+  delete ctx.frameTiming;
+  ctx.frameTiming = nullptr;
+}
+
+// ----------------------------------------------------------------------------
+
+void collect_frame_timings(VulkanContext &ctx) {
+  FrameTiming &timing = *ctx.frameTiming;
+
+  timing.current = FrameTiming::Frame();
+  timing.current.start_us = profiler_now_us();
+
+  read_gpu_timestamps(ctx);
+  read_pipeline_statistics(ctx);
+  collect_presents(ctx);
+}
+
+// ----------------------------------------------------------------------------
+
+void wait_late_latch(VulkanContext &ctx) {
+  FrameTiming &timing = *ctx.frameTiming;
+  FrameScheduler &fs = *ctx.frameScheduler;
+
+  /* Without a GPU estimate, or once the GPU is idle, inputs are sampled now */
+  if (!ctx.app.options.lateLatch
+   || (timing.gpuFrame_ms <= 0.0)
+   || (poll_frame_value(ctx) >= fs.submittedValue)) {
+    return;
+  }
+
+  PROFILE_FUNCTION();
+
+  /* Submit right when the GPU completes the previous frame, with a margin */
+  const uint64_t margin_us = std::max(uint64_t(500u), uint64_t(100.0 * timing.gpuFrame_ms));
+  const uint64_t cpu_us = uint64_t(1000.0 * timing.cpuFrame_ms) + margin_us;
+  const uint64_t now_us = profiler_now_us();
+
+  if (timing.predictedIdle_us > now_us + cpu_us) {
+    const uint64_t delay_us = std::min(timing.predictedIdle_us - now_us - cpu_us,
+                                       kMaxLatchDelay_us);
+    std::this_thread::sleep_for(std::chrono::microseconds(delay_us));
+    timing.stats.latch_us += delay_us;
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+void mark_frame_input(VulkanContext &ctx) {
+  ctx.frameTiming->current.input_us = profiler_now_us();
+}
+
+// ----------------------------------------------------------------------------
+
+void mark_frame_update(VulkanContext &ctx) {
+  ctx.frameTiming->current.update_us = profiler_now_us();
+}
+
+// ----------------------------------------------------------------------------
+
+void mark_frame_submit(VulkanContext &ctx, const uint64_t value) {
+  FrameTiming &timing = *ctx.frameTiming;
+  FrameTiming::Frame &frame = timing.current;
+
+  frame.value = value;
+  frame.submit_us = profiler_now_us();
+
+  timing.cpuFrame_ms = moving_average(timing.cpuFrame_ms,
+                                      1e-3 * (frame.submit_us - frame.input_us));
+
+  /* The GPU starts the frame once submitted and done with the previous one */
+  timing.predictedIdle_us = std::max(frame.submit_us, timing.predictedIdle_us)
+                          + uint64_t(1000.0 * timing.gpuFrame_ms);
+
+  if (timing.useTimestamps) {
+    timing.slotValues[ctx.frameScheduler->slotIndex] = value;
+  }
+  if (timing.usePipelineStatistics) {
+    timing.statisticsValues[ctx.frameScheduler->slotIndex] = value;
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+void mark_frame_present(VulkanContext &ctx) {
+  FrameTiming &timing = *ctx.frameTiming;
+
+  timing.current.present_us = profiler_now_us();
+  timing.pending.push_back(timing.current);
+}
+
+// ----------------------------------------------------------------------------
+
+void get_frame_timing_cmds(VulkanContext &ctx,
+                           VkCommandBuffer &begin_cmd,
+                           VkCommandBuffer &end_cmd)
+{
+  const FrameTiming &timing = *ctx.frameTiming;
+  const uint32_t slot = ctx.frameScheduler->slotIndex;
+
+  begin_cmd = (timing.useTimestamps) ? timing.beginCmds[slot] : VK_NULL_HANDLE;
+  end_cmd = (timing.useTimestamps) ? timing.endCmds[slot] : VK_NULL_HANDLE;
+}
+
+// ----------------------------------------------------------------------------
+
+void begin_pipeline_statistics(VulkanContext &ctx,
+                               VkCommandBuffer cmd,
+                               const uint32_t surface_index,
+                               const uint32_t slot)
+{
+  const FrameTiming &timing = *ctx.frameTiming;
+  if (!timing.usePipelineStatistics) {
+    return;
+  }
+
+  // the query is reset by each submission of the command buffer
+  const uint32_t query = slot * timing.statisticsPerSlot + surface_index;
+  vkCmdResetQueryPool(cmd, timing.statisticsPool, query, 1u);
+  vkCmdBeginQuery(cmd, timing.statisticsPool, query, 0u);
+}
+
+// ----------------------------------------------------------------------------
+
+void end_pipeline_statistics(VulkanContext &ctx,
+                             VkCommandBuffer cmd,
+                             const uint32_t surface_index,
+                             const uint32_t slot)
+{
+  const FrameTiming &timing = *ctx.frameTiming;
+  if (!timing.usePipelineStatistics) {
+    return;
+  }
+
+  const uint32_t query = slot * timing.statisticsPerSlot + surface_index;
+  vkCmdEndQuery(cmd, timing.statisticsPool, query);
+}
+
+// ============================================================================
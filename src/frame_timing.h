@@ -0,0 +1,129 @@
+#ifndef FRAME_TIMING_H_
+#define FRAME_TIMING_H_
+
+#include <deque>
+
+#include "common.h"
+#include "frame_scheduler.h"
+
+/* Pipeline statistics counted per frame, in the order of their query results */
+const VkQueryPipelineStatisticFlags kFramePipelineStatistics =
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT
+  | VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT
+  | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT
+  | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT
+  | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+const uint32_t kFramePipelineStatisticCount = 5u;
+
+/**
+* Per-frame timestamps, from the sampling of its inputs to its presentation,
+* the GPU metrics of its passes, and the late latch scheduler.
+*
+* GPU frame times are measured with timestamp queries written at the end of
+* each frame submission, and at its start once the swapchain images are
+* acquired, at the color output stage. When the device supports them, pipeline
+* statistics queries enclose the passes of each surface, giving the vertex
+* load and the overdraw of the frame. Both are read once their frame slot is
+* acquired again, without waiting. With the late latch, the CPU sleeps
+* after acquiring a frame slot until just before the GPU is predicted to be
+* idle, minus the time needed to sample the inputs, update and submit, so
+* inputs are as fresh as possible without starving the GPU.
+*/
+struct FrameTiming {
+  /* CPU timestamps of a frame, in microseconds */
+  struct Frame {
+    uint64_t value = 0u;          // frame value, used as present id
+    uint64_t start_us = 0u;       // frame slot acquired
+    uint64_t input_us = 0u;       // inputs sampled
+    uint64_t update_us = 0u;      // scene updated
+    uint64_t submit_us = 0u;      // queue submission
+    uint64_t present_us = 0u;     // queue presentation
+    double gpu_ms = 0.0;          // GPU execution time, when measured
+  };
+
+  Frame current;
+  std::deque<Frame> pending;      // submitted, not presented yet
+
+  /* Timestamp queries, two per frame slot */
+  bool useTimestamps = false;
+  double timestampPeriod_ns = 1.0;
+  VkQueryPool queryPool = VK_NULL_HANDLE;
+  VkCommandBuffer beginCmds[kMaxFramesInFlight];
+  VkCommandBuffer endCmds[kMaxFramesInFlight];
+  uint64_t slotValues[kMaxFramesInFlight];   // frame measured by each slot
+
+  /* Pipeline statistics queries, one per surface and frame slot */
+  bool usePipelineStatistics = false;
+  VkQueryPool statisticsPool = VK_NULL_HANDLE;
+  uint32_t statisticsPerSlot = 0u;
+  uint64_t statisticsValues[kMaxFramesInFlight];   // frame counted by each slot
+
+  /* Late latch estimates */
+  double gpuFrame_ms = 0.0;       // moving average of the GPU frame time
+  double cpuFrame_ms = 0.0;       // moving average of input to submit
+  uint64_t predictedIdle_us = 0u; // predicted end of the last submission
+
+#ifdef VK_KHR_present_wait
+  PFN_vkWaitForPresentKHR fpWaitForPresentKHR = nullptr;
+#endif
+
+  struct {
+    uint32_t frames = 0u;
+    uint32_t gpuFrames = 0u;
+    uint64_t update_us = 0u;      // sums, from the input sampling
+    uint64_t submit_us = 0u;
+    uint64_t presented_us = 0u;   // upper bounds, seen at the next frame starts
+    uint64_t maxPresented_us = 0u;
+    uint64_t latch_us = 0u;
+    double gpu_ms = 0.0;
+
+    /* pipeline statistics sums, and the pixels of the frames counted */
+    uint32_t statisticsFrames = 0u;
+    uint64_t statistics[kFramePipelineStatisticCount] = {};
+    uint64_t pixels = 0u;
+  } stats;
+};
+
+/**/
+void init_frame_timing(VulkanContext &ctx);
+
+/* Report the latency statistics, and destroy the queries */
+void release_frame_timing(VulkanContext &ctx);
+
+/**
+* Once the frame slot is acquired, read the GPU times of its last frame and
+* account the frames presented since.
+*/
+void collect_frame_timings(VulkanContext &ctx);
+
+/* Sleep until the latest point the frame can sample its inputs (late latch) */
+void wait_late_latch(VulkanContext &ctx);
+
+/* Timestamp the steps of the current frame */
+void mark_frame_input(VulkanContext &ctx);
+void mark_frame_update(VulkanContext &ctx);
+void mark_frame_submit(VulkanContext &ctx, const uint64_t value);
+void mark_frame_present(VulkanContext &ctx);
+
+/**
+* Command buffers writing the timestamps of the current slot, submitted
+* first and last with the frame, or VK_NULL_HANDLE without timestamps.
+*/
+void get_frame_timing_cmds(VulkanContext &ctx,
+                           VkCommandBuffer &begin_cmd,
+                           VkCommandBuffer &end_cmd);
+
+/**
+* Enclose the passes recorded for a surface in the pipeline statistics query
+* of a frame slot, outside of any render pass. No-ops without the feature.
+*/
+void begin_pipeline_statistics(VulkanContext &ctx,
+                               VkCommandBuffer cmd,
+                               const uint32_t surface_index,
+                               const uint32_t slot);
+void end_pipeline_statistics(VulkanContext &ctx,
+                             VkCommandBuffer cmd,
+                             const uint32_t surface_index,
+                             const uint32_t slot);
+
+#endif  // FRAME_TIMING_H_
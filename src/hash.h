@@ -0,0 +1,36 @@
+#ifndef HASH_H_
+#define HASH_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/* 64bit FNV-1a, used to key the caches of Vulkan objects */
+
+static const uint64_t kHashSeed = 14695981039346656037ull;
+
+static inline
+uint64_t hash_bytes(const void *data, size_t size, uint64_t h = kHashSeed) {
+  const uint8_t *bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0u; i < size; ++i) {
+    h ^= bytes[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+static inline
+uint64_t hash_string(const char *str, uint64_t h = kHashSeed) {
+  for (; *str; ++str) {
+    h ^= static_cast<uint8_t>(*str);
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+/* Hash a trivially copyable value (with no padding bytes) */
+template<typename T> static inline
+uint64_t hash_value(const T &value, uint64_t h = kHashSeed) {
+  return hash_bytes(&value, sizeof(T), h);
+}
+
+#endif  // HASH_H_
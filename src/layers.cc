@@ -0,0 +1,158 @@
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include "vulkan/vulkan.h"
+#include "layers.h"
+
+// ============================================================================
+
+/**
+* Validation layers, by order of preference.
+* Each entry is a set of layers enabled together, the first set fully
+* available is used.
+*/
+static
+const char *g_khronos_validation[] = {
+  "VK_LAYER_KHRONOS_validation"
+};
+
+static
+const char *g_lunarg_standard_validation[] = {
+  "VK_LAYER_LUNARG_standard_validation"
+};
+
+// pre-1.1.73 SDK layers (image and swapchain were merged into core_validation)
+static
+const char *g_legacy_validation[] = {
+  "VK_LAYER_GOOGLE_threading",       "VK_LAYER_LUNARG_parameter_validation",
+  "VK_LAYER_LUNARG_object_tracker",  "VK_LAYER_LUNARG_core_validation",
+  "VK_LAYER_GOOGLE_unique_objects"
+};
+
+#define LAYER_SET(layers)  { layers, sizeof(layers) / sizeof(layers[0u]) }
+
+static const struct {
+  const char **names;
+  unsigned int count;
+} g_validation_sets[] = {
+  LAYER_SET(g_khronos_validation),
+  LAYER_SET(g_lunarg_standard_validation),
+  LAYER_SET(g_legacy_validation),
+};
+
+#undef LAYER_SET
+
+// ----------------------------------------------------------------------------
+
+void select_vk_layers(const LayerProfile profile, std::vector<char const*> &layers) {
+  VkResult err;
+
+  layers.clear();
+
+  if (profile == LAYER_PROFILE_PERFORMANCE) {
+    return;
+  }
+
+  /* Retrieve the available layers */
+  uint32_t layer_count = 0u;
+  err = vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
+  assert(!err);
+
+  std::vector<VkLayerProperties> available(layer_count);
+  err = vkEnumerateInstanceLayerProperties(&layer_count, available.data());
+  assert(!err);
+
+  auto is_available = [&available](const char *name) {
+    for (const auto &layer : available) {
+      if (!strcmp(layer.layerName, name)) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  /* Use the first validation set fully available */
+  for (const auto &set : g_validation_sets) {
+    bool bAvailable = true;
+    for (unsigned int i = 0u; i < set.count; ++i) {
+      bAvailable = bAvailable && is_available(set.names[i]);
+    }
+
+    if (bAvailable) {
+      layers.assign(set.names, set.names + set.count);
+      return;
+    }
+  }
+
+  fprintf(stderr, "Vulkan warning : no validation layers available, running without.\n");
+}
+
+// ----------------------------------------------------------------------------
+
+static
+VKAPI_ATTR VkBool32 VKAPI_CALL debug_messenger_callback(
+  VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+  VkDebugUtilsMessageTypeFlagsEXT type,
+  const VkDebugUtilsMessengerCallbackDataEXT *data,
+  void *user_data)
+{
+  const char *prefix = "info";
+  if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+    prefix = "error";
+  } else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+    prefix = "warning";
+  }
+
+  fprintf(stderr, "Vulkan %s%s : %s\n",
+          prefix,
+          (type & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT) ? " [performance]" : "",
+          data->pMessage);
+
+  // do not abort the call which triggered the message
+  return VK_FALSE;
+}
+
+// ----------------------------------------------------------------------------
+
+void setup_debug_messenger(VulkanContext &ctx) {
+  VkResult err;
+
+  ctx.ext.fpCreateDebugUtilsMessengerEXT = (PFN_vkCreateDebugUtilsMessengerEXT)
+    vkGetInstanceProcAddr(ctx.inst, "vkCreateDebugUtilsMessengerEXT");
+  ctx.ext.fpDestroyDebugUtilsMessengerEXT = (PFN_vkDestroyDebugUtilsMessengerEXT)
+    vkGetInstanceProcAddr(ctx.inst, "vkDestroyDebugUtilsMessengerEXT");
+
+  if (ctx.ext.fpCreateDebugUtilsMessengerEXT == nullptr) {
+    fprintf(stderr, "Vulkan warning : debug messenger entrypoints not found.\n");
+    return;
+  }
+
+  VkDebugUtilsMessengerCreateInfoEXT info;
+  memset(&info, 0, sizeof(info));
+  info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+  info.pNext = nullptr;
+  info.flags = 0u;
+  info.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT
+                       | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+  info.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT
+                   | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT
+                   | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+  info.pfnUserCallback = debug_messenger_callback;
+  info.pUserData = nullptr;
+
+  err = ctx.ext.fpCreateDebugUtilsMessengerEXT(ctx.inst, &info, nullptr, &ctx.debugMessenger);
+  assert(!err);
+}
+
+// ----------------------------------------------------------------------------
+
+void release_debug_messenger(VulkanContext &ctx) {
+  if (ctx.debugMessenger == VK_NULL_HANDLE) {
+    return;
+  }
+  ctx.ext.fpDestroyDebugUtilsMessengerEXT(ctx.inst, ctx.debugMessenger, nullptr);
+  ctx.debugMessenger = VK_NULL_HANDLE;
+}
+
+// ============================================================================
@@ -0,0 +1,17 @@
+#ifndef LAYERS_H_
+#define LAYERS_H_
+
+#include <vector>
+
+#include "common.h"
+
+/* Select the layers of a profile which are available on the system */
+void select_vk_layers(const LayerProfile profile, std::vector<char const*> &layers);
+
+/* Create the VK_EXT_debug_utils messenger, when enabled on the instance */
+void setup_debug_messenger(VulkanContext &ctx);
+
+/**/
+void release_debug_messenger(VulkanContext &ctx);
+
+#endif  // LAYERS_H_
@@ -11,14 +11,21 @@ This code is based on the LunarG's Vulkan SDK demo 'cube.c'
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
-#include <array>
 #include <vector>
 
 #include "vulkan/vulkan.h"
 
+#include "capture.h"
 #include "common.h"
+#include "entity.h"
+#include "extensions.h"
+#include "frame_timing.h"
+#include "layers.h"
+#include "mesh.h"
+#include "profiler.h"
 #include "setup.h"
 #include "render.h"
+#include "scene.h"
 
 
 // ============================================================================
@@ -73,6 +80,17 @@ void init_xcb_connection(XCBHandler &xcb) {
   while (scr--) xcb_screen_next(&iter);
 
   xcb.screen = iter.data;
+
+  /* Atoms used by every window to handle their destruction */
+  xcb_intern_atom_cookie_t cookie =
+      xcb_intern_atom(xcb.connection, 1, 12, "WM_PROTOCOLS");
+  xcb.atom_wm_protocols =
+      xcb_intern_atom_reply(xcb.connection, cookie, 0);
+
+  xcb_intern_atom_cookie_t cookie2 =
+      xcb_intern_atom(xcb.connection, 0, 16, "WM_DELETE_WINDOW");
+  xcb.atom_wm_delete_window =
+      xcb_intern_atom_reply(xcb.connection, cookie2, 0);
 }
 
 // ----------------------------------------------------------------------------
@@ -80,8 +98,10 @@ void init_xcb_connection(XCBHandler &xcb) {
 /**
 * Create a XCB window with basic event signals.
 */
-void create_xcb_window(const unsigned int width, const unsigned int height, XCBHandler &xcb) {
-  xcb.window = xcb_generate_id(xcb.connection);
+xcb_window_t create_xcb_window(const int x, const int y,
+                               const unsigned int width, const unsigned int height,
+                               const XCBHandler &xcb) {
+  xcb_window_t window = xcb_generate_id(xcb.connection);
 
   // Enable background pixels and event handling on the window
   uint32_t value_mask = XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK;
@@ -92,14 +112,15 @@ void create_xcb_window(const unsigned int width, const unsigned int height, XCBH
   value_list[0u] = xcb.screen->black_pixel;
 
   value_list[1u] =  XCB_EVENT_MASK_KEY_RELEASE
+                  | XCB_EVENT_MASK_POINTER_MOTION
                   | XCB_EVENT_MASK_EXPOSURE
                   | XCB_EVENT_MASK_STRUCTURE_NOTIFY;
 
   xcb_create_window(  xcb.connection,
                       XCB_COPY_FROM_PARENT,
-                      xcb.window,
+                      window,
                       xcb.screen->root,
-                      0u, 0u,
+                      x, y,
                       width, height,
                       0,
                       XCB_WINDOW_CLASS_INPUT_OUTPUT,
@@ -109,111 +130,149 @@ void create_xcb_window(const unsigned int width, const unsigned int height, XCBH
 
 
   /* Destruction events handling */
-  xcb_intern_atom_cookie_t cookie =
-      xcb_intern_atom(xcb.connection, 1, 12, "WM_PROTOCOLS");
-  xcb_intern_atom_reply_t *reply =
-      xcb_intern_atom_reply(xcb.connection, cookie, 0);
-
-  xcb_intern_atom_cookie_t cookie2 =
-      xcb_intern_atom(xcb.connection, 0, 16, "WM_DELETE_WINDOW");
-  xcb.atom_wm_delete_window =
-      xcb_intern_atom_reply(xcb.connection, cookie2, 0);
-
-  xcb_change_property(xcb.connection, XCB_PROP_MODE_REPLACE, xcb.window,
-                      (*reply).atom, 4, 32, 1,
+  xcb_change_property(xcb.connection, XCB_PROP_MODE_REPLACE, window,
+                      (*xcb.atom_wm_protocols).atom, 4, 32, 1,
                       &(*xcb.atom_wm_delete_window).atom);
-  free(reply);
 
 
   /* Map the window to the screen (xserver) */
-  xcb_map_window(xcb.connection, xcb.window);
+  xcb_map_window(xcb.connection, window);
 
   /* Flush XCB pending events, which will display the window */
   xcb_flush(xcb.connection);
+
+  return window;
 }
 
 // ----------------------------------------------------------------------------
 
 void init_wm(WindowContext &winContext) {
+  PROFILE_FUNCTION();
+
   init_xcb_connection(winContext.xcb);
 }
 
 // ----------------------------------------------------------------------------
 
-void create_window(VulkanContext &vkContext, WindowContext &winContext) {
+/**
+* Create the windows side by side, each with a surface bound to Vulkan.
+* The surfaces are created once, as their address is kept by the frame
+* objects built from them.
+*/
+void create_windows(VulkanContext &vkContext, WindowContext &winContext) {
+  PROFILE_FUNCTION();
+
   VkResult err;
 
-  /* Init XCB and create a window */
-  create_xcb_window(vkContext.app.width, vkContext.app.height, winContext.xcb);
+  const uint32_t width = vkContext.app.width;
+  const uint32_t height = vkContext.app.height;
 
-  /* Create the Vulkan - XCB surface */
-  VkXcbSurfaceCreateInfoKHR createInfo;
-  createInfo.sType = VK_STRUCTURE_TYPE_XCB_SURFACE_CREATE_INFO_KHR;
-  createInfo.pNext = nullptr;
-  createInfo.flags = 0;
-  createInfo.connection = winContext.xcb.connection;
-  createInfo.window = winContext.xcb.window;
+  vkContext.surfaces.resize(vkContext.app.options.windows);
 
-  err = vkCreateXcbSurfaceKHR(vkContext.inst, &createInfo, nullptr, &vkContext.surface);
-  CHECK_VK(err);
+  for (uint32_t i = 0u; i < vkContext.surfaces.size(); ++i) {
+    SurfaceContext &surface = vkContext.surfaces[i];
+
+    /* Create a XCB window */
+    surface.window = create_xcb_window(i * width, 0, width, height, winContext.xcb);
+    surface.width = width;
+    surface.height = height;
 
-  // This is a WM specific call, typically for GLFW we'll call
-  // glfwCreateWindowSurface(vkContext.inst, &glfw_window, nullptr, &vkContext.surface)
+    /* Create the Vulkan - XCB surface */
+    VkXcbSurfaceCreateInfoKHR createInfo;
+    createInfo.sType = VK_STRUCTURE_TYPE_XCB_SURFACE_CREATE_INFO_KHR;
+    createInfo.pNext = nullptr;
+    createInfo.flags = 0;
+    createInfo.connection = winContext.xcb.connection;
+    createInfo.window = surface.window;
+
+    err = vkCreateXcbSurfaceKHR(vkContext.inst, &createInfo, nullptr, &surface.surface);
+    CHECK_VK(err);
+
+    // This is a WM specific call, typically for GLFW we'll call
+    // glfwCreateWindowSurface(vkContext.inst, &glfw_window, nullptr, &surface.surface)
+  }
 }
 
 // ----------------------------------------------------------------------------
 
-void wm_mainloop(VulkanContext &vkContext, WindowContext &winContext) {
-  while (true) {
-    /* handle events */
-    xcb_generic_event_t *event = xcb_poll_for_event(winContext.xcb.connection);
-    if (event) {
-      free(event);
-    }
+/**
+* Check if an event asks to close the application : the window manager
+* delete message or the Escape key.
+*/
+static
+bool is_quit_event(const XCBHandler &xcb, const xcb_generic_event_t *event) {
+  const uint8_t kEscapeKeycode = 9u;
 
-    /**/
-    render_frame(vkContext);
-  }
+  switch (event->response_type & 0x7f) {
+    case XCB_CLIENT_MESSAGE:
+      return reinterpret_cast<const xcb_client_message_event_t*>(event)->data.data32[0]
+          == xcb.atom_wm_delete_window->atom;
+
+    case XCB_KEY_RELEASE:
+      return reinterpret_cast<const xcb_key_release_event_t*>(event)->detail
+          == kEscapeKeycode;
+
+    default:
+      return false;
+  };
 }
 
 // ----------------------------------------------------------------------------
 
 /**
-* Search for specific Vulkan extensions and fill an array with the found ones.
-* @return false if at least one extension has not been found.
+* Apply an input event to the scene : the pointer rotates the triangle,
+* in any of the windows.
 */
-bool search_vk_extensions(const VkExtensionProperties vk_extensions[],
-                          const unsigned int vk_extension_count,
-                          char const* const requested_extensions[],
-                          const unsigned int requested_extension_count,
-                          std::vector<char const*> &enabled_extensions)
-{
-  std::vector<bool> bFoundExt(requested_extension_count, false);
-  unsigned int enabled_count = 0u;
-
-  /* Search for requested extensions */
-  for (unsigned int j = 0u; j < vk_extension_count; ++j) {
-    const char* instance_ext_name = vk_extensions[j].extensionName;
-    for (unsigned int i = 0u; i < requested_extension_count; ++i) {
-      if (!strcmp(requested_extensions[i], instance_ext_name)) {
-        // Use Vulkan's constant extension name pointers
-        enabled_extensions[enabled_count++] = requested_extensions[i];
-        bFoundExt[i] = true;
-      }
+static
+void handle_input_event(VulkanContext &ctx, const xcb_generic_event_t *event) {
+  if ((event->response_type & 0x7f) != XCB_MOTION_NOTIFY) {
+    return;
+  }
+
+  const xcb_motion_notify_event_t *motion =
+    reinterpret_cast<const xcb_motion_notify_event_t*>(event);
+
+  for (const auto &surface : ctx.surfaces) {
+    if ((surface.window == motion->event) && (surface.width > 0u)) {
+      const float x = motion->event_x / static_cast<float>(surface.width);
+      const float angle = static_cast<float>(2.0 * M_PI) * (x - 0.5f);
+
+      mat4x4 identity, rotation;
+      mat4x4_identity(identity);
+      mat4x4_rotate_Z(rotation, identity, angle);
+      set_scene_node_local(*ctx.sceneGraph, ctx.scene.triangle, rotation);
     }
   }
-  enabled_extensions.resize(enabled_count);
-
-  /* Check if the requested extensions were found */
-  bool bNotFound = false;
-  for (unsigned int i = 0u; i < requested_extension_count; ++i) {
-    if (!bFoundExt[i]) {
-      fprintf(stderr, "Vulkan error : extensions %s not found.\n", requested_extensions[i]);
-      bNotFound = true;
+}
+
+// ----------------------------------------------------------------------------
+
+void wm_mainloop(VulkanContext &vkContext, WindowContext &winContext) {
+  const uint32_t max_frames = vkContext.app.options.frames;
+  uint32_t frame = 0u;
+  bool bRunning = true;
+
+  while (bRunning) {
+    /* Wait for a frame slot, and with the late latch for the GPU */
+    begin_render_frame(vkContext);
+
+    /* Handle every event received since the last frame */
+    xcb_generic_event_t *event;
+    while ((event = xcb_poll_for_event(winContext.xcb.connection)) != nullptr) {
+      bRunning &= !is_quit_event(winContext.xcb, event);
+      handle_input_event(vkContext, event);
+      free(event);
+    }
+    mark_frame_input(vkContext);
+
+    /**/
+    bRunning &= render_frame(vkContext);
+
+    /* Bounded runs, eg. for captures */
+    if ((max_frames > 0u) && (++frame >= max_frames)) {
+      bRunning = false;
     }
   }
-  
-  return !bNotFound;
 }
 
 // ----------------------------------------------------------------------------
@@ -221,33 +280,33 @@ bool search_vk_extensions(const VkExtensionProperties vk_extensions[],
 /**
 * Set extensions for a Vulkan instance.
 */
-void set_vk_instance_extensions(char const* const requested_exts[],
-                                const unsigned int requested_exts_count,
-                                std::vector<char const *> &enabled_extension_names) 
+void set_vk_instance_extensions(VulkanContext &ctx,
+                                std::vector<char const *> &enabled_extension_names)
 {
-  VkResult err;
+  PROFILE_FUNCTION();
 
-  uint32_t instance_ext_count(0u);
-  err = vkEnumerateInstanceExtensionProperties(nullptr, &instance_ext_count, nullptr);
-  CHECK_VK(err);
+  ExtensionIndex index;
+  index_instance_extensions(index);
 
-  if (instance_ext_count == 0u) {
+  if (index.properties.empty()) {
     fprintf(stderr, "Vulkan error : no instance extensions found.\n");
     exit(EXIT_FAILURE);
   }
 
-  VkExtensionProperties *extensions = new VkExtensionProperties[instance_ext_count];
-  enabled_extension_names.resize(instance_ext_count, nullptr);
+  std::vector<ExtensionRequest> requests({
+    { VK_KHR_SURFACE_EXTENSION_NAME,     true, nullptr },
+    { VK_KHR_XCB_SURFACE_EXTENSION_NAME, true, nullptr },
 
-  err = vkEnumerateInstanceExtensionProperties(nullptr, &instance_ext_count, extensions);
-  CHECK_VK(err);
+    // needed by most optional device extensions on a 1.0 instance
+    { VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME, false,
+      &ctx.caps.physicalDeviceProperties2 },
+  });
 
-  bool bFound = search_vk_extensions(extensions, instance_ext_count,
-                                     requested_exts, requested_exts_count,
-                                     enabled_extension_names);
-  delete [] extensions;
+  if (ctx.app.options.debugMessenger) {
+    requests.push_back({ VK_EXT_DEBUG_UTILS_EXTENSION_NAME, false, &ctx.caps.debugUtils });
+  }
 
-  if (!bFound) {
+  if (!negotiate_extensions(index, requests, enabled_extension_names)) {
     fprintf(stderr, "Vulkan error : requested instance extension(s) not found.\n");
     exit(EXIT_FAILURE);
   }
@@ -258,33 +317,39 @@ void set_vk_instance_extensions(char const* const requested_exts[],
 /**
 * Set extensions for a Vulkan device.
 */
-void set_vk_device_extensions(char const* const requested_exts[],
-                              const unsigned int requested_exts_count,
-                              VulkanContext &ctx)
-{
-  VkResult err;
+void set_vk_device_extensions(VulkanContext &ctx) {
+  PROFILE_FUNCTION();
 
-  uint32_t extension_count(0u);
-  err = vkEnumerateDeviceExtensionProperties(ctx.gpu, nullptr, &extension_count, nullptr);
-  CHECK_VK(err);
+  ExtensionIndex index;
+  index_device_extensions(ctx.gpu, index);
 
-  if (extension_count == 0u) {
+  if (index.properties.empty()) {
     fprintf(stderr, "Vulkan error : no device extensions found.\n");
     exit(EXIT_FAILURE);
   }
 
-  VkExtensionProperties *extensions = new VkExtensionProperties[extension_count];
-  ctx.device_extension_names.resize(extension_count);
-
-  err = vkEnumerateDeviceExtensionProperties(ctx.gpu, nullptr, &extension_count, extensions);
-  CHECK_VK(err);
+  std::vector<ExtensionRequest> requests({
+    { VK_KHR_SWAPCHAIN_EXTENSION_NAME, true, nullptr },
+  });
 
-  bool bFound = search_vk_extensions(extensions, extension_count,
-                                     requested_exts, requested_exts_count,
-                                     ctx.device_extension_names);
-  delete [] extensions;
+  /* Optional extensions, which all depend on VK_KHR_get_physical_device_properties2 */
+  if (ctx.caps.physicalDeviceProperties2) {
+    requests.push_back({ VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME, false,
+                         &ctx.caps.timelineSemaphore });
+    requests.push_back({ VK_EXT_MEMORY_BUDGET_EXTENSION_NAME, false,
+                         &ctx.caps.memoryBudget });
+#ifdef VK_KHR_present_id
+    requests.push_back({ VK_KHR_PRESENT_ID_EXTENSION_NAME, false,
+                         &ctx.caps.presentId });
+#endif
+#if defined(VK_KHR_present_wait) && defined(VK_KHR_present_id)
+    // presents are waited by their id
+    requests.push_back({ VK_KHR_PRESENT_WAIT_EXTENSION_NAME, false,
+                         &ctx.caps.presentWait, VK_KHR_PRESENT_ID_EXTENSION_NAME });
+#endif
+  }
 
-  if (!bFound) {
+  if (!negotiate_extensions(index, requests, ctx.device_extension_names)) {
     fprintf(stderr, "Vulkan error : requested device extension(s) not found.\n");
     exit(EXIT_FAILURE);
   }
@@ -334,42 +399,21 @@ void retrieve_vk_device_ext_entrypoints(const VkDevice &device, VulkanExtensionF
 
 // ----------------------------------------------------------------------------
 
-// shared between instance and device
-static
-const char *g_validation_layers[] = {
-    //"VK_LAYER_LUNARG_standard_validation",
-
-    
-    "VK_LAYER_GOOGLE_threading",       "VK_LAYER_LUNARG_parameter_validation",
-    "VK_LAYER_LUNARG_object_tracker",  "VK_LAYER_LUNARG_image",
-    "VK_LAYER_LUNARG_core_validation", "VK_LAYER_LUNARG_swapchain",
-    "VK_LAYER_GOOGLE_unique_objects"
-};
-
-static
-const unsigned int g_layer_count = sizeof(g_validation_layers) / sizeof(g_validation_layers[0u]);
-
-// ----------------------------------------------------------------------------
-
 /*
   Setup the Vulkan instance and device with their requested validations layers 
   and extensions.
 */
 void init_vk(VulkanContext &ctx) {
+  PROFILE_FUNCTION();
+
   VkResult err;
 
-  /* Set instance's validation layers */
-  // see globals
+  /* Set instance's validation layers, depending on the selected profile */
+  select_vk_layers(ctx.app.options.layerProfile, ctx.layer_names);
 
   /* Set instance's extensions */
-  const std::array<char const*, 2u> requestedInstanceExts({
-    VK_KHR_SURFACE_EXTENSION_NAME,
-    VK_KHR_XCB_SURFACE_EXTENSION_NAME,
-  });
   std::vector<char const *> extension_names;
-  set_vk_instance_extensions(requestedInstanceExts.data(),
-                             requestedInstanceExts.size(),
-                             extension_names);
+  set_vk_instance_extensions(ctx, extension_names);
 
   /* Create a Vulkan instance */
   const VkApplicationInfo app = {
@@ -387,12 +431,20 @@ void init_vk(VulkanContext &ctx) {
   info.pNext = nullptr;
   info.flags = 0;
   info.pApplicationInfo = &app;
-  info.enabledLayerCount = g_layer_count;
-  info.ppEnabledLayerNames = g_validation_layers;
+  info.enabledLayerCount = ctx.layer_names.size();
+  info.ppEnabledLayerNames = ctx.layer_names.data();
   info.enabledExtensionCount = extension_names.size();
   info.ppEnabledExtensionNames = (const char *const *)extension_names.data();
 
-  err = vkCreateInstance(&info, nullptr, &ctx.inst); CHECK_VK(err);
+  {
+    // validation layers are loaded here
+    PROFILE_ZONE("vkCreateInstance");
+    err = vkCreateInstance(&info, nullptr, &ctx.inst); CHECK_VK(err);
+  }
+
+  if (ctx.caps.debugUtils) {
+    setup_debug_messenger(ctx);
+  }
 
 
   /* Retrieve the physical device with its properties */
@@ -432,20 +484,17 @@ void init_vk(VulkanContext &ctx) {
   }
 
 
-  /* [Optional] Retrieve device's features */
-  //VkPhysicalDeviceFeatures device_features;
-  //vkGetPhysicalDeviceFeatures(ctx.gpu, &device_features);
+  /* Retrieve device's optional features */
+  VkPhysicalDeviceFeatures device_features;
+  vkGetPhysicalDeviceFeatures(ctx.gpu, &device_features);
+  ctx.caps.pipelineStatistics = (device_features.pipelineStatisticsQuery == VK_TRUE);
 
   /* Set device's layers */
   // TODO
 
   /* Set device's extensions */
-  const std::array<char const*, 1u> requestedDeviceExts({
-    VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-  });
-  set_vk_device_extensions(requestedDeviceExts.data(),
-                           requestedDeviceExts.size(),
-                           ctx);
+  set_vk_device_extensions(ctx);
+  print_vk_capabilities(ctx.caps);
 
 
   /* Retrieve instance's function pointers */
@@ -454,21 +503,55 @@ void init_vk(VulkanContext &ctx) {
 
 // ----------------------------------------------------------------------------
 
+/* Check a surface supports the swapchain format and color space selected */
+static
+bool is_surface_format_supported(const VulkanContext &ctx, const VkSurfaceKHR surface) {
+  uint32_t format_count = 0u;
+  VkResult err = ctx.ext.fpGetPhysicalDeviceSurfaceFormatsKHR(
+    ctx.gpu, surface, &format_count, nullptr
+  );
+  CHECK_VK(err);
+
+  std::vector<VkSurfaceFormatKHR> formats(format_count);
+  err = ctx.ext.fpGetPhysicalDeviceSurfaceFormatsKHR(
+    ctx.gpu, surface, &format_count, formats.data()
+  );
+  CHECK_VK(err);
+
+  for (const auto &format : formats) {
+    if (  ((format.format == ctx.format) || (format.format == VK_FORMAT_UNDEFINED))
+       && (format.colorSpace == ctx.color_space)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// ----------------------------------------------------------------------------
+
 void init_vk_device(VulkanContext &ctx) {
+  PROFILE_FUNCTION();
+
   VkResult err;
 
   // The Graphics support is used to render
   // The Surface support is used for display
 
-  /* Retrieve the list of surface support state for queues */
+  /* Retrieve the list of surface support state for queues, for every surface */
   VkBool32 *surfaceSupport = new VkBool32[ctx.queue_count]();
   for (unsigned int i=0u; i<ctx.queue_count; ++i) {
-    ctx.ext.fpGetPhysicalDeviceSurfaceSupportKHR(
-      ctx.gpu, i, ctx.surface, &surfaceSupport[i]
-    );
+    surfaceSupport[i] = VK_TRUE;
+
+    for (const auto &surface : ctx.surfaces) {
+      VkBool32 supported = VK_FALSE;
+      ctx.ext.fpGetPhysicalDeviceSurfaceSupportKHR(
+        ctx.gpu, i, surface.surface, &supported
+      );
+      surfaceSupport[i] &= supported;
+    }
   }
   
-  /* Search a queue with both graphics and surface presentation support */
+  /* Search a queue with both graphics and surfaces presentation support */
   uint32_t valid_queue_index = UINT32_MAX;
   for (unsigned int i=0u; i<ctx.queue_count; ++i) {
     if (    (ctx.properties.queue[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
@@ -500,18 +583,56 @@ void init_vk_device(VulkanContext &ctx) {
     queue.queueCount = 1u;
     queue.pQueuePriorities = queue_priorities;
 
+    /* Enable the features of the optional extensions found */
+    void *pFeatures = nullptr;
+
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures;
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+    timelineFeatures.pNext = pFeatures;
+    timelineFeatures.timelineSemaphore = VK_TRUE;
+    if (ctx.caps.timelineSemaphore) {
+      pFeatures = &timelineFeatures;
+    }
+
+#ifdef VK_KHR_present_id
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures;
+    presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    presentIdFeatures.pNext = pFeatures;
+    presentIdFeatures.presentId = VK_TRUE;
+    if (ctx.caps.presentId) {
+      pFeatures = &presentIdFeatures;
+    }
+#endif
+
+#ifdef VK_KHR_present_wait
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures;
+    presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    presentWaitFeatures.pNext = pFeatures;
+    presentWaitFeatures.presentWait = VK_TRUE;
+    if (ctx.caps.presentWait) {
+      pFeatures = &presentWaitFeatures;
+    }
+#endif
+
+    /* Core features, only those used are enabled */
+    VkPhysicalDeviceFeatures features;
+    memset(&features, 0, sizeof(features));
+    features.pipelineStatisticsQuery = (ctx.caps.pipelineStatistics) ? VK_TRUE : VK_FALSE;
+
     VkDeviceCreateInfo device;
     device.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    device.pNext = nullptr;
+    device.pNext = pFeatures;
     device.flags = 0;
     device.queueCreateInfoCount = 1u;
     device.pQueueCreateInfos = &queue;
-    device.enabledLayerCount = g_layer_count;
-    device.ppEnabledLayerNames = g_validation_layers;
+    // device layers are deprecated, but still expected by older loaders
+    device.enabledLayerCount = ctx.layer_names.size();
+    device.ppEnabledLayerNames = ctx.layer_names.data();
     device.enabledExtensionCount = ctx.device_extension_names.size(),
     device.ppEnabledExtensionNames = (const char *const *)ctx.device_extension_names.data();
-    device.pEnabledFeatures = nullptr;
+    device.pEnabledFeatures = &features;
 
+    PROFILE_ZONE("vkCreateDevice");
     err = vkCreateDevice(ctx.gpu, &device, nullptr, &ctx.device);
     CHECK_VK(err);
   }
@@ -523,10 +644,12 @@ void init_vk_device(VulkanContext &ctx) {
   /* Retrieve device's function pointers */
   retrieve_vk_device_ext_entrypoints(ctx.device, ctx.ext);
 
-  /* Retrieve the surface formats supported */
+  /* Retrieve the surface formats supported, by the primary surface */
+  const VkSurfaceKHR primary = ctx.surfaces.front().surface;
+
   uint32_t format_count;
   err = ctx.ext.fpGetPhysicalDeviceSurfaceFormatsKHR(
-    ctx.gpu, ctx.surface, &format_count, nullptr
+    ctx.gpu, primary, &format_count, nullptr
   );
   CHECK_VK(err);
 
@@ -537,7 +660,7 @@ void init_vk_device(VulkanContext &ctx) {
 
   VkSurfaceFormatKHR *formats = new VkSurfaceFormatKHR[format_count];
   err = ctx.ext.fpGetPhysicalDeviceSurfaceFormatsKHR(
-    ctx.gpu, ctx.surface, &format_count, formats
+    ctx.gpu, primary, &format_count, formats
   );
   CHECK_VK(err);
 
@@ -547,26 +670,111 @@ void init_vk_device(VulkanContext &ctx) {
   ctx.color_space = formats[0u].colorSpace;
     
   delete [] formats;
+
+  /* Surfaces share the swapchain format, for their pipelines to be shared */
+  for (uint32_t i = 1u; i < ctx.surfaces.size(); ++i) {
+    if (!is_surface_format_supported(ctx, ctx.surfaces[i].surface)) {
+      fprintf(stderr, "Vulkan error : window %u does not support the surface format.\n", i);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+* Destroy the Vulkan device, surfaces and instance, once every objects
+* created from them have been released.
+*/
+void release_vk(VulkanContext &ctx) {
+  PROFILE_FUNCTION();
+
+  vkDestroyDevice(ctx.device, nullptr);
+  ctx.device = VK_NULL_HANDLE;
+  ctx.queue = VK_NULL_HANDLE;
+
+  for (auto &surface : ctx.surfaces) {
+    vkDestroySurfaceKHR(ctx.inst, surface.surface, nullptr);
+    surface.surface = VK_NULL_HANDLE;
+  }
+
+  release_debug_messenger(ctx);
+
+  vkDestroyInstance(ctx.inst, nullptr);
+  ctx.inst = VK_NULL_HANDLE;
+
+  delete [] ctx.properties.queue;
+  ctx.properties.queue = nullptr;
+}
+
+// ----------------------------------------------------------------------------
+
+void release_windows(VulkanContext &vkContext, WindowContext &winContext) {
+  XCBHandler &xcb = winContext.xcb;
+
+  for (auto &surface : vkContext.surfaces) {
+    xcb_destroy_window(xcb.connection, surface.window);
+    surface.window = 0u;
+  }
+  vkContext.surfaces.clear();
+
+  free(xcb.atom_wm_protocols);
+  free(xcb.atom_wm_delete_window);
+  xcb_disconnect(xcb.connection);
+
+  xcb.atom_wm_protocols = nullptr;
+  xcb.atom_wm_delete_window = nullptr;
+  xcb.connection = nullptr;
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+* Build the scene, once the meshes are loaded : a root node with the mesh
+* as its single child, driving the transform of its entity.
+*/
+void init_scene(VulkanContext &ctx) {
+  PROFILE_FUNCTION();
+
+  init_entity_store(ctx);
+  init_scene_graph(ctx);
+  EntityStore &store = *ctx.entityStore;
+  SceneGraph &graph = *ctx.sceneGraph;
+
+  // the mesh given on the command line, or the triangle
+  const Mesh &mesh = get_mesh(ctx, ctx.scene.mesh);
+  const EntityId triangle = create_entity(store, kDrawableComponents);
+  set_entity_bounds(store, triangle, mesh.bounds);
+  set_entity_renderable(store, triangle, ctx.scene.mesh, 0u);
+
+  const SceneNodeId root = add_scene_node(graph, kSceneNone);
+  ctx.scene.triangle = add_scene_node(graph, root, triangle);
 }
 
 // ----------------------------------------------------------------------------
 
 void init_app(VulkanContext &ctx) {
+  PROFILE_FUNCTION();
+
   vec3 eye    = {0.0f, 0.0f, 5.0f};
   vec3 origin = {0.0f, 0.0f, 0.0f};
   vec3 up     = {0.0f, 1.0f, 0.0f};
 
+  /* The scene is shared by the windows, framed for the primary one */
+  const SurfaceContext &primary = ctx.surfaces.front();
+
   mat4x4_perspective(
     ctx.scene.projection,
     static_cast<float>(degreesToRadians(60.0f)),
-    ctx.app.width / static_cast<float>(ctx.app.height),
+    primary.width / static_cast<float>(primary.height),
     0.1f,
     500.0f
   );
   
   mat4x4_look_at(ctx.scene.view, eye, origin, up);
-  
-  mat4x4_identity(ctx.scene.model);
+
+  /* Every uniform slice is updated with the new camera */
+  ctx.scene.cameraSlices = ~0u;
 }
 
 // ----------------------------------------------------------------------------
@@ -578,6 +786,12 @@ int main(int argc, char *argv[]) {
   vkContext.app.width = 800u;
   vkContext.app.height = 450u;
 
+  parse_options(argc, argv, vkContext.app.options);
+
+  /* Profiling is enabled by giving a trace output file */
+  const char *trace_filename = getenv("VK_TRIANGLE_TRACE");
+  profiler_set_enabled(trace_filename != nullptr);
+
 
   /// 1 - Initialize Vulkan / WM
 
@@ -587,8 +801,8 @@ int main(int argc, char *argv[]) {
   /* Initialize Vulkan */
   init_vk(vkContext);
 
-  /* Create a window with a surface bound to Vulkan */
-  create_window(vkContext, windowContext);
+  /* Create the windows, each with a surface bound to Vulkan */
+  create_windows(vkContext, windowContext);
 
   /* Initialize the Vulkan device */
   init_vk_device(vkContext);
@@ -596,9 +810,12 @@ int main(int argc, char *argv[]) {
 
   /// 2 - Initialize Application datas
 
-  /* Initialize Vulkan objects */
+  /* Initialize Vulkan objects, and load the meshes */
   setup_vk_data(vkContext);
 
+  /* Build the scene hierarchy, from the meshes loaded */
+  init_scene(vkContext);
+
   /* Initialize the application parameters */
   init_app(vkContext);
 
@@ -608,10 +825,29 @@ int main(int argc, char *argv[]) {
   /* Mainloop */
   wm_mainloop(vkContext, windowContext);
 
-  /* Clean exit */
-  // TODO
 
-  return EXIT_SUCCESS;
+  /// 4 - Clean exit
+
+  /* Wait for the frame readbacks, and their golden image comparison */
+  const bool bCaptureValid = finish_captures(vkContext);
+
+  /* Release Vulkan objects, after the GPU has finished with them */
+  release_vk_data(vkContext);
+
+  /* Scene statistics, hierarchy and entities */
+  release_scene_graph(vkContext);
+  release_entity_store(vkContext);
+
+  /* Release the Vulkan device / instance, then the windows */
+  release_vk(vkContext);
+  release_windows(vkContext, windowContext);
+
+  /* Export the profiled zones, viewable in chrome://tracing */
+  if (trace_filename != nullptr) {
+    profiler_export_chrome_trace(trace_filename);
+  }
+
+  return (bCaptureValid) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 // ============================================================================
@@ -0,0 +1,214 @@
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "vulkan/vulkan.h"
+#include "mesh.h"
+#include "profiler.h"
+#include "setup.h"
+#include "staging.h"
+
+// ============================================================================
+
+/* Size of the vertex attributes as floats (position, normal, color) */
+static const VkDeviceSize kFloatVertexSize = (3u + 3u + 4u) * sizeof(float);
+
+// ----------------------------------------------------------------------------
+
+/* Create the device buffer of a mapped mesh and stage the copy of its streams */
+static
+void upload_mesh(VulkanContext &ctx, const MeshView &view, Mesh &mesh) {
+  VkResult err;
+
+  const MeshFileHeader &header = *view.header;
+
+  const VkDeviceSize vertexSize = VkDeviceSize(header.vertexCount) * header.vertexStride;
+  const VkDeviceSize indexSize = VkDeviceSize(header.indexCount) * header.indexSize;
+
+  mesh.indexOffset = ((vertexSize + kMeshStreamAlignment - 1u) / kMeshStreamAlignment)
+                   * kMeshStreamAlignment;
+  mesh.indexType = (header.indexSize == 2u) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+  mesh.vertexCount = header.vertexCount;
+
+  /* Vertices and indices share a device local buffer */
+  VkBufferCreateInfo bufferInfo;
+  memset(&bufferInfo, 0, sizeof(bufferInfo));
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = mesh.indexOffset + indexSize;
+  bufferInfo.usage =   VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+                     | VK_BUFFER_USAGE_INDEX_BUFFER_BIT
+                     | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  err = vkCreateBuffer(ctx.device, &bufferInfo, nullptr, &mesh.buffer);
+  assert(!err);
+
+  VkMemoryRequirements memReqs;
+  vkGetBufferMemoryRequirements(ctx.device, mesh.buffer, &memReqs);
+
+  VkMemoryAllocateInfo allocInfo;
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.pNext = nullptr;
+  allocInfo.allocationSize = memReqs.size;
+  allocInfo.memoryTypeIndex = 0u;
+
+  bool res = retrieve_memory_type_index(
+    ctx.properties.memory,
+    memReqs.memoryTypeBits,
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+    &allocInfo.memoryTypeIndex
+  );
+  assert(res);
+
+  err = vkAllocateMemory(ctx.device, &allocInfo, nullptr, &mesh.mem);
+  assert(!err);
+
+  err = vkBindBufferMemory(ctx.device, mesh.buffer, mesh.mem, 0u);
+  assert(!err);
+
+  /* The streams are copied as laid out in the file */
+  stage_buffer_upload(ctx, mesh.buffer, 0u, view.vertices, vertexSize);
+  stage_buffer_upload(ctx, mesh.buffer, mesh.indexOffset, view.indices, indexSize);
+
+  mesh.lods.resize(header.lodCount);
+  for (uint32_t i = 0u; i < header.lodCount; ++i) {
+    mesh.lods[i] = MeshLod{ view.lods[i].firstIndex, view.lods[i].indexCount, view.lods[i].error };
+  }
+
+  memcpy(mesh.bounds.center, header.boundsCenter, sizeof(header.boundsCenter));
+  mesh.bounds.radius = header.boundsRadius;
+
+  /* position = quantOffset + quantScale * snorm */
+  mat4x4 translation;
+  mat4x4_translate(translation, header.quantOffset[0u],
+                                header.quantOffset[1u],
+                                header.quantOffset[2u]);
+  mat4x4_scale_aniso(mesh.dequantize.m, translation, header.quantScale[0u],
+                                                     header.quantScale[1u],
+                                                     header.quantScale[2u]);
+
+  MeshStore &store = *ctx.meshStore;
+  store.stats.bytes += vertexSize + indexSize;
+  store.stats.floatBytes += header.vertexCount * kFloatVertexSize
+                          + VkDeviceSize(header.indexCount) * sizeof(uint32_t);
+}
+
+// ----------------------------------------------------------------------------
+
+void init_mesh_store(VulkanContext &ctx) {
+  PROFILE_FUNCTION();
+
+  assert(ctx.meshStore == nullptr);
+  ctx.meshStore = new MeshStore();
+
+  /* The triangle goes through the same format as the loaded meshes */
+  MeshSource source;
+  source.positions = {
+    -1.0f, -1.0f, 0.0f,
+    +1.0f, -1.0f, 0.0f,
+     0.0f, 0.73f, 0.0f
+  };
+  source.colors = {
+    1.0f, 0.0f, 0.0f, 1.0f,
+    0.0f, 1.0f, 0.0f, 1.0f,
+    0.0f, 0.0f, 1.0f, 1.0f
+  };
+  source.indices = { 0u, 1u, 2u };
+
+  MeshData data;
+  build_mesh_data(source, data);
+
+  std::vector<uint8_t> bytes;
+  serialize_mesh(data, bytes);
+
+  MeshView view;
+  bool res = parse_mesh_file(bytes.data(), bytes.size(), view);
+  assert(res);
+  (void)res;
+
+  // the streams are copied to the staging ring, bytes can go
+  ctx.meshStore->meshes.push_back(Mesh());
+  upload_mesh(ctx, view, ctx.meshStore->meshes.back());
+}
+
+// ----------------------------------------------------------------------------
+
+void release_mesh_store(VulkanContext &ctx) {
+  if (ctx.meshStore == nullptr) {
+    return;
+  }
+  MeshStore &store = *ctx.meshStore;
+
+  fprintf(stdout, "meshes : %zu mesh(es), %.1f KiB of geometry (%.1f KiB unquantized)\n",
+          store.meshes.size(),
+          store.stats.bytes / 1024.0,
+          store.stats.floatBytes / 1024.0);
+
+  for (auto &mesh : store.meshes) {
+    vkDestroyBuffer(ctx.device, mesh.buffer, nullptr);
+    vkFreeMemory(ctx.device, mesh.mem, nullptr);
+  }
+
+  delete ctx.meshStore;
+  ctx.meshStore = nullptr;
+}
+
+// ----------------------------------------------------------------------------
+
+bool load_mesh(VulkanContext &ctx, const char *filename, MeshHandle &mesh) {
+  PROFILE_FUNCTION();
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Mesh error : cannot open \"%s\".\n", filename);
+    return false;
+  }
+
+  struct stat st;
+  if ((fstat(fd, &st) < 0) || (st.st_size == 0)) {
+    fprintf(stderr, "Mesh error : cannot read \"%s\".\n", filename);
+    close(fd);
+    return false;
+  }
+
+  /* The streams are read directly from the page cache */
+  const size_t size = st.st_size;
+  void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (mapped == MAP_FAILED) {
+    fprintf(stderr, "Mesh error : cannot map \"%s\".\n", filename);
+    return false;
+  }
+
+  MeshView view;
+  const bool bLoaded = parse_mesh_file(static_cast<const uint8_t*>(mapped), size, view);
+
+  if (!bLoaded) {
+    fprintf(stderr, "Mesh error : \"%s\" is not a valid mesh file (version %u).\n",
+            filename, kMeshFileVersion);
+  } else {
+    MeshStore &store = *ctx.meshStore;
+    mesh = static_cast<MeshHandle>(store.meshes.size());
+    store.meshes.push_back(Mesh());
+    upload_mesh(ctx, view, store.meshes.back());
+  }
+
+  munmap(mapped, size);
+
+  return bLoaded;
+}
+
+// ----------------------------------------------------------------------------
+
+const Mesh& get_mesh(const VulkanContext &ctx, const MeshHandle mesh) {
+  assert(mesh < ctx.meshStore->meshes.size());
+  return ctx.meshStore->meshes[mesh];
+}
+
+// ============================================================================
@@ -0,0 +1,66 @@
+#ifndef MESH_H_
+#define MESH_H_
+
+#include <vector>
+
+#include "common.h"
+#include "entity.h"
+#include "mesh_format.h"
+
+/* Built-in mesh, created with the store */
+const MeshHandle kTriangleMesh = 0u;
+
+/* Vertex buffer binding of the mesh vertices (0 holds the instances) */
+const uint32_t kMeshVertexBinding = 1u;
+
+/* Level of detail of a loaded mesh */
+struct MeshLod {
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  float error;
+};
+
+/**
+* Mesh resident on the device : its vertices then its indices in a single
+* buffer. The quantized positions are expanded by the dequantize transform,
+* applied to the world transform of its instances.
+*/
+struct Mesh {
+  VkBuffer buffer = VK_NULL_HANDLE;
+  VkDeviceMemory mem = VK_NULL_HANDLE;
+  VkDeviceSize indexOffset = 0u;
+  VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+  uint32_t vertexCount = 0u;
+  std::vector<MeshLod> lods;
+  BoundingSphere bounds;
+  Matrix dequantize;
+};
+
+/* Meshes indexed by MeshHandle */
+struct MeshStore {
+  std::vector<Mesh> meshes;
+
+  struct {
+    VkDeviceSize bytes = 0u;          // uploaded vertices and indices
+    VkDeviceSize floatBytes = 0u;     // same data with float attributes and 32-bit indices
+  } stats;
+};
+
+/* Create the store with its built-in triangle */
+void init_mesh_store(VulkanContext &ctx);
+
+/* Report the memory used, and destroy the meshes, the GPU must be done with them */
+void release_mesh_store(VulkanContext &ctx);
+
+/**
+* Load a binary mesh file (see mesh_format.h, written by mesh_convert).
+* The file is memory mapped, its header and stream ranges are validated,
+* then its streams are copied as-is to the staging ring.
+* @return false if the file could not be loaded or is invalid.
+*/
+bool load_mesh(VulkanContext &ctx, const char *filename, MeshHandle &mesh);
+
+/**/
+const Mesh& get_mesh(const VulkanContext &ctx, const MeshHandle mesh);
+
+#endif  // MESH_H_
@@ -0,0 +1,568 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+#include "mesh_format.h"
+
+// ============================================================================
+
+static
+uint64_t align_offset(const uint64_t offset, const uint64_t alignment) {
+  return ((offset + alignment - 1u) / alignment) * alignment;
+}
+
+// ----------------------------------------------------------------------------
+
+static
+int16_t quantize_snorm16(const float v) {
+  const float c = std::max(-1.0f, std::min(1.0f, v));
+  return static_cast<int16_t>(lrintf(c * 32767.0f));
+}
+
+// ----------------------------------------------------------------------------
+
+static
+uint8_t quantize_unorm8(const float v) {
+  const float c = std::max(0.0f, std::min(1.0f, v));
+  return static_cast<uint8_t>(lrintf(c * 255.0f));
+}
+
+// ----------------------------------------------------------------------------
+
+/* Project a unit vector on the octahedron, then unfold it on a square */
+static
+void encode_octahedral(const float n[3u], int16_t out[2u]) {
+  const float l1 = fabsf(n[0u]) + fabsf(n[1u]) + fabsf(n[2u]);
+  float x = (l1 > 0.0f) ? n[0u] / l1 : 0.0f;
+  float y = (l1 > 0.0f) ? n[1u] / l1 : 0.0f;
+
+  if (n[2u] < 0.0f) {
+    const float ox = x;
+    x = (1.0f - fabsf(y))  * ((ox >= 0.0f) ? 1.0f : -1.0f);
+    y = (1.0f - fabsf(ox)) * ((y  >= 0.0f) ? 1.0f : -1.0f);
+  }
+
+  out[0u] = quantize_snorm16(x);
+  out[1u] = quantize_snorm16(y);
+}
+
+// ----------------------------------------------------------------------------
+
+/* Area weighted normals of the vertices, from their triangles */
+static
+void compute_normals(const MeshSource &source, std::vector<float> &normals) {
+  normals.assign(source.positions.size(), 0.0f);
+
+  for (size_t i = 0u; i + 2u < source.indices.size(); i += 3u) {
+    const float *p[3u];
+    for (uint32_t k = 0u; k < 3u; ++k) {
+      p[k] = &source.positions[3u * source.indices[i + k]];
+    }
+
+    float e1[3u], e2[3u];
+    for (uint32_t c = 0u; c < 3u; ++c) {
+      e1[c] = p[1u][c] - p[0u][c];
+      e2[c] = p[2u][c] - p[0u][c];
+    }
+    const float n[3u] = {
+      e1[1u] * e2[2u] - e1[2u] * e2[1u],
+      e1[2u] * e2[0u] - e1[0u] * e2[2u],
+      e1[0u] * e2[1u] - e1[1u] * e2[0u]
+    };
+
+    for (uint32_t k = 0u; k < 3u; ++k) {
+      for (uint32_t c = 0u; c < 3u; ++c) {
+        normals[3u * source.indices[i + k] + c] += n[c];
+      }
+    }
+  }
+
+  for (size_t i = 0u; i < normals.size(); i += 3u) {
+    const float len = sqrtf(  normals[i + 0u] * normals[i + 0u]
+                            + normals[i + 1u] * normals[i + 1u]
+                            + normals[i + 2u] * normals[i + 2u]);
+    if (len > 0.0f) {
+      normals[i + 0u] /= len;
+      normals[i + 1u] /= len;
+      normals[i + 2u] /= len;
+    } else {
+      normals[i + 2u] = 1.0f;
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+void build_mesh_data(const MeshSource &source, MeshData &mesh) {
+  assert((source.positions.size() % 3u) == 0u);
+  assert((source.indices.size() % 3u) == 0u);
+
+  const uint32_t vertexCount = static_cast<uint32_t>(source.positions.size() / 3u);
+
+  MeshFileHeader &header = mesh.header;
+  memset(&header, 0, sizeof(header));
+
+  /* Bounding box, quantization range and bounding sphere */
+  float bmin[3u] = {  HUGE_VALF,  HUGE_VALF,  HUGE_VALF };
+  float bmax[3u] = { -HUGE_VALF, -HUGE_VALF, -HUGE_VALF };
+  for (uint32_t v = 0u; v < vertexCount; ++v) {
+    for (uint32_t c = 0u; c < 3u; ++c) {
+      bmin[c] = std::min(bmin[c], source.positions[3u * v + c]);
+      bmax[c] = std::max(bmax[c], source.positions[3u * v + c]);
+    }
+  }
+
+  for (uint32_t c = 0u; c < 3u; ++c) {
+    header.quantOffset[c] = (vertexCount > 0u) ? 0.5f * (bmin[c] + bmax[c]) : 0.0f;
+    header.quantScale[c] = (vertexCount > 0u) ? 0.5f * (bmax[c] - bmin[c]) : 0.0f;
+    header.boundsCenter[c] = header.quantOffset[c];
+  }
+
+  float radius2 = 0.0f;
+  for (uint32_t v = 0u; v < vertexCount; ++v) {
+    float d2 = 0.0f;
+    for (uint32_t c = 0u; c < 3u; ++c) {
+      const float d = source.positions[3u * v + c] - header.boundsCenter[c];
+      d2 += d * d;
+    }
+    radius2 = std::max(radius2, d2);
+  }
+  header.boundsRadius = sqrtf(radius2);
+
+  /* Quantize the attributes */
+  std::vector<float> computed_normals;
+  const std::vector<float> *normals = &source.normals;
+  if (source.normals.size() != source.positions.size()) {
+    compute_normals(source, computed_normals);
+    normals = &computed_normals;
+  }
+  const bool bColors = (source.colors.size() == 4u * vertexCount);
+
+  mesh.vertices.resize(vertexCount);
+  for (uint32_t v = 0u; v < vertexCount; ++v) {
+    PackedVertex &packed = mesh.vertices[v];
+
+    for (uint32_t c = 0u; c < 3u; ++c) {
+      const float scale = header.quantScale[c];
+      const float p = source.positions[3u * v + c] - header.quantOffset[c];
+      packed.position[c] = quantize_snorm16((scale > 0.0f) ? p / scale : 0.0f);
+    }
+    packed.position[3u] = 32767;
+
+    encode_octahedral(&(*normals)[3u * v], packed.normal);
+
+    for (uint32_t c = 0u; c < 4u; ++c) {
+      packed.color[c] = (bColors) ? quantize_unorm8(source.colors[4u * v + c]) : 0xffu;
+    }
+  }
+
+  /* Reorder for the post-transform cache, then for the vertex fetches */
+  mesh.indices = source.indices;
+  optimize_vertex_cache(mesh.indices, vertexCount);
+  optimize_vertex_fetch(mesh.vertices, mesh.indices);
+
+  mesh.lods.assign(1u, MeshFileLod{0u, static_cast<uint32_t>(mesh.indices.size()), 0.0f, 0u});
+
+  header.magic = kMeshFileMagic;
+  header.version = kMeshFileVersion;
+  header.vertexCount = vertexCount;
+  header.vertexStride = sizeof(PackedVertex);
+
+  build_mesh_lods(mesh);
+}
+
+// ----------------------------------------------------------------------------
+
+void build_mesh_lods(MeshData &mesh) {
+  /* Cells per axis of the first clustering grid, halved for each level */
+  const uint32_t kFirstGridSize = 64u;
+
+  /* A level is kept when it has at most this ratio of the previous triangles */
+  const float kMinReduction = 0.75f;
+
+  assert(mesh.lods.size() == 1u);
+
+  const MeshFileHeader &header = mesh.header;
+  const uint32_t vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+  const std::vector<uint32_t> source(mesh.indices.begin(),
+                                     mesh.indices.begin() + mesh.lods[0u].indexCount);
+
+  typedef std::array<uint32_t, 3u> Triangle;
+
+  std::vector<uint32_t> remap(vertexCount);
+  std::vector<Triangle> triangles;
+  std::vector<uint32_t> indices;
+  std::unordered_map<uint32_t, uint32_t> representatives;
+
+  uint32_t previous = static_cast<uint32_t>(source.size() / 3u);
+
+  for (uint32_t grid = kFirstGridSize; (grid >= 2u) && (mesh.lods.size() < kMaxMeshLods); grid /= 2u) {
+    /**
+    * Vertices of a cell collapse on the first of them : the levels share the
+    * vertex stream, and their error is bounded by the cell diagonal.
+    */
+    representatives.clear();
+    for (uint32_t v = 0u; v < vertexCount; ++v) {
+      uint32_t cell = 0u;
+      for (uint32_t c = 0u; c < 3u; ++c) {
+        const uint32_t q = static_cast<uint32_t>(mesh.vertices[v].position[c] + 32768);
+        cell = cell * grid + std::min((q * grid) >> 16u, grid - 1u);
+      }
+      remap[v] = representatives.emplace(cell, v).first->second;
+    }
+
+    /* Collapsed triangles are removed, and duplicated ones (same winding) */
+    triangles.clear();
+    for (size_t i = 0u; i < source.size(); i += 3u) {
+      Triangle t = {{ remap[source[i + 0u]], remap[source[i + 1u]], remap[source[i + 2u]] }};
+      if ((t[0u] == t[1u]) || (t[1u] == t[2u]) || (t[2u] == t[0u])) {
+        continue;
+      }
+
+      // rotate the smallest index first, keeping the winding
+      std::rotate(t.begin(), std::min_element(t.begin(), t.end()), t.end());
+      triangles.push_back(t);
+    }
+    std::sort(triangles.begin(), triangles.end());
+    triangles.erase(std::unique(triangles.begin(), triangles.end()), triangles.end());
+
+    const uint32_t count = static_cast<uint32_t>(triangles.size());
+    if (count == 0u) {
+      break;
+    }
+    if (count > kMinReduction * previous) {
+      continue;
+    }
+    previous = count;
+
+    indices.clear();
+    for (const auto &t : triangles) {
+      indices.insert(indices.end(), t.begin(), t.end());
+    }
+    optimize_vertex_cache(indices, vertexCount);
+
+    float diagonal2 = 0.0f;
+    for (uint32_t c = 0u; c < 3u; ++c) {
+      const float size = 2.0f * header.quantScale[c] / grid;
+      diagonal2 += size * size;
+    }
+
+    mesh.lods.push_back(MeshFileLod{
+      static_cast<uint32_t>(mesh.indices.size()), static_cast<uint32_t>(indices.size()),
+      sqrtf(diagonal2), 0u
+    });
+    mesh.indices.insert(mesh.indices.end(), indices.begin(), indices.end());
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+/* Score of a vertex from its cache position and its remaining triangles */
+static
+float vertex_score(const int32_t cachePos, const uint32_t remaining) {
+  const float kCacheDecayPower   = 1.5f;
+  const float kLastTriScore      = 0.75f;
+  const float kValenceBoostScale = 2.0f;
+  const float kValenceBoostPower = 0.5f;
+
+  if (remaining == 0u) {
+    return -1.0f;
+  }
+
+  float score = 0.0f;
+  if (cachePos >= 0) {
+    if (cachePos < 3) {
+      // vertices of the last triangle, whatever its order
+      score = kLastTriScore;
+    } else {
+      const float s = 1.0f - (cachePos - 3) / float(kMeshVertexCacheSize - 3u);
+      score = powf(s, kCacheDecayPower);
+    }
+  }
+
+  /* Favor vertices with few triangles left, to finish them off */
+  score += kValenceBoostScale * powf(float(remaining), -kValenceBoostPower);
+  return score;
+}
+
+// ----------------------------------------------------------------------------
+
+void optimize_vertex_cache(std::vector<uint32_t> &indices, const uint32_t vertexCount) {
+  const uint32_t triCount = static_cast<uint32_t>(indices.size() / 3u);
+  if (triCount == 0u) {
+    return;
+  }
+
+  /* Triangles of each vertex, the first 'remaining' ones are not emitted */
+  std::vector<uint32_t> remaining(vertexCount, 0u);
+  for (const auto index : indices) {
+    ++remaining[index];
+  }
+
+  std::vector<uint32_t> offsets(vertexCount + 1u, 0u);
+  for (uint32_t v = 0u; v < vertexCount; ++v) {
+    offsets[v + 1u] = offsets[v] + remaining[v];
+  }
+
+  std::vector<uint32_t> adjacency(indices.size());
+  {
+    std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1u);
+    for (uint32_t i = 0u; i < indices.size(); ++i) {
+      adjacency[cursor[indices[i]]++] = i / 3u;
+    }
+  }
+
+  std::vector<int32_t> cachePos(vertexCount, -1);
+  std::vector<float> vscores(vertexCount);
+  for (uint32_t v = 0u; v < vertexCount; ++v) {
+    vscores[v] = vertex_score(-1, remaining[v]);
+  }
+
+  std::vector<float> tscores(triCount);
+  std::vector<uint8_t> emitted(triCount, 0u);
+  for (uint32_t t = 0u; t < triCount; ++t) {
+    tscores[t] = vscores[indices[3u * t + 0u]]
+               + vscores[indices[3u * t + 1u]]
+               + vscores[indices[3u * t + 2u]];
+  }
+
+  std::vector<uint32_t> output;
+  output.reserve(indices.size());
+
+  std::vector<uint32_t> cache, next_cache;
+  cache.reserve(kMeshVertexCacheSize + 3u);
+  next_cache.reserve(kMeshVertexCacheSize + 3u);
+
+  int64_t best = std::max_element(tscores.begin(), tscores.end()) - tscores.begin();
+
+  while (output.size() < indices.size()) {
+    /* No candidate around the cache, take the best triangle left */
+    if (best < 0) {
+      float best_score = -HUGE_VALF;
+      for (uint32_t t = 0u; t < triCount; ++t) {
+        if (!emitted[t] && (tscores[t] > best_score)) {
+          best_score = tscores[t];
+          best = t;
+        }
+      }
+    }
+    assert(best >= 0);
+
+    const uint32_t tri = static_cast<uint32_t>(best);
+    emitted[tri] = 1u;
+
+    next_cache.clear();
+    for (uint32_t k = 0u; k < 3u; ++k) {
+      const uint32_t v = indices[3u * tri + k];
+      output.push_back(v);
+      next_cache.push_back(v);
+
+      // remove the triangle from the vertex adjacency
+      uint32_t *adj = &adjacency[offsets[v]];
+      uint32_t *last = adj + remaining[v] - 1u;
+      *std::find(adj, last + 1u, tri) = *last;
+      --remaining[v];
+    }
+
+    /* Emitted vertices move to the front of the LRU cache */
+    for (const auto v : cache) {
+      if (std::find(next_cache.begin(), next_cache.begin() + 3u, v) == next_cache.begin() + 3u) {
+        next_cache.push_back(v);
+      }
+    }
+
+    for (uint32_t i = 0u; i < next_cache.size(); ++i) {
+      const uint32_t v = next_cache[i];
+      cachePos[v] = (i < kMeshVertexCacheSize) ? static_cast<int32_t>(i) : -1;
+      vscores[v] = vertex_score(cachePos[v], remaining[v]);
+    }
+
+    /* Only triangles of cached vertices change of score */
+    best = -1;
+    float best_score = -HUGE_VALF;
+    for (const auto v : next_cache) {
+      for (uint32_t i = offsets[v]; i < offsets[v] + remaining[v]; ++i) {
+        const uint32_t t = adjacency[i];
+        tscores[t] = vscores[indices[3u * t + 0u]]
+                   + vscores[indices[3u * t + 1u]]
+                   + vscores[indices[3u * t + 2u]];
+        if (tscores[t] > best_score) {
+          best_score = tscores[t];
+          best = t;
+        }
+      }
+    }
+
+    if (next_cache.size() > kMeshVertexCacheSize) {
+      next_cache.resize(kMeshVertexCacheSize);
+    }
+    cache.swap(next_cache);
+  }
+
+  indices.swap(output);
+}
+
+// ----------------------------------------------------------------------------
+
+void optimize_vertex_fetch(std::vector<PackedVertex> &vertices, std::vector<uint32_t> &indices) {
+  const uint32_t kUnused = UINT32_MAX;
+  std::vector<uint32_t> remap(vertices.size(), kUnused);
+  std::vector<PackedVertex> ordered;
+  ordered.reserve(vertices.size());
+
+  for (auto &index : indices) {
+    if (remap[index] == kUnused) {
+      remap[index] = static_cast<uint32_t>(ordered.size());
+      ordered.push_back(vertices[index]);
+    }
+    index = remap[index];
+  }
+
+  /* Unreferenced vertices are dropped */
+  vertices.swap(ordered);
+}
+
+// ----------------------------------------------------------------------------
+
+float compute_acmr(const std::vector<uint32_t> &indices,
+                   const uint32_t vertexCount,
+                   const uint32_t cacheSize)
+{
+  if (indices.empty()) {
+    return 0.0f;
+  }
+
+  /* Timestamp of each vertex entering the FIFO */
+  std::vector<uint32_t> timestamps(vertexCount, 0u);
+  uint32_t time = cacheSize + 1u;
+  uint32_t misses = 0u;
+
+  for (const auto index : indices) {
+    if (time - timestamps[index] > cacheSize) {
+      timestamps[index] = time++;
+      ++misses;
+    }
+  }
+
+  return misses / (indices.size() / 3.0f);
+}
+
+// ----------------------------------------------------------------------------
+
+void serialize_mesh(const MeshData &mesh, std::vector<uint8_t> &bytes) {
+  MeshFileHeader header = mesh.header;
+
+  header.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+  header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+  header.indexSize = (header.vertexCount <= 0x10000u) ? 2u : 4u;
+  header.lodCount = static_cast<uint32_t>(mesh.lods.size());
+  assert(header.lodCount <= kMaxMeshLods);
+
+  header.lodOffset = sizeof(MeshFileHeader);
+  header.vertexOffset = align_offset(header.lodOffset + header.lodCount * sizeof(MeshFileLod),
+                                     kMeshStreamAlignment);
+  header.indexOffset = align_offset(header.vertexOffset + header.vertexCount * sizeof(PackedVertex),
+                                    kMeshStreamAlignment);
+  const uint64_t size = header.indexOffset + uint64_t(header.indexCount) * header.indexSize;
+
+  bytes.assign(size, 0u);
+  memcpy(bytes.data(), &header, sizeof(header));
+  memcpy(bytes.data() + header.lodOffset, mesh.lods.data(),
+         mesh.lods.size() * sizeof(MeshFileLod));
+  memcpy(bytes.data() + header.vertexOffset, mesh.vertices.data(),
+         mesh.vertices.size() * sizeof(PackedVertex));
+
+  if (header.indexSize == 2u) {
+    uint16_t *dst = reinterpret_cast<uint16_t*>(bytes.data() + header.indexOffset);
+    for (uint32_t i = 0u; i < header.indexCount; ++i) {
+      dst[i] = static_cast<uint16_t>(mesh.indices[i]);
+    }
+  } else {
+    memcpy(bytes.data() + header.indexOffset, mesh.indices.data(),
+           mesh.indices.size() * sizeof(uint32_t));
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+/* Return the largest of count 16 or 32-bit indices, in a single pass */
+static
+uint32_t max_mesh_index(const uint8_t *indices, const uint32_t count, const uint32_t indexSize) {
+  uint32_t maxIndex = 0u;
+
+  if (indexSize == 2u) {
+    const uint16_t *src = reinterpret_cast<const uint16_t*>(indices);
+    for (uint32_t i = 0u; i < count; ++i) {
+      maxIndex = std::max(maxIndex, uint32_t(src[i]));
+    }
+  } else {
+    const uint32_t *src = reinterpret_cast<const uint32_t*>(indices);
+    for (uint32_t i = 0u; i < count; ++i) {
+      maxIndex = std::max(maxIndex, src[i]);
+    }
+  }
+
+  return maxIndex;
+}
+
+// ----------------------------------------------------------------------------
+
+/* Return true when count elements of stride bytes at offset lie in size bytes, without overflow */
+static
+bool is_range_in_file(const uint64_t offset,
+                      const uint64_t count,
+                      const uint64_t stride,
+                      const uint64_t size) {
+  return (offset <= size) && (count <= (size - offset) / stride);
+}
+
+// ----------------------------------------------------------------------------
+
+bool parse_mesh_file(const uint8_t *bytes, const size_t size, MeshView &view) {
+  if ((size < sizeof(MeshFileHeader))
+   || (reinterpret_cast<uintptr_t>(bytes) % alignof(MeshFileHeader))) {
+    return false;
+  }
+  const MeshFileHeader *header = reinterpret_cast<const MeshFileHeader*>(bytes);
+
+  if ((header->magic != kMeshFileMagic)
+   || (header->version != kMeshFileVersion)
+   || (header->vertexStride != sizeof(PackedVertex))
+   || ((header->indexSize != 2u) && (header->indexSize != 4u))
+   || (header->vertexCount == 0u) || (header->indexCount == 0u)
+   || (header->lodCount == 0u) || (header->lodCount > kMaxMeshLods)
+   || (header->lodOffset % alignof(MeshFileLod))
+   || (header->vertexOffset % kMeshStreamAlignment)
+   || (header->vertexOffset % alignof(PackedVertex))
+   || (header->indexOffset % kMeshStreamAlignment)
+   || (header->indexOffset % header->indexSize)) {
+    return false;
+  }
+
+  /* Every range lies in the file */
+  if (!is_range_in_file(header->lodOffset, header->lodCount, sizeof(MeshFileLod), size)
+   || !is_range_in_file(header->vertexOffset, header->vertexCount, header->vertexStride, size)
+   || !is_range_in_file(header->indexOffset, header->indexCount, header->indexSize, size)) {
+    return false;
+  }
+
+  view.header = header;
+  view.lods = reinterpret_cast<const MeshFileLod*>(bytes + header->lodOffset);
+  view.vertices = bytes + header->vertexOffset;
+  view.indices = bytes + header->indexOffset;
+
+  for (uint32_t i = 0u; i < header->lodCount; ++i) {
+    if (uint64_t(view.lods[i].firstIndex) + view.lods[i].indexCount > header->indexCount) {
+      return false;
+    }
+  }
+
+  /* The ranges of the LODs lie in the index stream, whose indices all address a vertex */
+  return max_mesh_index(view.indices, header->indexCount, header->indexSize) < header->vertexCount;
+}
+
+// ============================================================================
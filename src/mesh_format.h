@@ -0,0 +1,121 @@
+#ifndef MESH_FORMAT_H_
+#define MESH_FORMAT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+* Binary mesh file, read in place from its mapping :
+*   header | LOD table | vertex stream | index stream
+* Streams start on kMeshStreamAlignment bytes. Positions are quantized in
+* the mesh bounding box, dequantized by the transform of the instances.
+* Shared by the application and the offline converter (tools/), it does
+* not depend on Vulkan.
+*/
+const uint32_t kMeshFileMagic = 0x534d4b56u;    // "VKMS"
+const uint32_t kMeshFileVersion = 1u;
+const uint32_t kMeshStreamAlignment = 16u;
+const uint32_t kMaxMeshLods = 8u;
+
+/* Vertex cache size the index order is optimized for */
+const uint32_t kMeshVertexCacheSize = 32u;
+
+struct MeshFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t vertexCount;
+  uint32_t vertexStride;    // sizeof(PackedVertex)
+  uint32_t indexCount;      // of every LOD
+  uint32_t indexSize;       // 2 or 4 bytes
+  uint32_t lodCount;
+  uint32_t reserved;
+  uint64_t lodOffset;       // offsets from the start of the file
+  uint64_t vertexOffset;
+  uint64_t indexOffset;
+  float boundsCenter[3u];   // bounding sphere, in object space
+  float boundsRadius;
+  float quantOffset[3u];    // position = quantOffset + quantScale * snorm
+  float quantScale[3u];
+};
+static_assert(sizeof(MeshFileHeader) == 96u, "MeshFileHeader layout changed");
+
+/* Index range of a level of detail, LOD 0 being the full mesh */
+struct MeshFileLod {
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  float error;              // object space error of the simplification
+  uint32_t reserved;
+};
+
+/**
+* Quantized vertex, 16 bytes instead of 40 as floats :
+*   position : snorm16 in the bounding box (w unused),
+*   normal   : snorm16 octahedral encoding,
+*   color    : unorm8 RGBA.
+*/
+struct PackedVertex {
+  int16_t position[4u];
+  int16_t normal[2u];
+  uint8_t color[4u];
+};
+static_assert(sizeof(PackedVertex) == 16u, "PackedVertex layout changed");
+
+/* Unquantized geometry, as read by the converter */
+struct MeshSource {
+  std::vector<float> positions;   // xyz
+  std::vector<float> normals;     // xyz, empty to compute them
+  std::vector<float> colors;      // rgba, empty for white
+  std::vector<uint32_t> indices;  // triangle list
+};
+
+/* Content of a mesh file */
+struct MeshData {
+  MeshFileHeader header;
+  std::vector<MeshFileLod> lods;
+  std::vector<PackedVertex> vertices;
+  std::vector<uint32_t> indices;  // stored on 16 bits when they fit
+};
+
+/* Pointers to the content of a mapped mesh file */
+struct MeshView {
+  const MeshFileHeader *header = nullptr;
+  const MeshFileLod *lods = nullptr;
+  const uint8_t *vertices = nullptr;
+  const uint8_t *indices = nullptr;
+};
+
+/**
+* Quantize a source mesh, optimize its index order for the vertex cache and
+* its vertex order for fetches, compute its bounds and its LODs.
+*/
+void build_mesh_data(const MeshSource &source, MeshData &mesh);
+
+/**
+* Append coarser LODs to a mesh with a single LOD, simplified by vertex
+* clustering. They index the vertices of LOD 0, their index ranges follow
+* it in the index stream.
+*/
+void build_mesh_lods(MeshData &mesh);
+
+/* Reorder triangles to reuse the post-transform vertex cache (Forsyth) */
+void optimize_vertex_cache(std::vector<uint32_t> &indices, const uint32_t vertexCount);
+
+/* Reorder vertices by first use, remapping the indices */
+void optimize_vertex_fetch(std::vector<PackedVertex> &vertices, std::vector<uint32_t> &indices);
+
+/* Average number of vertices transformed per triangle with a FIFO cache */
+float compute_acmr(const std::vector<uint32_t> &indices,
+                   const uint32_t vertexCount,
+                   const uint32_t cacheSize);
+
+/* Write the file content of a mesh, laid out as mapped */
+void serialize_mesh(const MeshData &mesh, std::vector<uint8_t> &bytes);
+
+/**
+* Check the header and bounds of a mapped file, and point to its streams.
+* Empty meshes and indices addressing no vertex are rejected.
+*/
+bool parse_mesh_file(const uint8_t *bytes, const size_t size, MeshView &view);
+
+#endif  // MESH_FORMAT_H_
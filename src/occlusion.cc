@@ -0,0 +1,629 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "vulkan/vulkan.h"
+#include "occlusion.h"
+#include "pipeline.h"
+#include "profiler.h"
+#include "setup.h"
+#include "texture.h"
+
+// ============================================================================
+
+/* Workgroup size of the reduction shader */
+static const uint32_t kHiZGroupSize = 8u;
+
+// ----------------------------------------------------------------------------
+
+/* Largest power of two not above n */
+static
+uint32_t floor_pow2(const uint32_t n) {
+  uint32_t p = 1u;
+  while ((p << 1u) <= n) {
+    p <<= 1u;
+  }
+  return p;
+}
+
+// ----------------------------------------------------------------------------
+
+/* Create a 2D image backed by its own device local memory */
+static
+void create_image(VulkanContext &ctx,
+                  const VkFormat format,
+                  const uint32_t width,
+                  const uint32_t height,
+                  const uint32_t levels,
+                  const VkImageUsageFlags usage,
+                  VkImage &image,
+                  VkDeviceMemory &mem)
+{
+  VkResult err;
+
+  VkImageCreateInfo imageInfo;
+  memset(&imageInfo, 0, sizeof(imageInfo));
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.format = format;
+  imageInfo.extent = { width, height, 1u };
+  imageInfo.mipLevels = levels;
+  imageInfo.arrayLayers = 1u;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.usage = usage;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+  err = vkCreateImage(ctx.device, &imageInfo, nullptr, &image);
+  assert(!err);
+
+  VkMemoryRequirements memReqs;
+  vkGetImageMemoryRequirements(ctx.device, image, &memReqs);
+
+  VkMemoryAllocateInfo allocInfo;
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.pNext = nullptr;
+  allocInfo.allocationSize = memReqs.size;
+  allocInfo.memoryTypeIndex = 0u;
+
+  bool res = retrieve_memory_type_index(ctx.properties.memory,
+                                        memReqs.memoryTypeBits,
+                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                        &allocInfo.memoryTypeIndex);
+  assert(res);
+
+  err = vkAllocateMemory(ctx.device, &allocInfo, nullptr, &mem);
+  assert(!err);
+
+  err = vkBindImageMemory(ctx.device, image, mem, 0u);
+  assert(!err);
+}
+
+// ----------------------------------------------------------------------------
+
+static
+VkImageView create_view(VulkanContext &ctx,
+                        const VkImage image,
+                        const VkFormat format,
+                        const VkImageAspectFlags aspect,
+                        const uint32_t level)
+{
+  VkImageViewCreateInfo viewInfo;
+  memset(&viewInfo, 0, sizeof(viewInfo));
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = image;
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format = format;
+  viewInfo.subresourceRange = { aspect, level, 1u, 0u, 1u };
+
+  VkImageView view;
+  VkResult err = vkCreateImageView(ctx.device, &viewInfo, nullptr, &view);
+  assert(!err);
+  (void)err;
+
+  return view;
+}
+
+// ----------------------------------------------------------------------------
+
+/* Host visible buffer receiving the last level, mapped for its lifetime */
+static
+void create_readback(VulkanContext &ctx, OcclusionCuller::Readback &readback) {
+  OcclusionCuller &occlusion = *ctx.occlusion;
+
+  VkResult err;
+
+  const uint32_t last = occlusion.levels - 1u;
+  const uint32_t width = std::max(occlusion.width >> last, 1u);
+  const uint32_t height = std::max(occlusion.height >> last, 1u);
+
+  VkBufferCreateInfo bufferInfo;
+  memset(&bufferInfo, 0, sizeof(bufferInfo));
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = width * height * sizeof(float);
+  bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  err = vkCreateBuffer(ctx.device, &bufferInfo, nullptr, &readback.buffer);
+  assert(!err);
+
+  VkMemoryRequirements memReqs;
+  vkGetBufferMemoryRequirements(ctx.device, readback.buffer, &memReqs);
+
+  VkMemoryAllocateInfo allocInfo;
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.pNext = nullptr;
+  allocInfo.allocationSize = memReqs.size;
+  allocInfo.memoryTypeIndex = 0u;
+
+  /* Cached memory is faster to read from the host */
+  const VkFlags coherent = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                         | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  bool res = retrieve_memory_type_index(ctx.properties.memory,
+                                        memReqs.memoryTypeBits,
+                                        coherent | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+                                        &allocInfo.memoryTypeIndex)
+          || retrieve_memory_type_index(ctx.properties.memory,
+                                        memReqs.memoryTypeBits,
+                                        coherent,
+                                        &allocInfo.memoryTypeIndex);
+  assert(res);
+
+  err = vkAllocateMemory(ctx.device, &allocInfo, nullptr, &readback.mem);
+  assert(!err);
+
+  err = vkBindBufferMemory(ctx.device, readback.buffer, readback.mem, 0u);
+  assert(!err);
+
+  void *mapped = nullptr;
+  err = vkMapMemory(ctx.device, readback.mem, 0u, VK_WHOLE_SIZE, 0u, &mapped);
+  assert(!err);
+  readback.depths = static_cast<const float*>(mapped);
+}
+
+// ----------------------------------------------------------------------------
+
+/* Descriptor sets and compute pipeline of the reduction, one set per level */
+static
+void setup_reduction(VulkanContext &ctx) {
+  OcclusionCuller &occlusion = *ctx.occlusion;
+
+  VkResult err;
+
+  VkDescriptorSetLayoutBinding bindings[2u];
+  memset(bindings, 0, sizeof(bindings));
+  bindings[0u].binding = 0u;
+  bindings[0u].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  bindings[0u].descriptorCount = 1u;
+  bindings[0u].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  bindings[1u].binding = 1u;
+  bindings[1u].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  bindings[1u].descriptorCount = 1u;
+  bindings[1u].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo;
+  memset(&layoutInfo, 0, sizeof(layoutInfo));
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = 2u;
+  layoutInfo.pBindings = bindings;
+
+  err = vkCreateDescriptorSetLayout(ctx.device, &layoutInfo, nullptr, &occlusion.descLayout);
+  assert(!err);
+
+  /* Source and destination extents */
+  VkPushConstantRange range;
+  range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  range.offset = 0u;
+  range.size = 4u * sizeof(int32_t);
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo;
+  memset(&pipelineLayoutInfo, 0, sizeof(pipelineLayoutInfo));
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 1u;
+  pipelineLayoutInfo.pSetLayouts = &occlusion.descLayout;
+  pipelineLayoutInfo.pushConstantRangeCount = 1u;
+  pipelineLayoutInfo.pPushConstantRanges = &range;
+
+  err = vkCreatePipelineLayout(ctx.device, &pipelineLayoutInfo, nullptr, &occlusion.pipelineLayout);
+  assert(!err);
+
+  occlusion.pipeline = get_compute_pipeline(ctx, SHADERS_DIR "hiz.comp.spv",
+                                            occlusion.pipelineLayout);
+
+  /* Descriptor sets */
+  VkDescriptorPoolSize poolSizes[2u];
+  poolSizes[0u].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  poolSizes[0u].descriptorCount = occlusion.levels;
+  poolSizes[1u].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  poolSizes[1u].descriptorCount = occlusion.levels;
+
+  VkDescriptorPoolCreateInfo poolInfo;
+  memset(&poolInfo, 0, sizeof(poolInfo));
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets = occlusion.levels;
+  poolInfo.poolSizeCount = 2u;
+  poolInfo.pPoolSizes = poolSizes;
+
+  err = vkCreateDescriptorPool(ctx.device, &poolInfo, nullptr, &occlusion.descPool);
+  assert(!err);
+
+  const std::vector<VkDescriptorSetLayout> layouts(occlusion.levels, occlusion.descLayout);
+
+  VkDescriptorSetAllocateInfo allocInfo;
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.pNext = nullptr;
+  allocInfo.descriptorPool = occlusion.descPool;
+  allocInfo.descriptorSetCount = occlusion.levels;
+  allocInfo.pSetLayouts = layouts.data();
+
+  occlusion.descSets.resize(occlusion.levels);
+  err = vkAllocateDescriptorSets(ctx.device, &allocInfo, occlusion.descSets.data());
+  assert(!err);
+
+  /* Texels are fetched, the sampler does not filter */
+  SamplerDesc samplerDesc;
+  samplerDesc.magFilter = VK_FILTER_NEAREST;
+  samplerDesc.minFilter = VK_FILTER_NEAREST;
+  samplerDesc.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  samplerDesc.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerDesc.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerDesc.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  const VkSampler sampler = get_sampler(ctx, samplerDesc);
+
+  /* The pyramid stays in the general layout, read and written level by level */
+  for (uint32_t level = 0u; level < occlusion.levels; ++level) {
+    VkDescriptorImageInfo source;
+    source.sampler = sampler;
+    source.imageView = (level == 0u) ? occlusion.depthSampledView
+                                     : occlusion.levelViews[level - 1u];
+    source.imageLayout = (level == 0u) ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+                                       : VK_IMAGE_LAYOUT_GENERAL;
+
+    VkDescriptorImageInfo destination;
+    destination.sampler = VK_NULL_HANDLE;
+    destination.imageView = occlusion.levelViews[level];
+    destination.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    VkWriteDescriptorSet writes[2u];
+    memset(writes, 0, sizeof(writes));
+    writes[0u].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0u].dstSet = occlusion.descSets[level];
+    writes[0u].dstBinding = 0u;
+    writes[0u].descriptorCount = 1u;
+    writes[0u].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[0u].pImageInfo = &source;
+    writes[1u] = writes[0u];
+    writes[1u].dstBinding = 1u;
+    writes[1u].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[1u].pImageInfo = &destination;
+
+    vkUpdateDescriptorSets(ctx.device, 2u, writes, 0u, nullptr);
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+bool occlusion_requested(const AppOptions &options) {
+  return options.occlusion;
+}
+
+// ----------------------------------------------------------------------------
+
+void init_occlusion(VulkanContext &ctx) {
+  PROFILE_FUNCTION();
+
+  assert(ctx.occlusion == nullptr);
+  ctx.occlusion = new OcclusionCuller();
+  OcclusionCuller &occlusion = *ctx.occlusion;
+
+  if (!occlusion_requested(ctx.app.options)) {
+    return;
+  }
+
+  /* The depth is reduced per texel, multisampled depth would need resolving first */
+  if (ctx.samples != VK_SAMPLE_COUNT_1_BIT) {
+    fprintf(stderr, "dev warning : occlusion culling is disabled with MSAA.\n");
+    return;
+  }
+
+  VkFormatProperties props;
+  vkGetPhysicalDeviceFormatProperties(ctx.gpu, ctx.depthFormat, &props);
+  if (!(props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+    fprintf(stderr, "dev warning : occlusion culling is disabled, "
+                    "the depth format cannot be sampled.\n");
+    return;
+  }
+
+  occlusion.enabled = true;
+
+  /* Depth buffer of the primary surface, imported by its render graph */
+  const SurfaceContext &primary = ctx.surfaces.front();
+  occlusion.depthWidth = primary.width;
+  occlusion.depthHeight = primary.height;
+  occlusion.depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+  if (ctx.depthFormat == VK_FORMAT_D24_UNORM_S8_UINT) {
+    occlusion.depthAspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+  }
+
+  create_image(ctx, ctx.depthFormat, primary.width, primary.height, 1u,
+               VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+               occlusion.depth, occlusion.depthMem);
+  occlusion.depthView = create_view(ctx, occlusion.depth, ctx.depthFormat,
+                                    occlusion.depthAspect, 0u);
+  occlusion.depthSampledView = create_view(ctx, occlusion.depth, ctx.depthFormat,
+                                           VK_IMAGE_ASPECT_DEPTH_BIT, 0u);
+
+  /* Pyramid levels down to the one read back, coarser ones are not needed */
+  occlusion.width = floor_pow2(primary.width);
+  occlusion.height = floor_pow2(primary.height);
+  occlusion.levels = 1u;
+  while (   ((occlusion.width >> (occlusion.levels - 1u)) > kOcclusionReadbackSize)
+         || ((occlusion.height >> (occlusion.levels - 1u)) > kOcclusionReadbackSize)) {
+    ++occlusion.levels;
+  }
+
+  create_image(ctx, VK_FORMAT_R32_SFLOAT, occlusion.width, occlusion.height, occlusion.levels,
+               VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT
+                                          | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+               occlusion.pyramid, occlusion.pyramidMem);
+
+  occlusion.levelViews.resize(occlusion.levels);
+  for (uint32_t level = 0u; level < occlusion.levels; ++level) {
+    occlusion.levelViews[level] = create_view(ctx, occlusion.pyramid, VK_FORMAT_R32_SFLOAT,
+                                              VK_IMAGE_ASPECT_COLOR_BIT, level);
+  }
+
+  setup_reduction(ctx);
+
+  for (auto &readback : occlusion.readbacks) {
+    create_readback(ctx, readback);
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+void release_occlusion(VulkanContext &ctx) {
+  if (ctx.occlusion == nullptr) {
+    return;
+  }
+  OcclusionCuller &occlusion = *ctx.occlusion;
+
+  if (occlusion.enabled) {
+    const uint32_t last = occlusion.levels - 1u;
+    fprintf(stdout, "occlusion : %llu of %llu tested instance(s) occluded (%.1f%%), "
+                    "hi-z %ux%u, %u level(s), read back at %ux%u\n",
+            static_cast<unsigned long long>(occlusion.stats.occluded),
+            static_cast<unsigned long long>(occlusion.stats.tested),
+            (occlusion.stats.tested > 0u)
+              ? 100.0 * occlusion.stats.occluded / occlusion.stats.tested : 0.0,
+            occlusion.width, occlusion.height, occlusion.levels,
+            std::max(occlusion.width >> last, 1u), std::max(occlusion.height >> last, 1u));
+  }
+
+  for (auto &readback : occlusion.readbacks) {
+    if (readback.mem != VK_NULL_HANDLE) {
+      vkUnmapMemory(ctx.device, readback.mem);
+    }
+    vkDestroyBuffer(ctx.device, readback.buffer, nullptr);
+    vkFreeMemory(ctx.device, readback.mem, nullptr);
+  }
+
+  // the pipeline is owned by the pipeline manager, the sets by their pool
+  vkDestroyDescriptorPool(ctx.device, occlusion.descPool, nullptr);
+  vkDestroyPipelineLayout(ctx.device, occlusion.pipelineLayout, nullptr);
+  vkDestroyDescriptorSetLayout(ctx.device, occlusion.descLayout, nullptr);
+
+  for (auto &view : occlusion.levelViews) {
+    vkDestroyImageView(ctx.device, view, nullptr);
+  }
+  vkDestroyImage(ctx.device, occlusion.pyramid, nullptr);
+  vkFreeMemory(ctx.device, occlusion.pyramidMem, nullptr);
+
+  vkDestroyImageView(ctx.device, occlusion.depthSampledView, nullptr);
+  vkDestroyImageView(ctx.device, occlusion.depthView, nullptr);
+  vkDestroyImage(ctx.device, occlusion.depth, nullptr);
+  vkFreeMemory(ctx.device, occlusion.depthMem, nullptr);
+
+  delete ctx.occlusion;
+  ctx.occlusion = nullptr;
+}
+
+// ----------------------------------------------------------------------------
+
+void record_occlusion(VulkanContext &ctx, VkCommandBuffer cmd, const uint32_t slot) {
+  OcclusionCuller &occlusion = *ctx.occlusion;
+  assert(occlusion.enabled);
+
+  /**
+  * The render pass leaves the depth in the shader read layout, without
+  * making its writes available. The pyramid content of the previous frame
+  * is discarded, once its reduction and copy are done.
+  */
+  VkImageMemoryBarrier barriers[2u];
+  memset(barriers, 0, sizeof(barriers));
+  barriers[0u].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barriers[0u].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  barriers[0u].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barriers[0u].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barriers[0u].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barriers[0u].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barriers[0u].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barriers[0u].image = occlusion.depth;
+  barriers[0u].subresourceRange = { occlusion.depthAspect, 0u, 1u, 0u, 1u };
+
+  barriers[1u] = barriers[0u];
+  barriers[1u].srcAccessMask = 0u;
+  barriers[1u].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barriers[1u].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barriers[1u].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+  barriers[1u].image = occlusion.pyramid;
+  barriers[1u].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, occlusion.levels, 0u, 1u };
+
+  vkCmdPipelineBarrier(cmd,
+                       VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT
+                     | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+                     | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       0u, 0u, nullptr, 0u, nullptr, 2u, barriers);
+
+  /* Reduce level by level, each one waiting for the previous */
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, occlusion.pipeline);
+
+  VkImageMemoryBarrier levelBarrier = barriers[1u];
+  levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  levelBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+  levelBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+  levelBarrier.subresourceRange.levelCount = 1u;
+
+  int32_t extents[4u] = {
+    int32_t(occlusion.depthWidth), int32_t(occlusion.depthHeight), 0, 0
+  };
+
+  for (uint32_t level = 0u; level < occlusion.levels; ++level) {
+    extents[2u] = int32_t(std::max(occlusion.width >> level, 1u));
+    extents[3u] = int32_t(std::max(occlusion.height >> level, 1u));
+
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, occlusion.pipelineLayout,
+                            0u, 1u, &occlusion.descSets[level], 0u, nullptr);
+    vkCmdPushConstants(cmd, occlusion.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT,
+                       0u, sizeof(extents), extents);
+    vkCmdDispatch(cmd, (extents[2u] + kHiZGroupSize - 1u) / kHiZGroupSize,
+                       (extents[3u] + kHiZGroupSize - 1u) / kHiZGroupSize,
+                       1u);
+
+    // the last level is read by the copy instead
+    const bool bLast = (level + 1u == occlusion.levels);
+    levelBarrier.dstAccessMask = (bLast) ? VK_ACCESS_TRANSFER_READ_BIT
+                                         : VK_ACCESS_SHADER_READ_BIT;
+    levelBarrier.subresourceRange.baseMipLevel = level;
+    vkCmdPipelineBarrier(cmd,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         (bLast) ? VK_PIPELINE_STAGE_TRANSFER_BIT
+                                 : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0u, 0u, nullptr, 0u, nullptr, 1u, &levelBarrier);
+
+    extents[0u] = extents[2u];
+    extents[1u] = extents[3u];
+  }
+
+  /* Copy the last level to the readback of the slot */
+  const OcclusionCuller::Readback &readback = occlusion.readbacks[slot];
+
+  VkBufferImageCopy region;
+  memset(&region, 0, sizeof(region));
+  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.imageSubresource.mipLevel = occlusion.levels - 1u;
+  region.imageSubresource.layerCount = 1u;
+  region.imageExtent.width = uint32_t(extents[2u]);
+  region.imageExtent.height = uint32_t(extents[3u]);
+  region.imageExtent.depth = 1u;
+
+  vkCmdCopyImageToBuffer(cmd, occlusion.pyramid, VK_IMAGE_LAYOUT_GENERAL,
+                         readback.buffer, 1u, &region);
+
+  /* Make the copy visible to the host */
+  VkBufferMemoryBarrier hostBarrier;
+  memset(&hostBarrier, 0, sizeof(hostBarrier));
+  hostBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  hostBarrier.buffer = readback.buffer;
+  hostBarrier.size = VK_WHOLE_SIZE;
+
+  // the depth is cleared by the next frame once the reduction has read it
+  vkCmdPipelineBarrier(cmd,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT
+                     | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT
+                     | VK_PIPELINE_STAGE_HOST_BIT,
+                       0u, 0u, nullptr, 1u, &hostBarrier, 0u, nullptr);
+}
+
+// ----------------------------------------------------------------------------
+
+void end_occlusion_frame(VulkanContext &ctx, const uint64_t value) {
+  OcclusionCuller &occlusion = *ctx.occlusion;
+
+  if (occlusion.enabled) {
+    occlusion.readbacks[ctx.frameScheduler->slotIndex].value = value;
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+bool begin_occlusion_test(VulkanContext &ctx, const uint32_t slot) {
+  const OcclusionCuller &occlusion = *ctx.occlusion;
+  return occlusion.enabled && (occlusion.readbacks[slot].value != 0u);
+}
+
+// ----------------------------------------------------------------------------
+
+bool is_sphere_occluded(VulkanContext &ctx,
+                        const uint32_t slot,
+                        const vec4 center,
+                        const float radius)
+{
+  OcclusionCuller &occlusion = *ctx.occlusion;
+  OcclusionCuller::Readback &readback = occlusion.readbacks[slot];
+
+  ++occlusion.stats.tested;
+
+  /* Screen rectangle and nearest depth of the box around the sphere */
+  float min_x = 1.0f, max_x = -1.0f;
+  float min_y = 1.0f, max_y = -1.0f;
+  float min_z = 1.0f;
+
+  for (uint32_t i = 0u; i < 8u; ++i) {
+    vec4 corner = {
+      center[0u] + ((i & 1u) ? radius : -radius),
+      center[1u] + ((i & 2u) ? radius : -radius),
+      center[2u] + ((i & 4u) ? radius : -radius),
+      1.0f
+    };
+    vec4 clip;
+    mat4x4_mul_vec4(clip, readback.viewProj.m, corner);
+
+    // crossing the near plane, the box covers the camera
+    if (!(clip[3u] > 0.0f)) {
+      return false;
+    }
+    const float inv_w = 1.0f / clip[3u];
+    min_x = std::min(min_x, clip[0u] * inv_w);
+    max_x = std::max(max_x, clip[0u] * inv_w);
+    min_y = std::min(min_y, clip[1u] * inv_w);
+    max_y = std::max(max_y, clip[1u] * inv_w);
+    min_z = std::min(min_z, clip[2u] * inv_w);
+  }
+
+  /**
+  * The viewport writes the normalized z as depth and maps y = -1 to the
+  * first row. Boxes in front of the depth range, or out of the previous
+  * view, cannot be tested.
+  */
+  if (!(min_z > 0.0f) || (max_x < -1.0f) || (min_x > 1.0f)
+                      || (max_y < -1.0f) || (min_y > 1.0f)) {
+    return false;
+  }
+
+  const uint32_t last = occlusion.levels - 1u;
+  const uint32_t width = std::max(occlusion.width >> last, 1u);
+  const uint32_t height = std::max(occlusion.height >> last, 1u);
+
+  const auto texel = [](const float ndc, const uint32_t size) {
+    const float t = (0.5f * ndc + 0.5f) * size;
+    return std::min(uint32_t(std::max(t, 0.0f)), size - 1u);
+  };
+  const uint32_t x0 = texel(min_x, width), x1 = texel(max_x, width);
+  const uint32_t y0 = texel(min_y, height), y1 = texel(max_y, height);
+
+  /* Occluded when nearer than none of the farthest depths it covers */
+  for (uint32_t y = y0; y <= y1; ++y) {
+    for (uint32_t x = x0; x <= x1; ++x) {
+      if (min_z <= readback.depths[y * width + x]) {
+        return false;
+      }
+    }
+  }
+
+  ++occlusion.stats.occluded;
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+
+void end_occlusion_test(VulkanContext &ctx, const uint32_t slot, mat4x4 viewProj) {
+  OcclusionCuller &occlusion = *ctx.occlusion;
+
+  if (occlusion.enabled) {
+    mat4x4_dup(occlusion.readbacks[slot].viewProj.m, viewProj);
+    occlusion.readbacks[slot].value = 0u;
+  }
+}
+
+// ============================================================================
@@ -0,0 +1,101 @@
+#ifndef OCCLUSION_H_
+#define OCCLUSION_H_
+
+#include <vector>
+
+#include "common.h"
+#include "frame_scheduler.h"
+
+/* Largest extent of the Hi-Z level read back by the CPU */
+const uint32_t kOcclusionReadbackSize = 128u;
+
+/**
+* Occlusion culling against the depth of a previous frame.
+* The depth buffer of the primary surface is kept after its pass, reduced
+* to a Hi-Z pyramid (farthest depth per texel) by a compute shader, and its
+* coarsest level is copied to host memory, one readback per frame slot.
+* Once the slot is reused, the CPU culling pass tests the bounds of the
+* instances against it, projected with the camera of that frame. The test
+* lags by the frames in flight : objects newly uncovered can appear a few
+* frames late, hence the option.
+*/
+struct OcclusionCuller {
+  bool enabled = false;
+
+  /* Depth attachment of the primary surface, sampled once drawn */
+  VkImage depth = VK_NULL_HANDLE;
+  VkDeviceMemory depthMem = VK_NULL_HANDLE;
+  VkImageView depthView = VK_NULL_HANDLE;         // attachment (every aspect)
+  VkImageView depthSampledView = VK_NULL_HANDLE;  // depth aspect only
+  VkImageAspectFlags depthAspect = 0u;
+  uint32_t depthWidth = 0u;
+  uint32_t depthHeight = 0u;
+
+  /* Hi-Z pyramid, from the power of two below the depth extent down to the level read back */
+  VkImage pyramid = VK_NULL_HANDLE;
+  VkDeviceMemory pyramidMem = VK_NULL_HANDLE;
+  std::vector<VkImageView> levelViews;
+  uint32_t width = 0u;
+  uint32_t height = 0u;
+  uint32_t levels = 0u;
+
+  /* Reduction pipeline, one descriptor set per level */
+  VkDescriptorSetLayout descLayout = VK_NULL_HANDLE;
+  VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VkDescriptorPool descPool = VK_NULL_HANDLE;
+  std::vector<VkDescriptorSet> descSets;
+
+  /* Last level of a frame slot, with the camera it was rendered from */
+  struct Readback {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory mem = VK_NULL_HANDLE;
+    const float *depths = nullptr;
+    Matrix viewProj;
+    uint64_t value = 0u;      // frame value of the copy, 0 until submitted
+  } readbacks[kMaxFramesInFlight];
+
+  struct {
+    uint64_t tested = 0u;     // instances tested against a readback
+    uint64_t occluded = 0u;
+  } stats;
+};
+
+/* Return true when the options request occlusion culling */
+bool occlusion_requested(const AppOptions &options);
+
+/**
+* Create the kept depth buffer of the primary surface, the pyramid and its
+* reduction pipeline, when requested and supported.
+*/
+void init_occlusion(VulkanContext &ctx);
+
+/* Report the instances occluded, and destroy the resources, the device must be idle */
+void release_occlusion(VulkanContext &ctx);
+
+/**
+* Record the reduction of the depth buffer into the pyramid and the copy of
+* its last level into the readback of a frame slot, after the passes of the
+* primary surface.
+*/
+void record_occlusion(VulkanContext &ctx, VkCommandBuffer cmd, const uint32_t slot);
+
+/* Tag the readback of the current slot with the value of its submission */
+void end_occlusion_frame(VulkanContext &ctx, const uint64_t value);
+
+/**
+* Return true when the slot holds a completed readback to test against,
+* the slot being waited for by begin_frame.
+*/
+bool begin_occlusion_test(VulkanContext &ctx, const uint32_t slot);
+
+/* Return true when a world space bounding sphere is behind the readback depth */
+bool is_sphere_occluded(VulkanContext &ctx,
+                        const uint32_t slot,
+                        const vec4 center,
+                        const float radius);
+
+/* Keep the camera of the frame recorded in the slot, for its readback */
+void end_occlusion_test(VulkanContext &ctx, const uint32_t slot, mat4x4 viewProj);
+
+#endif  // OCCLUSION_H_
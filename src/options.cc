@@ -0,0 +1,196 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "options.h"
+
+// ============================================================================
+
+static
+void print_usage(const char *appname) {
+  fprintf(stdout,
+    "usage : %s [options]\n"
+    "  --profile=validation|performance  Vulkan layers profile\n"
+    "                                    (env VK_TRIANGLE_PROFILE)\n"
+    "  --debug-messenger                 print validation messages through\n"
+    "                                    VK_EXT_debug_utils\n"
+    "  --graph-report                    print the passes and images of\n"
+    "                                    the compiled render graphs\n"
+    "  --texture=<file>                  KTX or DDS texture to apply\n"
+    "  --mesh=<file>                     binary mesh to draw in place of\n"
+    "                                    the triangle (see mesh_convert)\n"
+    "  --windows=<n>                     number of windows (1 to 8)\n"
+    "  --present=low-latency|power-saving|benchmark\n"
+    "                                    presentation policy\n"
+    "                                    (env VK_TRIANGLE_PRESENT)\n"
+    "  --late-latch                      sample inputs as late as the GPU\n"
+    "                                    allows, from its measured frame time\n"
+    "  --uniform-camera                  send the camera through a uniform\n"
+    "                                    buffer instead of push constants\n"
+    "  --msaa=1|2|4|8                    multisampling sample count\n"
+    "  --occlusion                       cull instances hidden in the depth\n"
+    "                                    of a previous frame (without MSAA)\n"
+    "  --frames=<n>                      exit after rendering n frames\n"
+    "  --capture=<file.ppm>              write a frame to a PPM file\n"
+    "  --capture-frame=<n>               index of the captured frame\n"
+    "                                    (default : last frame, or 0)\n"
+    "  --golden=<file.ppm>               compare the captured frame to a\n"
+    "                                    golden image, exit on failure\n"
+    "  --tolerance=<n>                   per channel difference allowed\n"
+    "                                    with the golden image (default 2)\n"
+    "  --help                            show this message\n",
+    appname
+  );
+}
+
+// ----------------------------------------------------------------------------
+
+static
+bool parse_layer_profile(const char *value, LayerProfile &profile) {
+  if (!strcmp(value, "validation")) {
+    profile = LAYER_PROFILE_VALIDATION;
+  } else if (!strcmp(value, "performance")) {
+    profile = LAYER_PROFILE_PERFORMANCE;
+  } else {
+    fprintf(stderr, "Options error : unknown layer profile \"%s\".\n", value);
+    return false;
+  }
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+
+static
+bool parse_present_policy(const char *value, PresentPolicy &policy) {
+  if (!strcmp(value, "low-latency")) {
+    policy = PRESENT_POLICY_LOW_LATENCY;
+  } else if (!strcmp(value, "power-saving")) {
+    policy = PRESENT_POLICY_POWER_SAVING;
+  } else if (!strcmp(value, "benchmark")) {
+    policy = PRESENT_POLICY_BENCHMARK;
+  } else {
+    fprintf(stderr, "Options error : unknown present policy \"%s\".\n", value);
+    return false;
+  }
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+
+static
+bool parse_uint(const char *name, const char *value, uint32_t &n) {
+  char *end = nullptr;
+  const unsigned long v = strtoul(value, &end, 10);
+  if ((*value == '\0') || (*end != '\0') || (v > UINT32_MAX)) {
+    fprintf(stderr, "Options error : invalid %s \"%s\".\n", name, value);
+    return false;
+  }
+  n = static_cast<uint32_t>(v);
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+
+static
+bool parse_msaa_samples(const char *value, uint32_t &samples) {
+  uint32_t n;
+  if (!parse_uint("MSAA sample count", value, n)) {
+    return false;
+  }
+  if ((n != 1u) && (n != 2u) && (n != 4u) && (n != 8u)) {
+    fprintf(stderr, "Options error : invalid MSAA sample count \"%s\".\n", value);
+    return false;
+  }
+  samples = n;
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+
+/* Return the value of a "--name=value" argument, or nullptr */
+static
+const char* option_value(const char *arg, const char *name) {
+  const size_t len = strlen(name);
+  if (!strncmp(arg, name, len) && (arg[len] == '=')) {
+    return arg + len + 1u;
+  }
+  return nullptr;
+}
+
+// ----------------------------------------------------------------------------
+
+void parse_options(int argc, char *argv[], AppOptions &options) {
+  const char *value;
+
+  /* Environment */
+  if ((value = getenv("VK_TRIANGLE_PROFILE")) != nullptr) {
+    parse_layer_profile(value, options.layerProfile);
+  }
+  if ((value = getenv("VK_TRIANGLE_PRESENT")) != nullptr) {
+    parse_present_policy(value, options.presentPolicy);
+  }
+
+  /* Command line */
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+
+    if ((value = option_value(arg, "--profile")) != nullptr) {
+      if (!parse_layer_profile(value, options.layerProfile)) {
+        exit(EXIT_FAILURE);
+      }
+    } else if (!strcmp(arg, "--debug-messenger")) {
+      options.debugMessenger = true;
+    } else if (!strcmp(arg, "--graph-report")) {
+      options.renderGraphReport = true;
+    } else if ((value = option_value(arg, "--texture")) != nullptr) {
+      options.texture = value;
+    } else if ((value = option_value(arg, "--mesh")) != nullptr) {
+      options.mesh = value;
+    } else if ((value = option_value(arg, "--windows")) != nullptr) {
+      if (!parse_uint("window count", value, options.windows)
+       || (options.windows == 0u) || (options.windows > kMaxWindows)) {
+        fprintf(stderr, "Options error : 1 to %u windows are supported.\n", kMaxWindows);
+        exit(EXIT_FAILURE);
+      }
+    } else if ((value = option_value(arg, "--present")) != nullptr) {
+      if (!parse_present_policy(value, options.presentPolicy)) {
+        exit(EXIT_FAILURE);
+      }
+    } else if (!strcmp(arg, "--late-latch")) {
+      options.lateLatch = true;
+    } else if (!strcmp(arg, "--uniform-camera")) {
+      options.uniformCamera = true;
+    } else if ((value = option_value(arg, "--msaa")) != nullptr) {
+      if (!parse_msaa_samples(value, options.msaaSamples)) {
+        exit(EXIT_FAILURE);
+      }
+    } else if (!strcmp(arg, "--occlusion")) {
+      options.occlusion = true;
+    } else if ((value = option_value(arg, "--frames")) != nullptr) {
+      if (!parse_uint("frame count", value, options.frames)) {
+        exit(EXIT_FAILURE);
+      }
+    } else if ((value = option_value(arg, "--capture")) != nullptr) {
+      options.capture = value;
+    } else if ((value = option_value(arg, "--capture-frame")) != nullptr) {
+      if (!parse_uint("capture frame", value, options.captureFrame)) {
+        exit(EXIT_FAILURE);
+      }
+    } else if ((value = option_value(arg, "--golden")) != nullptr) {
+      options.golden = value;
+    } else if ((value = option_value(arg, "--tolerance")) != nullptr) {
+      if (!parse_uint("tolerance", value, options.goldenTolerance)) {
+        exit(EXIT_FAILURE);
+      }
+    } else if (!strcmp(arg, "--help")) {
+      print_usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    } else {
+      fprintf(stderr, "Options error : unknown argument \"%s\".\n", arg);
+      print_usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+// ============================================================================
@@ -0,0 +1,80 @@
+#ifndef OPTIONS_H_
+#define OPTIONS_H_
+
+#include <cstdint>
+#include <string>
+
+/* Set of Vulkan layers enabled on the instance and device */
+enum LayerProfile {
+  LAYER_PROFILE_VALIDATION,   // validation layers, when available
+  LAYER_PROFILE_PERFORMANCE,  // no layer at all
+};
+
+/* Presentation trade-off, between latency, power and throughput */
+enum PresentPolicy {
+  PRESENT_POLICY_LOW_LATENCY,   // MAILBOX / IMMEDIATE, fewest images, 1 frame in flight
+  PRESENT_POLICY_POWER_SAVING,  // FIFO, capped to the display rate
+  PRESENT_POLICY_BENCHMARK,     // IMMEDIATE, uncapped, every frame in flight
+};
+
+/* Highest number of windows sharing the device */
+const uint32_t kMaxWindows = 8u;
+
+/* Capture the last frame of a bounded run, or the first one otherwise */
+const uint32_t kCaptureLastFrame = UINT32_MAX;
+
+/**
+* Application options, set by order of priority from :
+*   the command line, the environment then the build type.
+*/
+struct AppOptions {
+#ifdef NDEBUG
+  LayerProfile layerProfile = LAYER_PROFILE_PERFORMANCE;
+#else
+  LayerProfile layerProfile = LAYER_PROFILE_VALIDATION;
+#endif
+
+  /* Report validation messages through VK_EXT_debug_utils */
+  bool debugMessenger = false;
+
+  /* Print the passes, culled passes and images of each compiled render graph */
+  bool renderGraphReport = false;
+
+  /* KTX or DDS texture applied to the triangle, white when empty */
+  std::string texture;
+
+  /* Binary mesh (from mesh_convert) drawn in place of the triangle */
+  std::string mesh;
+
+  /* Windows rendered and presented together */
+  uint32_t windows = 1u;
+
+  /* Present mode, swapchain image count and frames in flight */
+  PresentPolicy presentPolicy = PRESENT_POLICY_LOW_LATENCY;
+
+  /* Delay the input sampling until just before the GPU needs the frame */
+  bool lateLatch = false;
+
+  /* Send the camera through the uniform buffer instead of push constants */
+  bool uniformCamera = false;
+
+  /* Requested multisampling (1, 2, 4 or 8), capped by the device */
+  uint32_t msaaSamples = 1u;
+
+  /* Cull the instances hidden in the depth of a previous frame (without MSAA) */
+  bool occlusion = false;
+
+  /* Number of frames rendered before exiting, 0 runs until closed */
+  uint32_t frames = 0u;
+
+  /* Readback of a frame written to a PPM file and / or compared to a golden PPM */
+  std::string capture;
+  std::string golden;
+  uint32_t captureFrame = kCaptureLastFrame;
+  uint32_t goldenTolerance = 2u;    // per channel difference allowed
+};
+
+/* Fill options from the environment and the command line */
+void parse_options(int argc, char *argv[], AppOptions &options);
+
+#endif  // OPTIONS_H_
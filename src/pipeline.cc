@@ -0,0 +1,541 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "vulkan/vulkan.h"
+#include "hash.h"
+#include "pipeline.h"
+#include "profiler.h"
+
+// ============================================================================
+
+static
+char* read_binary_file(const char *filename, size_t &filesize) {
+    FILE *fd = fopen(filename, "rb");
+    if (!fd) {
+      return nullptr;
+    }
+
+    fseek(fd, 0L, SEEK_END);
+    filesize = ftell(fd);
+    fseek(fd, 0L, SEEK_SET);
+
+    char* shader_binary = new char[filesize];
+    size_t ret = fread(shader_binary, filesize, 1u, fd);
+    assert(ret == 1u);
+
+    fclose(fd);
+    return shader_binary;
+}
+
+// ----------------------------------------------------------------------------
+
+static
+VkShaderModule create_shader_module(VkDevice device, const char *filename) {
+    PROFILE_FUNCTION();
+
+    size_t codesize;
+    char* code = read_binary_file(filename, codesize);
+
+    if (code == nullptr) {
+      fprintf(stderr, "Error : shader \"%s\" not found.\n", filename);
+      exit(EXIT_FAILURE);
+    }
+
+    VkResult err;
+
+    VkShaderModuleCreateInfo moduleInfo;
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.pNext = nullptr;
+    moduleInfo.flags = 0;
+    moduleInfo.codeSize = codesize;
+    moduleInfo.pCode = (uint32_t*)code;
+
+    VkShaderModule module;
+    err = vkCreateShaderModule(device, &moduleInfo, nullptr, &module);
+    assert(!err);
+
+    delete [] code;
+
+    return module;
+}
+
+// ----------------------------------------------------------------------------
+
+/* Retrieve a shader module from the manager, loading it on first use */
+static
+VkShaderModule get_shader_module(VulkanContext &ctx, const std::string &filename) {
+  PipelineManager &mgr = *ctx.pipelineManager;
+
+  {
+    std::lock_guard<std::mutex> lock(mgr.mutex);
+    auto it = mgr.shaders.find(filename);
+    if (it != mgr.shaders.end()) {
+      return it->second;
+    }
+  }
+
+  // file I/O is done outside the lock, concurrent loads of the same file
+  // keep the first module inserted
+  VkShaderModule module = create_shader_module(ctx.device, filename.c_str());
+
+  std::lock_guard<std::mutex> lock(mgr.mutex);
+  auto res = mgr.shaders.insert(std::make_pair(filename, module));
+  if (!res.second) {
+    vkDestroyShaderModule(ctx.device, module, nullptr);
+  }
+  return res.first->second;
+}
+
+// ----------------------------------------------------------------------------
+
+static
+VkPipeline create_graphics_pipeline(VulkanContext &ctx, const PipelineDesc &desc) {
+  PROFILE_FUNCTION();
+
+  VkResult err;
+
+  /* Setup pipeline shader stages */
+  const unsigned int stageCount = 2u;
+  VkPipelineShaderStageCreateInfo shaderStages[stageCount];
+  memset(&shaderStages, 0, stageCount * sizeof(VkPipelineShaderStageCreateInfo));
+
+  shaderStages[0u].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shaderStages[0u].stage = VK_SHADER_STAGE_VERTEX_BIT;
+  shaderStages[0u].module = get_shader_module(ctx, desc.vert_shader);
+  shaderStages[0u].pName = "main";
+
+  shaderStages[1u].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shaderStages[1u].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  shaderStages[1u].module = get_shader_module(ctx, desc.frag_shader);
+  shaderStages[1u].pName = "main";
+
+
+  /* Setup pipeline states */
+  struct States_t {
+    VkPipelineVertexInputStateCreateInfo vi;
+    VkPipelineInputAssemblyStateCreateInfo ia;
+    VkPipelineTessellationStateCreateInfo ts;
+    VkPipelineViewportStateCreateInfo vp;
+    VkPipelineRasterizationStateCreateInfo rs;
+    VkPipelineMultisampleStateCreateInfo ms;
+    VkPipelineDepthStencilStateCreateInfo ds;
+    VkPipelineColorBlendStateCreateInfo cb;
+    VkPipelineDynamicStateCreateInfo dynamic;
+  } states;
+  memset(&states, 0, sizeof(States_t));
+
+  // vertex input
+  states.vi.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  states.vi.vertexBindingDescriptionCount = desc.bindings.size();
+  states.vi.pVertexBindingDescriptions = desc.bindings.data();
+  states.vi.vertexAttributeDescriptionCount = desc.attributes.size();
+  states.vi.pVertexAttributeDescriptions = desc.attributes.data();
+
+  // input assembly
+  states.ia.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  states.ia.topology = desc.topology;
+
+  // tessellation
+  states.ts.sType = VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO;
+
+  // viewport
+  states.vp.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  states.vp.viewportCount = 1u;
+  states.vp.scissorCount = 1u;
+
+  // rasterization
+  states.rs.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  states.rs.flags = 0;
+  states.rs.depthClampEnable = VK_FALSE;
+  states.rs.rasterizerDiscardEnable = VK_FALSE;
+  states.rs.polygonMode = desc.polygonMode;
+  states.rs.cullMode = desc.cullMode;
+  states.rs.frontFace = desc.frontFace;
+  states.rs.depthBiasEnable = VK_FALSE;
+  states.rs.lineWidth = 1.0f;
+
+  // multisample
+  states.ms.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  states.ms.pSampleMask = nullptr;
+  states.ms.rasterizationSamples = desc.samples;
+
+  // depth stencil
+  states.ds.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  states.ds.depthTestEnable = desc.depthTest;
+  states.ds.depthWriteEnable = desc.depthWrite;
+  states.ds.depthCompareOp = desc.depthCompareOp;
+  states.ds.depthBoundsTestEnable = VK_FALSE;
+  states.ds.stencilTestEnable = VK_FALSE;
+  states.ds.back.failOp = VK_STENCIL_OP_KEEP;
+  states.ds.back.passOp = VK_STENCIL_OP_KEEP;
+  states.ds.back.compareOp = VK_COMPARE_OP_ALWAYS;
+  states.ds.front = states.ds.back;
+
+  // color blend
+  VkPipelineColorBlendAttachmentState blendAttachState;
+  memset(&blendAttachState, 0, sizeof(VkPipelineColorBlendAttachmentState));
+  blendAttachState.blendEnable = desc.blendEnable;
+  blendAttachState.srcColorBlendFactor = desc.srcColorBlendFactor;
+  blendAttachState.dstColorBlendFactor = desc.dstColorBlendFactor;
+  blendAttachState.colorBlendOp = desc.colorBlendOp;
+  blendAttachState.srcAlphaBlendFactor = desc.srcColorBlendFactor;
+  blendAttachState.dstAlphaBlendFactor = desc.dstColorBlendFactor;
+  blendAttachState.alphaBlendOp = desc.colorBlendOp;
+  blendAttachState.colorWriteMask = desc.colorWriteMask;
+
+  states.cb.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  states.cb.attachmentCount = 1u;
+  states.cb.pAttachments = &blendAttachState;
+
+  // dynamic states
+  VkDynamicState dynamicStateEnables[VK_DYNAMIC_STATE_RANGE_SIZE];
+  unsigned int dynamicStateCount = 0u;
+  memset(dynamicStateEnables, 0, sizeof(VkDynamicState));
+  dynamicStateEnables[dynamicStateCount++] = VK_DYNAMIC_STATE_VIEWPORT;
+  dynamicStateEnables[dynamicStateCount++] = VK_DYNAMIC_STATE_SCISSOR;
+
+  states.dynamic.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  states.dynamic.dynamicStateCount = dynamicStateCount;
+  states.dynamic.pDynamicStates = dynamicStateEnables;
+
+
+  /* Create the Graphic Pipeline */
+  VkGraphicsPipelineCreateInfo pipeline;
+  memset(&pipeline, 0, sizeof(pipeline));
+  pipeline.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipeline.stageCount = stageCount;
+  pipeline.pStages = shaderStages;
+  
+  pipeline.pVertexInputState = &states.vi;
+  pipeline.pInputAssemblyState = &states.ia;
+  pipeline.pTessellationState = nullptr;
+  pipeline.pViewportState = &states.vp;
+  pipeline.pRasterizationState = &states.rs;
+  pipeline.pMultisampleState = &states.ms;
+  pipeline.pDepthStencilState = &states.ds;
+  pipeline.pColorBlendState = &states.cb;
+  pipeline.pDynamicState = &states.dynamic;
+
+  pipeline.layout = desc.layout;
+  pipeline.renderPass = desc.renderPass;
+  pipeline.subpass = desc.subpass;
+
+  // the pipeline cache is internally synchronized, it can be shared by workers
+  VkPipeline handle;
+  err = vkCreateGraphicsPipelines(
+    ctx.device, ctx.pipelineCache, 1u, &pipeline, nullptr, &handle
+  );
+  assert(!err);
+
+  return handle;
+}
+
+// ----------------------------------------------------------------------------
+
+static
+VkPipeline create_compute_pipeline(VulkanContext &ctx, const PipelineDesc &desc) {
+  PROFILE_FUNCTION();
+
+  VkComputePipelineCreateInfo info;
+  memset(&info, 0, sizeof(info));
+  info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  info.stage.module = get_shader_module(ctx, desc.comp_shader);
+  info.stage.pName = "main";
+  info.layout = desc.layout;
+  info.basePipelineIndex = -1;
+
+  VkPipeline pipeline;
+  VkResult err;
+  err = vkCreateComputePipelines(ctx.device, ctx.pipelineCache, 1u, &info, nullptr, &pipeline);
+  assert(!err);
+
+  return pipeline;
+}
+
+// ----------------------------------------------------------------------------
+
+void init_pipeline_manager(VulkanContext &ctx) {
+  VkResult err;
+
+  assert(ctx.pipelineManager == nullptr);
+
+  /* Create the pipeline cache */
+  VkPipelineCacheCreateInfo pipelineCache;
+  memset(&pipelineCache, 0, sizeof(pipelineCache));
+  pipelineCache.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+  err =
+  vkCreatePipelineCache(ctx.device, &pipelineCache, nullptr, &ctx.pipelineCache);
+  assert(!err);
+
+  /* Keep a core for the main thread */
+  const unsigned int hw_threads = std::thread::hardware_concurrency();
+  const unsigned int num_workers = (hw_threads > 2u) ? hw_threads - 1u : 1u;
+
+  ctx.pipelineManager = new PipelineManager();
+  thread_pool_init(ctx.pipelineManager->workers, num_workers);
+}
+
+// ----------------------------------------------------------------------------
+
+void release_pipeline_manager(VulkanContext &ctx) {
+  if (ctx.pipelineManager == nullptr) {
+    return;
+  }
+  PipelineManager &mgr = *ctx.pipelineManager;
+
+  thread_pool_release(mgr.workers);
+
+  for (auto &it : mgr.pipelines) {
+    vkDestroyPipeline(ctx.device, it.second.pipeline, nullptr);
+  }
+  for (auto &it : mgr.shaders) {
+    vkDestroyShaderModule(ctx.device, it.second, nullptr);
+  }
+  vkDestroyPipelineCache(ctx.device, ctx.pipelineCache, nullptr);
+  ctx.pipelineCache = VK_NULL_HANDLE;
+
+  delete ctx.pipelineManager;
+  ctx.pipelineManager = nullptr;
+}
+
+// ----------------------------------------------------------------------------
+
+uint64_t hash_pipeline_desc(const PipelineDesc &desc) {
+  uint64_t h = kHashSeed;
+
+  // lengths are hashed ahead of the contents, so that consecutive strings
+  // or lists splitting the same bytes differently do not collide
+  h = hash_value(uint64_t(desc.vert_shader.size()), h);
+  h = hash_string(desc.vert_shader.c_str(), h);
+  h = hash_value(uint64_t(desc.frag_shader.size()), h);
+  h = hash_string(desc.frag_shader.c_str(), h);
+  h = hash_value(uint64_t(desc.comp_shader.size()), h);
+  h = hash_string(desc.comp_shader.c_str(), h);
+
+  h = hash_value(uint64_t(desc.bindings.size()), h);
+  for (const auto &b : desc.bindings) {
+    h = hash_value(b.binding, h);
+    h = hash_value(b.stride, h);
+    h = hash_value(b.inputRate, h);
+  }
+  h = hash_value(uint64_t(desc.attributes.size()), h);
+  for (const auto &a : desc.attributes) {
+    h = hash_value(a.location, h);
+    h = hash_value(a.binding, h);
+    h = hash_value(a.format, h);
+    h = hash_value(a.offset, h);
+  }
+  h = hash_value(desc.topology, h);
+
+  h = hash_value(desc.polygonMode, h);
+  h = hash_value(desc.cullMode, h);
+  h = hash_value(desc.frontFace, h);
+  h = hash_value(desc.samples, h);
+
+  h = hash_value(desc.depthTest, h);
+  h = hash_value(desc.depthWrite, h);
+  h = hash_value(desc.depthCompareOp, h);
+
+  h = hash_value(desc.blendEnable, h);
+  h = hash_value(desc.srcColorBlendFactor, h);
+  h = hash_value(desc.dstColorBlendFactor, h);
+  h = hash_value(desc.colorBlendOp, h);
+  h = hash_value(desc.colorWriteMask, h);
+
+  h = hash_value(desc.layout, h);
+  h = hash_value(desc.renderPass, h);
+  h = hash_value(desc.subpass, h);
+
+  return h;
+}
+
+// ----------------------------------------------------------------------------
+
+bool equal_pipeline_desc(const PipelineDesc &a, const PipelineDesc &b) {
+  const auto equal_binding = [](const VkVertexInputBindingDescription &x,
+                                const VkVertexInputBindingDescription &y) {
+    return (x.binding == y.binding) && (x.stride == y.stride)
+        && (x.inputRate == y.inputRate);
+  };
+  const auto equal_attribute = [](const VkVertexInputAttributeDescription &x,
+                                  const VkVertexInputAttributeDescription &y) {
+    return (x.location == y.location) && (x.binding == y.binding)
+        && (x.format == y.format) && (x.offset == y.offset);
+  };
+
+  return (a.vert_shader == b.vert_shader)
+      && (a.frag_shader == b.frag_shader)
+      && (a.comp_shader == b.comp_shader)
+      && (a.bindings.size() == b.bindings.size())
+      && std::equal(a.bindings.begin(), a.bindings.end(), b.bindings.begin(), equal_binding)
+      && (a.attributes.size() == b.attributes.size())
+      && std::equal(a.attributes.begin(), a.attributes.end(), b.attributes.begin(), equal_attribute)
+      && (a.topology == b.topology)
+      && (a.polygonMode == b.polygonMode)
+      && (a.cullMode == b.cullMode)
+      && (a.frontFace == b.frontFace)
+      && (a.samples == b.samples)
+      && (a.depthTest == b.depthTest)
+      && (a.depthWrite == b.depthWrite)
+      && (a.depthCompareOp == b.depthCompareOp)
+      && (a.blendEnable == b.blendEnable)
+      && (a.srcColorBlendFactor == b.srcColorBlendFactor)
+      && (a.dstColorBlendFactor == b.dstColorBlendFactor)
+      && (a.colorBlendOp == b.colorBlendOp)
+      && (a.colorWriteMask == b.colorWriteMask)
+      && (a.layout == b.layout)
+      && (a.renderPass == b.renderPass)
+      && (a.subpass == b.subpass);
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+* Key of the entry holding desc, probing the keys following its hash on
+* collisions. When it is not cached, return the first free key.
+* The manager's mutex must be held.
+*/
+static
+uint64_t find_pipeline_key(const PipelineManager &mgr, const PipelineDesc &desc, bool &bFound) {
+  uint64_t key = hash_pipeline_desc(desc);
+  for (;;) {
+    auto it = mgr.pipelines.find(key);
+    if (it == mgr.pipelines.end()) {
+      bFound = false;
+      return key;
+    }
+    if (equal_pipeline_desc(it->second.desc, desc)) {
+      bFound = true;
+      return key;
+    }
+    ++key;
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+void load_shader_modules(VulkanContext &ctx, const PipelineDesc &desc) {
+  assert(ctx.pipelineManager != nullptr);
+  get_shader_module(ctx, desc.vert_shader);
+  get_shader_module(ctx, desc.frag_shader);
+}
+
+// ----------------------------------------------------------------------------
+
+/* Compile a pipeline reserved in the cache and mark it as ready */
+static
+VkPipeline compile_reserved_pipeline(VulkanContext &ctx,
+                                     const PipelineDesc &desc,
+                                     const uint64_t key) {
+  PipelineManager &mgr = *ctx.pipelineManager;
+
+  VkPipeline pipeline = (desc.comp_shader.empty()) ? create_graphics_pipeline(ctx, desc)
+                                                   : create_compute_pipeline(ctx, desc);
+
+  {
+    std::lock_guard<std::mutex> lock(mgr.mutex);
+    PipelineManager::Entry &entry = mgr.pipelines[key];
+    entry.pipeline = pipeline;
+    entry.ready = true;
+  }
+  mgr.cv_ready.notify_all();
+
+  return pipeline;
+}
+
+// ----------------------------------------------------------------------------
+
+VkPipeline get_pipeline(VulkanContext &ctx, const PipelineDesc &desc) {
+  assert(ctx.pipelineManager != nullptr);
+  PipelineManager &mgr = *ctx.pipelineManager;
+
+  uint64_t key;
+
+  {
+    std::unique_lock<std::mutex> lock(mgr.mutex);
+
+    bool bFound;
+    key = find_pipeline_key(mgr, desc, bFound);
+    if (bFound) {
+      // wait for any concurrent compilation of the same state to finish
+      // rather than compiling it twice
+      mgr.cv_ready.wait(lock, [&mgr, key] { return mgr.pipelines[key].ready; });
+      ++mgr.stats.hits;
+      return mgr.pipelines[key].pipeline;
+    }
+
+    // reserve the entry while compiling
+    mgr.pipelines[key].desc = desc;
+    ++mgr.stats.compiles;
+  }
+
+  return compile_reserved_pipeline(ctx, desc, key);
+}
+
+// ----------------------------------------------------------------------------
+
+PipelineHandle request_pipeline_async(VulkanContext &ctx, const PipelineDesc &desc) {
+  assert(ctx.pipelineManager != nullptr);
+  PipelineManager &mgr = *ctx.pipelineManager;
+
+  uint64_t key;
+
+  {
+    std::lock_guard<std::mutex> lock(mgr.mutex);
+
+    // already compiled or being compiled
+    bool bFound;
+    key = find_pipeline_key(mgr, desc, bFound);
+    if (bFound) {
+      ++mgr.stats.hits;
+      return key;
+    }
+
+    mgr.pipelines[key].desc = desc;
+    ++mgr.stats.compiles;
+    ++mgr.stats.async_compiles;
+  }
+
+  // the description is copied, the caller's one may not outlive the job
+  thread_pool_submit(mgr.workers, [&ctx, desc, key] {
+    compile_reserved_pipeline(ctx, desc, key);
+  });
+
+  return key;
+}
+
+// ----------------------------------------------------------------------------
+
+VkPipeline resolve_pipeline(VulkanContext &ctx, PipelineHandle handle) {
+  assert(ctx.pipelineManager != nullptr);
+  PipelineManager &mgr = *ctx.pipelineManager;
+
+  std::lock_guard<std::mutex> lock(mgr.mutex);
+
+  auto it = mgr.pipelines.find(handle);
+  if ((it != mgr.pipelines.end()) && it->second.ready) {
+    return it->second.pipeline;
+  }
+  return VK_NULL_HANDLE;
+}
+
+// ----------------------------------------------------------------------------
+
+VkPipeline get_compute_pipeline(VulkanContext &ctx,
+                                const std::string &shader,
+                                VkPipelineLayout layout)
+{
+  /* Cached in the same table as the graphics pipelines */
+  PipelineDesc desc;
+  desc.comp_shader = shader;
+  desc.layout = layout;
+  return get_pipeline(ctx, desc);
+}
+
+// ============================================================================
@@ -0,0 +1,120 @@
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common.h"
+#include "thread_pool.h"
+
+/**
+* Full description of a pipeline, every field takes part in its hash.
+* Compute pipelines only set comp_shader and layout.
+*/
+struct PipelineDesc {
+  /* shader stages (SPIR-V binaries) */
+  std::string vert_shader;
+  std::string frag_shader;
+  std::string comp_shader;
+
+  /* vertex layout */
+  std::vector<VkVertexInputBindingDescription> bindings;
+  std::vector<VkVertexInputAttributeDescription> attributes;
+  VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+  /* rasterization */
+  VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+  VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+  VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+
+  /* depth */
+  VkBool32 depthTest = VK_TRUE;
+  VkBool32 depthWrite = VK_TRUE;
+  VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+  /* blend */
+  VkBool32 blendEnable = VK_FALSE;
+  VkBlendFactor srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+  VkBlendFactor dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+  VkBlendOp colorBlendOp = VK_BLEND_OP_ADD;
+  VkColorComponentFlags colorWriteMask =   VK_COLOR_COMPONENT_R_BIT
+                                         | VK_COLOR_COMPONENT_G_BIT
+                                         | VK_COLOR_COMPONENT_B_BIT
+                                         | VK_COLOR_COMPONENT_A_BIT;
+
+  /* layout and render pass compatibility */
+  VkPipelineLayout layout = VK_NULL_HANDLE;
+  VkRenderPass renderPass = VK_NULL_HANDLE;
+  uint32_t subpass = 0u;
+};
+
+/**
+* Cache of pipelines (and their shader modules) keyed by hashed descriptions.
+* The description of an entry is compared on lookups, a colliding one is
+* stored under the next free key.
+*/
+struct PipelineManager {
+  struct Entry {
+    PipelineDesc desc;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    bool ready = false;               // false while being compiled
+  };
+
+  std::mutex mutex;
+  std::condition_variable cv_ready;   // signaled when a compilation ends
+  std::unordered_map<uint64_t, Entry> pipelines;
+  std::unordered_map<std::string, VkShaderModule> shaders;
+
+  /* workers compiling the asynchronous requests, in parallel */
+  ThreadPool workers;
+
+  struct {
+    uint32_t hits = 0u;
+    uint32_t compiles = 0u;
+    uint32_t async_compiles = 0u;
+  } stats;
+};
+
+/* Create the pipeline cache and the manager with its workers */
+void init_pipeline_manager(VulkanContext &ctx);
+
+/* Destroy every cached pipelines, shader modules and the pipeline cache */
+void release_pipeline_manager(VulkanContext &ctx);
+
+/**/
+uint64_t hash_pipeline_desc(const PipelineDesc &desc);
+
+/* Return true when two descriptions create the same pipeline */
+bool equal_pipeline_desc(const PipelineDesc &a, const PipelineDesc &b);
+
+/* Load the shader modules used by desc ahead of its compilation (thread safe) */
+void load_shader_modules(VulkanContext &ctx, const PipelineDesc &desc);
+
+/* Return the pipeline matching desc, compiling it on first use (thread safe) */
+VkPipeline get_pipeline(VulkanContext &ctx, const PipelineDesc &desc);
+
+/**
+* Queue the compilation of desc on a worker and return immediately.
+* The returned handle is resolved with resolve_pipeline.
+*/
+PipelineHandle request_pipeline_async(VulkanContext &ctx, const PipelineDesc &desc);
+
+/**
+* Return the pipeline of a handle when its compilation is done, or
+* VK_NULL_HANDLE otherwise (the draws using it are skipped).
+*/
+VkPipeline resolve_pipeline(VulkanContext &ctx, PipelineHandle handle);
+
+/**
+* Return the compute pipeline of a shader and layout, created on first use
+* and destroyed with the manager (thread safe).
+*/
+VkPipeline get_compute_pipeline(VulkanContext &ctx,
+                                const std::string &shader,
+                                VkPipelineLayout layout);
+
+#endif  // PIPELINE_H_
@@ -0,0 +1,174 @@
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+
+#include "profiler.h"
+
+// ============================================================================
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const Clock::time_point sEpoch = Clock::now();
+
+std::atomic<bool> sEnabled(false);
+
+/* Fixed-size block of events, written by a single thread */
+struct EventChunk {
+  static const uint32_t kCapacity = 4096u;
+
+  ProfilerEvent events[kCapacity];
+  std::atomic<uint32_t> count;        // published events
+  std::atomic<EventChunk*> next;
+
+  EventChunk() : count(0u), next(nullptr) {}
+};
+
+/* Per-thread list of chunks, threads are linked together once registered */
+struct ThreadBuffer {
+  uint32_t tid = 0u;
+  EventChunk *head = nullptr;
+  EventChunk *tail = nullptr;
+  ThreadBuffer *next = nullptr;
+};
+
+std::atomic<ThreadBuffer*> sThreads(nullptr);
+std::atomic<uint32_t> sThreadCount(0u);
+
+/* Retrieve the calling thread's buffer, registering it on first use */
+ThreadBuffer& thread_buffer() {
+  // buffers are intentionally never freed, exported zones may come
+  // from threads that have already exited
+  static thread_local ThreadBuffer *tls_buffer = nullptr;
+
+  if (tls_buffer == nullptr) {
+    ThreadBuffer *buffer = new ThreadBuffer();
+    buffer->tid = sThreadCount.fetch_add(1u);
+    buffer->head = buffer->tail = new EventChunk();
+
+    // lock-free push on the list of threads
+    buffer->next = sThreads.load(std::memory_order_relaxed);
+    while (!sThreads.compare_exchange_weak(buffer->next, buffer,
+                                           std::memory_order_release,
+                                           std::memory_order_relaxed)) {}
+    tls_buffer = buffer;
+  }
+  return *tls_buffer;
+}
+
+/**/
+void record_event(const ProfilerEvent &event) {
+  ThreadBuffer &buffer = thread_buffer();
+  EventChunk *chunk = buffer.tail;
+
+  uint32_t index = chunk->count.load(std::memory_order_relaxed);
+  if (index == EventChunk::kCapacity) {
+    EventChunk *new_chunk = new EventChunk();
+    chunk->next.store(new_chunk, std::memory_order_release);
+    buffer.tail = chunk = new_chunk;
+    index = 0u;
+  }
+
+  chunk->events[index] = event;
+  chunk->count.store(index + 1u, std::memory_order_release);
+}
+
+/* Write a JSON string, names are C identifiers or literals */
+void write_json_string(FILE *fd, const char *str) {
+  fputc('"', fd);
+  for (; *str; ++str) {
+    if ((*str == '"') || (*str == '\\')) {
+      fputc('\\', fd);
+    }
+    fputc(*str, fd);
+  }
+  fputc('"', fd);
+}
+
+}  // namespace
+
+// ----------------------------------------------------------------------------
+
+ProfilerZone::ProfilerZone(const char *name)
+  : name_(sEnabled.load(std::memory_order_relaxed) ? name : nullptr),
+    start_us_(name_ ? profiler_now_us() : 0u)
+{}
+
+ProfilerZone::~ProfilerZone() {
+  if (name_ == nullptr) {
+    return;
+  }
+
+  ProfilerEvent event;
+  event.name = name_;
+  event.start_us = start_us_;
+  event.duration_us = profiler_now_us() - start_us_;
+  record_event(event);
+}
+
+// ----------------------------------------------------------------------------
+
+void profiler_set_enabled(bool enabled) {
+  sEnabled.store(enabled);
+}
+
+// ----------------------------------------------------------------------------
+
+bool profiler_is_enabled() {
+  return sEnabled.load();
+}
+
+// ----------------------------------------------------------------------------
+
+uint64_t profiler_now_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    Clock::now() - sEpoch
+  ).count();
+}
+
+// ----------------------------------------------------------------------------
+
+bool profiler_export_chrome_trace(const char *filename) {
+  FILE *fd = fopen(filename, "w");
+  if (!fd) {
+    fprintf(stderr, "Profiler error : cannot write trace \"%s\".\n", filename);
+    return false;
+  }
+
+  fprintf(fd, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+  bool first = true;
+  ThreadBuffer *buffer = sThreads.load(std::memory_order_acquire);
+  for (; buffer != nullptr; buffer = buffer->next) {
+    // thread name metadata
+    fprintf(fd, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                "\"args\":{\"name\":\"thread %u\"}}",
+            first ? "" : ",\n", buffer->tid, buffer->tid);
+    first = false;
+
+    // only read events published by their thread
+    EventChunk *chunk = buffer->head;
+    for (; chunk != nullptr; chunk = chunk->next.load(std::memory_order_acquire)) {
+      const uint32_t count = chunk->count.load(std::memory_order_acquire);
+      for (uint32_t i = 0u; i < count; ++i) {
+        const ProfilerEvent &e = chunk->events[i];
+        fprintf(fd, ",\n{\"name\":");
+        write_json_string(fd, e.name);
+        fprintf(fd, ",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                    "\"ts\":%llu,\"dur\":%llu}",
+                buffer->tid,
+                static_cast<unsigned long long>(e.start_us),
+                static_cast<unsigned long long>(e.duration_us));
+      }
+    }
+  }
+
+  fprintf(fd, "\n]}\n");
+  fclose(fd);
+
+  return true;
+}
+
+// ============================================================================
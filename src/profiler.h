@@ -0,0 +1,50 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <cstdint>
+
+/**
+* Lightweight CPU profiler.
+*
+* Scoped zones are appended to a buffer owned by the calling thread, without
+* any lock. Buffers are made of fixed-size chunks published atomically, so
+* they can be exported while other threads keep recording.
+* Zone names must outlive the profiler (string literals or __func__).
+*/
+
+#define PROFILER_CONCAT_(a, b)  a##b
+#define PROFILER_CONCAT(a, b)   PROFILER_CONCAT_(a, b)
+
+/* Profile the enclosing scope */
+#define PROFILE_ZONE(name)  ProfilerZone PROFILER_CONCAT(profiler_zone_, __LINE__)(name)
+#define PROFILE_FUNCTION()  PROFILE_ZONE(__func__)
+
+/* Recorded zone, timings are in microseconds since the profiler epoch */
+struct ProfilerEvent {
+  const char *name;
+  uint64_t start_us;
+  uint64_t duration_us;
+};
+
+/**/
+class ProfilerZone {
+ public:
+  explicit ProfilerZone(const char *name);
+  ~ProfilerZone();
+
+ private:
+  const char *name_;
+  uint64_t start_us_;
+};
+
+/* Zones are only recorded when enabled (disabled by default) */
+void profiler_set_enabled(bool enabled);
+bool profiler_is_enabled();
+
+/* Microseconds elapsed since the profiler epoch */
+uint64_t profiler_now_us();
+
+/* Write every recorded zone to filename in the Chrome trace_event format */
+bool profiler_export_chrome_trace(const char *filename);
+
+#endif  // PROFILER_H_
@@ -2,116 +2,216 @@
 #include <cstdio>
 #include <cstring>
 
+#include "capture.h"
+#include "deletion_queue.h"
+#include "draw_list.h"
+#include "frame_scheduler.h"
+#include "frame_timing.h"
+#include "occlusion.h"
+#include "pipeline.h"
+#include "profiler.h"
 #include "render.h"
+#include "scene.h"
 #include "setup.h"
+#include "staging.h"
 
 // ============================================================================
 
 static
 void update(VulkanContext &ctx) {
+  PROFILE_FUNCTION();
+
+  /* Only the subtrees changed since the last frame are recomputed */
+  propagate_scene_transforms(*ctx.sceneGraph, *ctx.entityStore);
+
   mat4x4 vp;
   mat4x4_mul(vp, ctx.scene.projection, ctx.scene.view);
-  
-  mat4x4 mvp;
-  mat4x4_mul(mvp, vp, ctx.scene.model);
-
 
-  VkResult err;  
-  void *pData;
-  err = vkMapMemory(ctx.device,
-                    ctx.uniformData.mem,
-                    0,
-                    ctx.uniformData.memAllocInfo.allocationSize,
-                    0,
-                    (void **)&pData
-  );
-  assert(!err);
+  /* The slices of the current frame slot are no longer read by the GPU */
+  const uint32_t slice = ctx.frameScheduler->slotIndex;
+
+  /* Cull, sort and fill the instances drawn by the frame */
+  build_draw_list(ctx, vp, slice);
+
+  /* The camera is only uploaded to the slices not holding it yet */
+  const uint32_t slice_bit = 1u << slice;
+  if (!(ctx.scene.cameraSlices & slice_bit)) {
+    return;
+  }
+  ctx.scene.cameraSlices &= ~slice_bit;
+
+  /* Push constants are recorded with the draw commands, no memory to update */
+  if (ctx.pushConstants.enabled) {
+    mat4x4_dup(ctx.pushConstants.viewProj, vp);
+    ++ctx.drawList->version;
+    return;
+  }
+
+  stage_buffer_upload(ctx,
+                      ctx.uniformData.buffer,
+                      slice * ctx.uniformData.sliceSize,
+                      &vp[0][0],
+                      sizeof(vp));
+}
 
-  memcpy(pData, (const void *)&mvp[0][0], sizeof(mvp));
+// ----------------------------------------------------------------------------
 
-  vkUnmapMemory(ctx.device, ctx.uniformData.mem);
+/**
+* Check the result of an acquisition or a presentation for a window. A
+* suboptimal swapchain is still presented. Swapchains are not recreated,
+* an out of date one ends the rendering.
+*/
+static
+bool check_swapchain_result(const VkResult result, const uint32_t window) {
+  if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+    fprintf(stderr, "Vulkan error : the swapchain of window %u is out of date.\n", window);
+    return false;
+  }
+  assert((result == VK_SUCCESS) || (result == VK_SUBOPTIMAL_KHR));
+  return true;
 }
 
 // ----------------------------------------------------------------------------
 
+/* Return false when a window can no longer be presented */
 static
-void draw(VulkanContext &ctx) {
+bool draw(VulkanContext &ctx, FrameSlot &slot) {
+  PROFILE_FUNCTION();
+
   VkResult err;
 
-  /* Create a semaphore for presentation */
-  VkSemaphoreCreateInfo sem_info;
-  sem_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-  sem_info.pNext = nullptr;
-  sem_info.flags = 0u;
-
-  VkSemaphore sem_presentComplete;
-  err = vkCreateSemaphore(ctx.device, &sem_info, nullptr, &sem_presentComplete);
-  assert(!err);
-
-  /**/
-  uint32_t buffer_id;
-  err = ctx.ext.fpAcquireNextImageKHR(
-    ctx.device, ctx.swapchain, UINT64_MAX, sem_presentComplete, VK_NULL_HANDLE, &buffer_id
-  );
-  assert(err != VK_ERROR_OUT_OF_DATE_KHR);
-  assert(!err);
-
-
-  //
-  set_buffer_image_layout(ctx,
-                          ctx.swapchainBuffers[buffer_id].image,
-                          VK_IMAGE_ASPECT_COLOR_BIT,
-                          VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-                          VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-  //
-  flush_init_cmd(ctx);
-
-  /**/
-  VkPipelineStageFlags dst_stage_flags[1u] = {
-    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT
-  };
-  
-  VkSubmitInfo submit_info;
-  memset(&submit_info, 0, sizeof(submit_info));
-  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submit_info.pNext = nullptr;
-  submit_info.waitSemaphoreCount = 1u;
-  submit_info.pWaitSemaphores = &sem_presentComplete;
-  submit_info.pWaitDstStageMask = dst_stage_flags;
-  submit_info.commandBufferCount = 1u;
-  submit_info.pCommandBuffers = &ctx.swapchainBuffers[buffer_id].cmd;
-  submit_info.signalSemaphoreCount = 0u;
-  submit_info.pSignalSemaphores = nullptr;
-
-  err = vkQueueSubmit(ctx.queue, 1u, &submit_info, VK_NULL_HANDLE);
-  assert(!err);
-
-  /**/
+  /* Pick up the pipeline once its asynchronous compilation is done */
+  ctx.pipeline = resolve_pipeline(ctx, ctx.pipelineHandle);
+
+  const uint32_t surface_count = static_cast<uint32_t>(ctx.surfaces.size());
+
+  for (uint32_t i = 0u; i < surface_count; ++i) {
+    SurfaceContext &surface = ctx.surfaces[i];
+
+    /**/
+    {
+      PROFILE_ZONE("acquire");
+      err = ctx.ext.fpAcquireNextImageKHR(
+        ctx.device, surface.swapchain, UINT64_MAX, slot.imageAcquired[i], VK_NULL_HANDLE,
+        &surface.imageIndex
+      );
+    }
+    // no image acquired, its semaphore is never signaled for the submission
+    if (!check_swapchain_result(err, i)) {
+      return false;
+    }
+
+    /* The image command buffer can be re-recorded or submitted again */
+    wait_swapchain_image(ctx, surface, surface.imageIndex);
+
+    /* Re-record the draw commands with new batches, camera, pipeline or slice */
+    const SwapchainBuffer &buffer = surface.swapchainBuffers[surface.imageIndex];
+    if ((buffer.drawVersion != ctx.drawList->version)
+     || (buffer.pipeline != ctx.pipeline)
+     || (buffer.uniformSlice != ctx.frameScheduler->slotIndex)) {
+      setup_buffer_draw_cmd(ctx, surface, surface.imageIndex);
+    }
+  }
+
+  /* Uploads of the frame are batched ahead of its draws */
+  VkCommandBuffer upload_cmd = record_staging_copies(ctx);
+
+  /* Captured frames are copied back once drawn, from the primary surface */
+  VkCommandBuffer readback_cmd = record_capture(ctx, ctx.surfaces.front());
+
+  /* The draws of every surface are submitted together */
+  const uint64_t value = submit_frame(ctx, upload_cmd, readback_cmd);
+  mark_frame_submit(ctx, value);
+  end_staging_frame(ctx, value);
+  end_capture_frame(ctx, value);
+  end_occlusion_frame(ctx, value);
+
+  /* Every surface is presented by a single call */
+  VkSwapchainKHR swapchains[kMaxWindows];
+  uint32_t image_indices[kMaxWindows];
+  uint64_t present_ids[kMaxWindows];
+  VkResult results[kMaxWindows];
+  for (uint32_t i = 0u; i < surface_count; ++i) {
+    swapchains[i] = ctx.surfaces[i].swapchain;
+    image_indices[i] = ctx.surfaces[i].imageIndex;
+    present_ids[i] = value;
+  }
+
   VkPresentInfoKHR present_info;
   memset(&present_info, 0, sizeof(present_info));
   present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
   present_info.pNext = nullptr;
-  present_info.swapchainCount = 1u;
-  present_info.pSwapchains = &ctx.swapchain;
-  present_info.pImageIndices = &buffer_id;
+  present_info.waitSemaphoreCount = 1u;
+  present_info.pWaitSemaphores = &slot.renderComplete;
+  present_info.swapchainCount = surface_count;
+  present_info.pSwapchains = swapchains;
+  present_info.pImageIndices = image_indices;
+  present_info.pResults = results;
+
+#ifdef VK_KHR_present_wait
+  /* The frame value identifies the present, to wait for it */
+  VkPresentIdKHR present_id;
+  present_id.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+  present_id.pNext = nullptr;
+  present_id.swapchainCount = surface_count;
+  present_id.pPresentIds = present_ids;
+  if (ctx.caps.presentWait) {
+    present_info.pNext = &present_id;
+  }
+#else
+  (void)present_ids;
+#endif
+
+  {
+    PROFILE_ZONE("present");
+    err = ctx.ext.fpQueuePresentKHR(ctx.queue, &present_info);
+    (void)err;    // the worst of the results
+  }
+
+  /* The other windows are still presented when one is out of date */
+  bool bPresentable = true;
+  for (uint32_t i = 0u; i < surface_count; ++i) {
+    bPresentable &= check_swapchain_result(results[i], i);
+  }
+
+  mark_frame_present(ctx);
+
+  return bPresentable;
+}
 
-  err = ctx.ext.fpQueuePresentKHR(ctx.queue, &present_info);
-  assert(!err);
+// ----------------------------------------------------------------------------
+
+void begin_render_frame(VulkanContext &ctx) {
+  PROFILE_FUNCTION();
+
+  /* Wait for the GPU to release the frame slot, not for the whole device */
+  begin_frame(ctx);
 
-  /**/
-  err = vkQueueWaitIdle(ctx.queue);
-  assert(!err);
+  /* GPU time of the slot's last frame, and latency of the frames presented */
+  collect_frame_timings(ctx);
 
-  vkDestroySemaphore(ctx.device, sem_presentComplete, nullptr);
+  wait_late_latch(ctx);
 }
 
 // ----------------------------------------------------------------------------
 
-void render_frame(VulkanContext &ctx) {
-  vkDeviceWaitIdle(ctx.device);
-  
-  update(ctx);  
-  draw(ctx);
+bool render_frame(VulkanContext &ctx) {
+  PROFILE_FUNCTION();
+
+  FrameScheduler &fs = *ctx.frameScheduler;
+  FrameSlot &slot = fs.slots[fs.slotIndex];
+
+  /* Free the resources retired by the frames completed since (and write their readbacks) */
+  collect_deletions(ctx);
+
+  update(ctx);
+  mark_frame_update(ctx);
+
+  const bool bPresentable = draw(ctx, slot);
+
+  end_frame(ctx);
+
+  return bPresentable;
 }
 
 // ============================================================================
@@ -3,6 +3,17 @@
 
 #include "common.h"
 
-void render_frame(VulkanContext &ctx);
+/**
+* Wait for a frame slot, then with the late latch, for the latest point
+* the frame inputs can be sampled.
+*/
+void begin_render_frame(VulkanContext &ctx);
+
+/**
+* Update and draw the frame, once its inputs are sampled.
+* @return false once the swapchain of a window is out of date, as
+* swapchains are not recreated.
+*/
+bool render_frame(VulkanContext &ctx);
 
 #endif  // RENDER_H_
\ No newline at end of file
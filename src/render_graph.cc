@@ -0,0 +1,801 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include "vulkan/vulkan.h"
+#include "profiler.h"
+#include "render_graph.h"
+#include "setup.h"
+
+// ============================================================================
+
+static
+VkImageLayout access_layout(const RGAccessType type) {
+  switch (type) {
+    case RG_ACCESS_COLOR:
+    case RG_ACCESS_RESOLVE:
+      return VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    case RG_ACCESS_DEPTH:
+      return VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    case RG_ACCESS_SAMPLED:
+    default:
+      return VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+static
+VkPipelineStageFlags access_stages(const RGAccessType type) {
+  switch (type) {
+    case RG_ACCESS_COLOR:
+    case RG_ACCESS_RESOLVE:
+      return VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+
+    case RG_ACCESS_DEPTH:
+      return VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT
+           | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+
+    case RG_ACCESS_SAMPLED:
+    default:
+      return VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+/* Memory accesses of a use, made visible by a dependency */
+static
+VkAccessFlags access_mask(const RGAccessType type) {
+  switch (type) {
+    case RG_ACCESS_COLOR:
+      return VK_ACCESS_COLOR_ATTACHMENT_READ_BIT
+           | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    case RG_ACCESS_RESOLVE:
+      return VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    case RG_ACCESS_DEPTH:
+      return VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT
+           | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    case RG_ACCESS_SAMPLED:
+    default:
+      return VK_ACCESS_SHADER_READ_BIT;
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+/* Memory writes of a use, made available by a dependency */
+static
+VkAccessFlags write_mask(const RGAccessType type) {
+  switch (type) {
+    case RG_ACCESS_COLOR:
+    case RG_ACCESS_RESOLVE:
+      return VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    case RG_ACCESS_DEPTH:
+      return VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    case RG_ACCESS_SAMPLED:
+    default:
+      return 0u;
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+static
+VkImageUsageFlags access_usage(const RGAccessType type) {
+  switch (type) {
+    case RG_ACCESS_COLOR:
+    case RG_ACCESS_RESOLVE:
+      return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+    case RG_ACCESS_DEPTH:
+      return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+
+    case RG_ACCESS_SAMPLED:
+    default:
+      return VK_IMAGE_USAGE_SAMPLED_BIT;
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+/* Return true when a use reads the content left by the previous one */
+static
+bool access_loads(const RenderGraph::Access &access) {
+  return (access.type == RG_ACCESS_SAMPLED)
+      || ((access.type != RG_ACCESS_RESOLVE) && !access.bClear);
+}
+
+// ----------------------------------------------------------------------------
+
+static
+const RenderGraph::Access* find_access(const RenderGraph::Pass &pass,
+                                       const RGResourceId resource)
+{
+  for (const auto &access : pass.accesses) {
+    if (access.resource == resource) {
+      return &access;
+    }
+  }
+  return nullptr;
+}
+
+// ----------------------------------------------------------------------------
+
+/* Use of a resource by the closest alive pass before pass_id, or nullptr */
+static
+const RenderGraph::Access* previous_access(const RenderGraph &graph,
+                                           const uint32_t pass_id,
+                                           const RGResourceId resource)
+{
+  for (uint32_t i = pass_id; i-- > 0u;) {
+    const RenderGraph::Pass &pass = graph.passes[i];
+    const RenderGraph::Access *access = (pass.bCulled) ? nullptr
+                                                       : find_access(pass, resource);
+    if (access) {
+      return access;
+    }
+  }
+  return nullptr;
+}
+
+// ----------------------------------------------------------------------------
+
+/* Use of a resource by the closest alive pass after pass_id, or nullptr */
+static
+const RenderGraph::Access* next_access(const RenderGraph &graph,
+                                       const uint32_t pass_id,
+                                       const RGResourceId resource)
+{
+  for (uint32_t i = pass_id + 1u; i < graph.passes.size(); ++i) {
+    const RenderGraph::Pass &pass = graph.passes[i];
+    const RenderGraph::Access *access = (pass.bCulled) ? nullptr
+                                                       : find_access(pass, resource);
+    if (access) {
+      return access;
+    }
+  }
+  return nullptr;
+}
+
+// ----------------------------------------------------------------------------
+
+static
+void add_access(RenderGraph &graph,
+                const RGPassId pass,
+                const RGResourceId resource,
+                const RGAccessType type,
+                const VkClearValue *clear)
+{
+  assert(!graph.bCompiled);
+  assert(pass < graph.passes.size());
+  assert(resource < graph.resources.size());
+
+  // a pass uses a resource only once
+  assert(find_access(graph.passes[pass], resource) == nullptr);
+
+  RenderGraph::Access access;
+  memset(&access, 0, sizeof(access));
+  access.resource = resource;
+  access.type = type;
+  access.bClear = (clear != nullptr);
+  if (clear) {
+    access.clear = *clear;
+  }
+
+  graph.passes[pass].accesses.push_back(access);
+}
+
+// ----------------------------------------------------------------------------
+
+static
+VkImageAspectFlags format_aspect(const VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_D16_UNORM:
+    case VK_FORMAT_D32_SFLOAT:
+      return VK_IMAGE_ASPECT_DEPTH_BIT;
+
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+      return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+
+    default:
+      return VK_IMAGE_ASPECT_COLOR_BIT;
+  }
+}
+
+// ============================================================================
+
+RGResourceId create_graph_image(RenderGraph &graph,
+                                const char *name,
+                                const VkFormat format,
+                                const VkSampleCountFlagBits samples)
+{
+  assert(!graph.bCompiled);
+
+  RenderGraph::Resource resource;
+  resource.name = name;
+  resource.format = format;
+  resource.samples = samples;
+  resource.aspect = format_aspect(format);
+
+  graph.resources.push_back(resource);
+  return static_cast<RGResourceId>(graph.resources.size() - 1u);
+}
+
+// ----------------------------------------------------------------------------
+
+RGResourceId import_graph_image(RenderGraph &graph,
+                                const char *name,
+                                const VkFormat format,
+                                const std::vector<VkImage> &images,
+                                const std::vector<VkImageView> &views,
+                                const VkImageLayout final_layout)
+{
+  assert(!images.empty() && (images.size() == views.size()));
+
+  const RGResourceId id = create_graph_image(graph, name, format, VK_SAMPLE_COUNT_1_BIT);
+
+  RenderGraph::Resource &resource = graph.resources[id];
+  resource.bImported = true;
+  resource.images = images;
+  resource.views = views;
+  resource.finalLayout = final_layout;
+
+  return id;
+}
+
+// ----------------------------------------------------------------------------
+
+RGPassId add_graph_pass(RenderGraph &graph, const char *name, RGRecordFn record) {
+  assert(!graph.bCompiled);
+
+  RenderGraph::Pass pass;
+  pass.name = name;
+  pass.record = record;
+
+  graph.passes.push_back(pass);
+  return static_cast<RGPassId>(graph.passes.size() - 1u);
+}
+
+// ----------------------------------------------------------------------------
+
+void pass_write_color(RenderGraph &graph,
+                      const RGPassId pass,
+                      const RGResourceId resource,
+                      const VkClearColorValue *clear,
+                      const RGResourceId resolve)
+{
+  VkClearValue value;
+  if (clear) {
+    value.color = *clear;
+  }
+  add_access(graph, pass, resource, RG_ACCESS_COLOR, (clear) ? &value : nullptr);
+
+  // the resolve follows its color attachment
+  if (resolve != kRGNone) {
+    assert(graph.resources[resource].samples != VK_SAMPLE_COUNT_1_BIT);
+    add_access(graph, pass, resolve, RG_ACCESS_RESOLVE, nullptr);
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+void pass_write_depth(RenderGraph &graph,
+                      const RGPassId pass,
+                      const RGResourceId resource,
+                      const VkClearDepthStencilValue *clear)
+{
+  VkClearValue value;
+  if (clear) {
+    value.depthStencil = *clear;
+  }
+  add_access(graph, pass, resource, RG_ACCESS_DEPTH, (clear) ? &value : nullptr);
+}
+
+// ----------------------------------------------------------------------------
+
+void pass_read_texture(RenderGraph &graph,
+                       const RGPassId pass,
+                       const RGResourceId resource)
+{
+  assert(!graph.resources[resource].bImported);
+  add_access(graph, pass, resource, RG_ACCESS_SAMPLED, nullptr);
+}
+
+// ============================================================================
+
+/**
+* Keep the passes writing an imported image, then walking backward, those
+* writing a content read by an alive pass.
+* @return the number of passes culled.
+*/
+static
+uint32_t cull_passes(RenderGraph &graph) {
+  std::vector<bool> needed(graph.resources.size(), false);
+  uint32_t culled = 0u;
+
+  for (uint32_t i = graph.passes.size(); i-- > 0u;) {
+    RenderGraph::Pass &pass = graph.passes[i];
+
+    bool bAlive = false;
+    for (const auto &access : pass.accesses) {
+      bAlive |= (access.type != RG_ACCESS_SAMPLED)
+             && (graph.resources[access.resource].bImported || needed[access.resource]);
+    }
+
+    pass.bCulled = !bAlive;
+    if (!bAlive) {
+      ++culled;
+      continue;
+    }
+
+    // content overwritten by the pass is not needed from the previous ones
+    for (const auto &access : pass.accesses) {
+      if ((access.type != RG_ACCESS_SAMPLED) && !access_loads(access)) {
+        needed[access.resource] = false;
+      }
+    }
+    for (const auto &access : pass.accesses) {
+      if (access_loads(access)) {
+        needed[access.resource] = true;
+      }
+    }
+  }
+
+  return culled;
+}
+
+// ----------------------------------------------------------------------------
+
+/* Derive the lifetime and usage of the resources from the alive passes */
+static
+void compute_lifetimes(RenderGraph &graph) {
+  for (auto &resource : graph.resources) {
+    resource.usage = 0u;
+    resource.firstUse = kRGNone;
+    resource.lastUse = kRGNone;
+    resource.physical = kRGNone;
+  }
+
+  for (uint32_t i = 0u; i < graph.passes.size(); ++i) {
+    const RenderGraph::Pass &pass = graph.passes[i];
+    if (pass.bCulled) {
+      continue;
+    }
+
+    for (const auto &access : pass.accesses) {
+      RenderGraph::Resource &resource = graph.resources[access.resource];
+      resource.usage |= access_usage(access.type);
+      resource.firstUse = std::min(resource.firstUse, i);
+      resource.lastUse = (resource.lastUse == kRGNone) ? i : std::max(resource.lastUse, i);
+    }
+  }
+
+  /* Images only used as attachment within passes can stay on-chip */
+  for (auto &resource : graph.resources) {
+    if (!resource.bImported
+     && (resource.usage != 0u)
+     && !(resource.usage & VK_IMAGE_USAGE_SAMPLED_BIT)) {
+      resource.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+* Assign a backing image to each transient resource, reusing an image
+* whose resources are no longer used when the description matches.
+*/
+static
+void alias_images(RenderGraph &graph) {
+  std::vector<RGResourceId> order;
+  for (RGResourceId id = 0u; id < graph.resources.size(); ++id) {
+    const RenderGraph::Resource &resource = graph.resources[id];
+    if (!resource.bImported && (resource.firstUse != kRGNone)) {
+      order.push_back(id);
+    }
+  }
+
+  std::sort(order.begin(), order.end(), [&graph](RGResourceId a, RGResourceId b) {
+    return graph.resources[a].firstUse < graph.resources[b].firstUse;
+  });
+
+  for (const auto &id : order) {
+    RenderGraph::Resource &resource = graph.resources[id];
+
+    for (uint32_t i = 0u; i < graph.images.size(); ++i) {
+      RenderGraph::PhysicalImage &image = graph.images[i];
+      if ((image.format == resource.format)
+       && (image.samples == resource.samples)
+       && (image.usage == resource.usage)
+       && (image.lastUse < resource.firstUse)) {
+        image.lastUse = resource.lastUse;
+        resource.physical = i;
+        break;
+      }
+    }
+
+    if (resource.physical == kRGNone) {
+      RenderGraph::PhysicalImage image;
+      image.format = resource.format;
+      image.samples = resource.samples;
+      image.usage = resource.usage;
+      image.aspect = resource.aspect;
+      image.lastUse = resource.lastUse;
+
+      resource.physical = static_cast<uint32_t>(graph.images.size());
+      graph.images.push_back(image);
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+uint32_t plan_render_graph(RenderGraph &graph) {
+  const uint32_t culled = cull_passes(graph);
+  compute_lifetimes(graph);
+  alias_images(graph);
+  return culled;
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+* Create a backing image. Transient attachments memory is lazily allocated
+* when the device supports it, which keeps it on-chip on tiled GPUs.
+*/
+static
+void create_physical_image(VulkanContext &ctx,
+                           const RenderGraph &graph,
+                           RenderGraph::PhysicalImage &image)
+{
+  VkResult err;
+
+  VkImageCreateInfo imageInfo;
+  memset(&imageInfo, 0, sizeof(imageInfo));
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.format = image.format;
+  imageInfo.extent = { graph.width, graph.height, 1u };
+  imageInfo.mipLevels = 1u;
+  imageInfo.arrayLayers = 1u;
+  imageInfo.samples = image.samples;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.usage = image.usage;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+  err = vkCreateImage(ctx.device, &imageInfo, nullptr, &image.image);
+  assert(!err);
+
+  VkMemoryRequirements memReqs;
+  vkGetImageMemoryRequirements(ctx.device, image.image, &memReqs);
+
+  VkMemoryAllocateInfo allocInfo;
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.pNext = nullptr;
+  allocInfo.allocationSize = memReqs.size;
+  allocInfo.memoryTypeIndex = 0u;
+
+  const bool bLazy = (image.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT)
+                  && retrieve_memory_type_index(
+                       ctx.properties.memory,
+                       memReqs.memoryTypeBits,
+                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT,
+                       &allocInfo.memoryTypeIndex
+                     );
+  if (!bLazy) {
+    bool res = retrieve_memory_type_index(
+      ctx.properties.memory,
+      memReqs.memoryTypeBits,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      &allocInfo.memoryTypeIndex
+    );
+    assert(res);
+  }
+
+  err = vkAllocateMemory(ctx.device, &allocInfo, nullptr, &image.mem);
+  assert(!err);
+
+  err = vkBindImageMemory(ctx.device, image.image, image.mem, 0u);
+  assert(!err);
+
+  VkImageViewCreateInfo viewInfo;
+  memset(&viewInfo, 0, sizeof(viewInfo));
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = image.image;
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format = image.format;
+  viewInfo.subresourceRange = {image.aspect, 0u, 1u, 0u, 1u};
+
+  err = vkCreateImageView(ctx.device, &viewInfo, nullptr, &image.view);
+  assert(!err);
+}
+
+// ----------------------------------------------------------------------------
+
+/* Create the render pass of an alive pass, and its framebuffers */
+static
+void create_pass_objects(VulkanContext &ctx,
+                         RenderGraph &graph,
+                         const uint32_t pass_id)
+{
+  RenderGraph::Pass &pass = graph.passes[pass_id];
+
+  std::vector<VkAttachmentDescription> descs;
+  std::vector<VkAttachmentReference> colors;
+  std::vector<VkAttachmentReference> resolves;
+  VkAttachmentReference depth = { VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED };
+  std::vector<RGResourceId> attachments;
+  bool bResolve = false;
+
+  /* External dependencies, before and after the pass */
+  VkSubpassDependency dependencies[2u];
+  memset(dependencies, 0, sizeof(dependencies));
+  dependencies[0u].srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[0u].dstSubpass = 0u;
+  dependencies[1u].srcSubpass = 0u;
+  dependencies[1u].dstSubpass = VK_SUBPASS_EXTERNAL;
+
+  pass.clearValues.clear();
+
+  for (const auto &access : pass.accesses) {
+    const RenderGraph::Resource &resource = graph.resources[access.resource];
+    const RenderGraph::Access *prev = previous_access(graph, pass_id, access.resource);
+    const RenderGraph::Access *next = next_access(graph, pass_id, access.resource);
+
+    /**
+    * Wait for the previous use in the frame, or for the uses of the image
+    * by the previous frame (and by aliased resources).
+    */
+    VkSubpassDependency &before = dependencies[0u];
+    if (prev) {
+      before.srcStageMask |= access_stages(prev->type);
+      before.srcAccessMask |= write_mask(prev->type);
+    } else if (resource.usage & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT) {
+      before.srcStageMask |= access_stages(RG_ACCESS_COLOR);
+      before.srcAccessMask |= write_mask(RG_ACCESS_COLOR);
+    } else if (resource.usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+      before.srcStageMask |= access_stages(RG_ACCESS_DEPTH);
+      before.srcAccessMask |= write_mask(RG_ACCESS_DEPTH);
+    }
+    if (resource.usage & VK_IMAGE_USAGE_SAMPLED_BIT) {
+      before.srcStageMask |= access_stages(RG_ACCESS_SAMPLED);
+    }
+    before.dstStageMask |= access_stages(access.type);
+    before.dstAccessMask |= access_mask(access.type);
+
+    if (access.type == RG_ACCESS_SAMPLED) {
+      continue;
+    }
+
+    /* Make the writes visible to the next sampling pass or the presentation */
+    VkSubpassDependency &after = dependencies[1u];
+    if ((next && (next->type == RG_ACCESS_SAMPLED)) || (!next && resource.bImported)) {
+      after.srcStageMask |= access_stages(access.type);
+      after.srcAccessMask |= write_mask(access.type);
+      after.dstStageMask |= (next) ? access_stages(next->type)
+                                   : VkPipelineStageFlags(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+      after.dstAccessMask |= (next) ? access_mask(next->type) : 0u;
+    }
+
+    /* Load / store ops and layouts from the previous and next uses */
+    const bool bLoad = prev && access_loads(access);
+    const bool bStore = (next) ? access_loads(*next) : resource.bImported;
+    const VkImageLayout layout = access_layout(access.type);
+
+    VkAttachmentDescription desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.format         = resource.format;
+    desc.samples        = resource.samples;
+    desc.loadOp         = (access.bClear) ? VK_ATTACHMENT_LOAD_OP_CLEAR
+                        : (bLoad)         ? VK_ATTACHMENT_LOAD_OP_LOAD
+                                          : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    desc.storeOp        = (bStore) ? VK_ATTACHMENT_STORE_OP_STORE
+                                   : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    desc.stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    desc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    if (resource.aspect & VK_IMAGE_ASPECT_STENCIL_BIT) {
+      desc.stencilLoadOp  = desc.loadOp;
+      desc.stencilStoreOp = desc.storeOp;
+    }
+    // discarded content does not need a layout transition
+    desc.initialLayout  = (bLoad) ? layout : VK_IMAGE_LAYOUT_UNDEFINED;
+    desc.finalLayout    = (next)               ? access_layout(next->type)
+                        : (resource.bImported) ? resource.finalLayout
+                                               : layout;
+
+    const VkAttachmentReference reference = {
+      static_cast<uint32_t>(descs.size()), layout
+    };
+
+    switch (access.type) {
+      case RG_ACCESS_COLOR:
+        colors.push_back(reference);
+        resolves.push_back({ VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED });
+      break;
+
+      case RG_ACCESS_RESOLVE:
+        resolves.back() = reference;
+        bResolve = true;
+      break;
+
+      case RG_ACCESS_DEPTH:
+        depth = reference;
+      break;
+
+      default:
+      break;
+    }
+
+    VkClearValue clear;
+    memset(&clear, 0, sizeof(clear));
+    pass.clearValues.push_back((access.bClear) ? access.clear : clear);
+
+    descs.push_back(desc);
+    attachments.push_back(access.resource);
+  }
+
+  /* Defines subpass */
+  VkSubpassDescription subpass;
+  memset(&subpass, 0, sizeof(subpass));
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = static_cast<uint32_t>(colors.size());
+  subpass.pColorAttachments = colors.data();
+  subpass.pResolveAttachments = (bResolve) ? resolves.data() : nullptr;
+  subpass.pDepthStencilAttachment = (depth.attachment != VK_ATTACHMENT_UNUSED) ? &depth
+                                                                              : nullptr;
+
+  /* Create the render pass */
+  VkRenderPassCreateInfo info;
+  info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  info.pNext = nullptr;
+  info.flags = 0u;
+  info.attachmentCount = static_cast<uint32_t>(descs.size());
+  info.pAttachments = descs.data();
+  info.subpassCount = 1u;
+  info.pSubpasses = &subpass;
+  info.dependencyCount = (dependencies[1u].dstStageMask != 0u) ? 2u : 1u;
+  info.pDependencies = dependencies;
+
+  VkResult err;
+  err = vkCreateRenderPass(ctx.device, &info, nullptr, &pass.renderPass);
+  assert(!err);
+
+  /* One framebuffer per variant of the imported attachments */
+  uint32_t numVariants = 1u;
+  for (const auto &id : attachments) {
+    numVariants = std::max(numVariants, uint32_t(graph.resources[id].views.size()));
+  }
+
+  std::vector<VkImageView> views(attachments.size());
+
+  VkFramebufferCreateInfo fbInfo;
+  fbInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+  fbInfo.pNext = nullptr;
+  fbInfo.flags = 0;
+  fbInfo.renderPass = pass.renderPass;
+  fbInfo.attachmentCount = static_cast<uint32_t>(views.size());
+  fbInfo.pAttachments = views.data();
+  fbInfo.width = graph.width;
+  fbInfo.height = graph.height;
+  fbInfo.layers = 1u;
+
+  pass.framebuffers.resize(numVariants);
+
+  for (uint32_t v = 0u; v < numVariants; ++v) {
+    for (uint32_t i = 0u; i < attachments.size(); ++i) {
+      const RenderGraph::Resource &resource = graph.resources[attachments[i]];
+      views[i] = (resource.bImported) ? resource.views[v % resource.views.size()]
+                                      : graph.images[resource.physical].view;
+    }
+    err = vkCreateFramebuffer(ctx.device, &fbInfo, nullptr, &pass.framebuffers[v]);
+    assert(!err);
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+void compile_render_graph(VulkanContext &ctx,
+                          RenderGraph &graph,
+                          const uint32_t width,
+                          const uint32_t height)
+{
+  PROFILE_FUNCTION();
+
+  assert(!graph.bCompiled);
+
+  graph.width = width;
+  graph.height = height;
+
+  const uint32_t culled = plan_render_graph(graph);
+
+  for (auto &image : graph.images) {
+    create_physical_image(ctx, graph, image);
+  }
+
+  for (uint32_t i = 0u; i < graph.passes.size(); ++i) {
+    if (!graph.passes[i].bCulled) {
+      create_pass_objects(ctx, graph, i);
+    }
+  }
+
+  if (ctx.app.options.renderGraphReport) {
+    uint32_t transients = 0u;
+    for (const auto &resource : graph.resources) {
+      transients += (resource.physical != kRGNone) ? 1u : 0u;
+    }
+
+    fprintf(stdout, "render graph : %u pass(es), %u culled, %u image(s) for %u transient(s)\n",
+            uint32_t(graph.passes.size()), culled, uint32_t(graph.images.size()), transients);
+  }
+
+  graph.bCompiled = true;
+}
+
+// ----------------------------------------------------------------------------
+
+void execute_render_graph(const RenderGraph &graph,
+                          VkCommandBuffer cmd,
+                          const uint32_t variant)
+{
+  assert(graph.bCompiled);
+
+  for (const auto &pass : graph.passes) {
+    if (pass.bCulled) {
+      continue;
+    }
+
+    VkRenderPassBeginInfo info;
+    info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    info.pNext = nullptr;
+    info.renderPass = pass.renderPass;
+    info.framebuffer = pass.framebuffers[variant % pass.framebuffers.size()];
+    info.renderArea.offset.x = 0;
+    info.renderArea.offset.y = 0;
+    info.renderArea.extent.width = graph.width;
+    info.renderArea.extent.height = graph.height;
+    info.clearValueCount = static_cast<uint32_t>(pass.clearValues.size());
+    info.pClearValues = pass.clearValues.data();
+
+    vkCmdBeginRenderPass(cmd, &info, VK_SUBPASS_CONTENTS_INLINE);
+    if (pass.record) {
+      pass.record(cmd);
+    }
+    vkCmdEndRenderPass(cmd);
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+void release_render_graph(VulkanContext &ctx, RenderGraph &graph) {
+  for (auto &pass : graph.passes) {
+    for (auto &framebuffer : pass.framebuffers) {
+      vkDestroyFramebuffer(ctx.device, framebuffer, nullptr);
+    }
+    pass.framebuffers.clear();
+
+    vkDestroyRenderPass(ctx.device, pass.renderPass, nullptr);
+    pass.renderPass = VK_NULL_HANDLE;
+  }
+
+  for (auto &image : graph.images) {
+    vkDestroyImageView(ctx.device, image.view, nullptr);
+    vkDestroyImage(ctx.device, image.image, nullptr);
+    vkFreeMemory(ctx.device, image.mem, nullptr);
+  }
+  graph.images.clear();
+
+  graph.bCompiled = false;
+}
+
+// ============================================================================
@@ -0,0 +1,163 @@
+#ifndef RENDER_GRAPH_H_
+#define RENDER_GRAPH_H_
+
+#include <functional>
+#include <vector>
+
+#include "common.h"
+
+typedef uint32_t RGResourceId;
+typedef uint32_t RGPassId;
+
+const uint32_t kRGNone = UINT32_MAX;
+
+/* Record the draws of a pass, within its render pass */
+typedef std::function<void(VkCommandBuffer cmd)> RGRecordFn;
+
+/* How a pass uses a resource */
+enum RGAccessType {
+  RG_ACCESS_COLOR,      // color attachment
+  RG_ACCESS_RESOLVE,    // resolve attachment of a multisampled color
+  RG_ACCESS_DEPTH,      // depth-stencil attachment
+  RG_ACCESS_SAMPLED,    // sampled by fragment shaders
+};
+
+/**
+* Frame described as passes declaring the images they write and read.
+* Once compiled, the graph has :
+*  - culled the passes not contributing to an imported image,
+*  - derived the load / store ops and layouts of each attachment from its
+*    previous and next uses,
+*  - created one render pass per pass, synchronized by its external subpass
+*    dependencies instead of hand placed barriers,
+*  - backed the transient images by lazily allocated memory, images with
+*    disjoint lifetimes and the same description sharing the same memory.
+* Imported images (the swapchain) have one variant per image, selected when
+* executing the graph.
+*/
+struct RenderGraph {
+  struct Resource {
+    const char *name;
+    VkFormat format;
+    VkSampleCountFlagBits samples;
+    VkImageAspectFlags aspect;
+
+    /* imported images, not owned by the graph */
+    bool bImported = false;
+    std::vector<VkImage> images;
+    std::vector<VkImageView> views;
+    VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    /* derived at compilation */
+    VkImageUsageFlags usage = 0u;
+    uint32_t firstUse = kRGNone;    // first and last alive pass using it
+    uint32_t lastUse = kRGNone;
+    uint32_t physical = kRGNone;    // backing image of a transient resource
+  };
+
+  struct Access {
+    RGResourceId resource;
+    RGAccessType type;
+    bool bClear;
+    VkClearValue clear;
+  };
+
+  struct Pass {
+    const char *name;
+    RGRecordFn record;
+    std::vector<Access> accesses;
+
+    /* derived at compilation */
+    bool bCulled = false;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    std::vector<VkFramebuffer> framebuffers;  // one per imported variant
+    std::vector<VkClearValue> clearValues;    // by attachment index
+  };
+
+  /* Image backing one or more transient resources */
+  struct PhysicalImage {
+    VkFormat format;
+    VkSampleCountFlagBits samples;
+    VkImageUsageFlags usage;
+    VkImageAspectFlags aspect;
+    uint32_t lastUse;
+    VkImage image = VK_NULL_HANDLE;
+    VkDeviceMemory mem = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+  };
+
+  std::vector<Resource> resources;
+  std::vector<Pass> passes;
+  std::vector<PhysicalImage> images;
+
+  uint32_t width = 0u;
+  uint32_t height = 0u;
+  bool bCompiled = false;
+};
+
+/* Add an image owned by the graph, living for the frame */
+RGResourceId create_graph_image(RenderGraph &graph,
+                                const char *name,
+                                const VkFormat format,
+                                const VkSampleCountFlagBits samples);
+
+/**
+* Add external images, one per variant, left in final_layout at the end of
+* the graph (eg. VK_IMAGE_LAYOUT_PRESENT_SRC_KHR for the swapchain).
+*/
+RGResourceId import_graph_image(RenderGraph &graph,
+                                const char *name,
+                                const VkFormat format,
+                                const std::vector<VkImage> &images,
+                                const std::vector<VkImageView> &views,
+                                const VkImageLayout final_layout);
+
+/* Add a pass, executed in order of addition */
+RGPassId add_graph_pass(RenderGraph &graph, const char *name, RGRecordFn record);
+
+/**
+* Declare a color attachment of a pass, cleared when clear is not null or
+* loaded otherwise, and optionally resolved into another image.
+*/
+void pass_write_color(RenderGraph &graph,
+                      const RGPassId pass,
+                      const RGResourceId resource,
+                      const VkClearColorValue *clear = nullptr,
+                      const RGResourceId resolve = kRGNone);
+
+/* Declare the depth-stencil attachment of a pass */
+void pass_write_depth(RenderGraph &graph,
+                      const RGPassId pass,
+                      const RGResourceId resource,
+                      const VkClearDepthStencilValue *clear = nullptr);
+
+/* Declare an image sampled by the fragment shaders of a pass */
+void pass_read_texture(RenderGraph &graph,
+                       const RGPassId pass,
+                       const RGResourceId resource);
+
+/**
+* Cull the passes, derive the lifetimes of the resources and assign their
+* backing images, without creating any object (done by the compilation).
+* @return the number of passes culled.
+*/
+uint32_t plan_render_graph(RenderGraph &graph);
+
+/**
+* Cull the passes, then create the images, render passes and framebuffers,
+* with the extent of the imported images.
+*/
+void compile_render_graph(VulkanContext &ctx,
+                          RenderGraph &graph,
+                          const uint32_t width,
+                          const uint32_t height);
+
+/* Record the alive passes, with the imported images of variant */
+void execute_render_graph(const RenderGraph &graph,
+                          VkCommandBuffer cmd,
+                          const uint32_t variant);
+
+/* Destroy the objects created by the compilation */
+void release_render_graph(VulkanContext &ctx, RenderGraph &graph);
+
+#endif  // RENDER_GRAPH_H_
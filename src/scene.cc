@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+
+#include "profiler.h"
+#include "scene.h"
+
+// ============================================================================
+
+void init_scene_graph(VulkanContext &ctx) {
+  assert(ctx.sceneGraph == nullptr);
+  ctx.sceneGraph = new SceneGraph();
+}
+
+// ----------------------------------------------------------------------------
+
+void release_scene_graph(VulkanContext &ctx) {
+  if (ctx.sceneGraph == nullptr) {
+    return;
+  }
+  const SceneGraph &graph = *ctx.sceneGraph;
+
+  if (graph.stats.frames > 0u) {
+    fprintf(stdout, "scene : %zu node(s), %.2f transform(s) recomputed and "
+                    "%.2f entity update(s) per frame\n",
+            graph.parents.size(),
+            graph.stats.propagated / double(graph.stats.frames),
+            graph.stats.entities / double(graph.stats.frames));
+  }
+
+  delete ctx.sceneGraph;
+  ctx.sceneGraph = nullptr;
+}
+
+// ----------------------------------------------------------------------------
+
+SceneNodeId add_scene_node(SceneGraph &graph,
+                           const SceneNodeId parent,
+                           const EntityId entity)
+{
+  const SceneNodeId node = static_cast<SceneNodeId>(graph.parents.size());
+  assert((parent == kSceneNone) || (parent < node));
+
+  Matrix identity;
+  mat4x4_identity(identity.m);
+
+  graph.parents.push_back(parent);
+  graph.locals.push_back(identity);
+  graph.worlds.push_back(identity);
+  graph.dirty.push_back(1u);
+  graph.entities.push_back(entity);
+
+  graph.firstDirty = std::min(graph.firstDirty, node);
+
+  return node;
+}
+
+// ----------------------------------------------------------------------------
+
+void set_scene_node_local(SceneGraph &graph,
+                          const SceneNodeId node,
+                          mat4x4 local)
+{
+  assert(node < graph.parents.size());
+
+  mat4x4_dup(graph.locals[node].m, local);
+  graph.dirty[node] = 1u;
+  graph.firstDirty = std::min(graph.firstDirty, node);
+}
+
+// ----------------------------------------------------------------------------
+
+uint32_t propagate_scene_transforms(SceneGraph &graph, EntityStore &store) {
+  ++graph.stats.frames;
+
+  if (graph.firstDirty == kSceneNone) {
+    return 0u;
+  }
+
+  PROFILE_FUNCTION();
+
+  /**
+  * Parents come first, so a node sees the final state of its parent : its
+  * dirty flag is inherited, and its world transform already up to date.
+  * Nodes before the first dirty one are left untouched.
+  */
+  const uint32_t count = static_cast<uint32_t>(graph.parents.size());
+  uint32_t propagated = 0u;
+
+  for (uint32_t i = graph.firstDirty; i < count; ++i) {
+    const SceneNodeId parent = graph.parents[i];
+
+    if (parent != kSceneNone) {
+      graph.dirty[i] |= graph.dirty[parent];
+    }
+    if (!graph.dirty[i]) {
+      continue;
+    }
+
+    if (parent != kSceneNone) {
+      mat4x4_mul(graph.worlds[i].m, graph.worlds[parent].m, graph.locals[i].m);
+    } else {
+      mat4x4_dup(graph.worlds[i].m, graph.locals[i].m);
+    }
+    ++propagated;
+
+    const EntityId entity = graph.entities[i];
+    if (entity != kNoEntity) {
+      set_entity_transform(store, entity, graph.worlds[i].m);
+      ++graph.stats.entities;
+    }
+  }
+
+  /* Flags are cleared once every child has inherited them */
+  std::fill(graph.dirty.begin() + graph.firstDirty, graph.dirty.end(), 0u);
+  graph.firstDirty = kSceneNone;
+
+  graph.stats.propagated += propagated;
+  return propagated;
+}
+
+// ============================================================================
@@ -0,0 +1,63 @@
+#ifndef SCENE_H_
+#define SCENE_H_
+
+#include <vector>
+
+#include "common.h"
+#include "entity.h"
+
+const SceneNodeId kSceneNone = UINT32_MAX;
+
+/**
+* Transform hierarchy stored flat, in parent-before-child order, so a single
+* forward pass over the arrays propagates the world transforms.
+*
+* Nodes whose local transform changed are flagged dirty, and only their
+* subtrees are recomputed, from the first dirty node on.
+* Nodes can drive the transform of an entity, which is written only when
+* their world transform changed.
+*/
+struct SceneGraph {
+  /* Nodes, as parallel arrays indexed by SceneNodeId */
+  std::vector<SceneNodeId> parents;     // always lower than the node id
+  std::vector<Matrix> locals;
+  std::vector<Matrix> worlds;
+  std::vector<uint8_t> dirty;
+  std::vector<EntityId> entities;       // entity driven, or kNoEntity
+
+  SceneNodeId firstDirty = kSceneNone;
+
+  struct {
+    uint32_t frames = 0u;
+    uint64_t propagated = 0u;   // world transforms recomputed
+    uint64_t entities = 0u;     // entity transforms written
+  } stats;
+};
+
+/**/
+void init_scene_graph(VulkanContext &ctx);
+
+/* Report the propagation statistics, and destroy the graph */
+void release_scene_graph(VulkanContext &ctx);
+
+/**
+* Add a node under parent (or a root with kSceneNone), with an identity
+* local transform, driving the transform of entity when given.
+*/
+SceneNodeId add_scene_node(SceneGraph &graph,
+                           const SceneNodeId parent,
+                           const EntityId entity = kNoEntity);
+
+/* Set the transform of a node relative to its parent, flagging it dirty */
+void set_scene_node_local(SceneGraph &graph,
+                          const SceneNodeId node,
+                          mat4x4 local);
+
+/**
+* Recompute the world transforms of the dirty subtrees, and write them to
+* the entities driven.
+* @return the number of nodes recomputed.
+*/
+uint32_t propagate_scene_transforms(SceneGraph &graph, EntityStore &store);
+
+#endif  // SCENE_H_
@@ -1,11 +1,26 @@
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstddef>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 
 #include "vulkan/vulkan.h"
+#include "capture.h"
+#include "deletion_queue.h"
+#include "draw_list.h"
+#include "frame_scheduler.h"
+#include "frame_timing.h"
+#include "mesh.h"
+#include "occlusion.h"
+#include "pipeline.h"
+#include "profiler.h"
+#include "render_graph.h"
 #include "setup.h"
+#include "staging.h"
+#include "task_graph.h"
+#include "texture.h"
 
 // ============================================================================
 
@@ -53,6 +68,8 @@ void setup_init_cmd_buffer(VulkanContext &ctx) {
 // ----------------------------------------------------------------------------
 
 void flush_init_cmd(VulkanContext &ctx) {
+  PROFILE_FUNCTION();
+
   VkResult err;
 
   if (ctx.initCmdBuffer == VK_NULL_HANDLE) {
@@ -168,14 +185,114 @@ bool retrieve_memory_type_index(const VkPhysicalDeviceMemoryProperties &props,
 // ----------------------------------------------------------------------------
 // ----------------------------------------------------------------------------
 
-void setup_swapchain_buffers(VulkanContext &ctx) {
+static
+void release_swapchain_buffers(VulkanContext &ctx,
+                               SwapchainBuffer *buffers,
+                               const uint32_t count) {
+  for (uint32_t i = 0u; i < count; ++i) {
+    vkFreeCommandBuffers(ctx.device, ctx.cmdPool, 1u, &buffers[i].cmd);
+    vkDestroyImageView(ctx.device, buffers[i].view, nullptr);
+  }
+  delete [] buffers;
+}
+
+// ----------------------------------------------------------------------------
+
+static
+const char* present_mode_name(const VkPresentModeKHR mode) {
+  switch (mode) {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+      return "immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+      return "mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR:
+      return "fifo";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+      return "fifo relaxed";
+    default:
+      return "unknown";
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+* Choose the present mode and frames in flight from the present policy.
+*  - low latency : MAILBOX (or IMMEDIATE) with the fewest images it can run
+*    on, and a single frame in flight so inputs are never queued,
+*  - power saving : FIFO, the only mode capped to the display rate,
+*  - benchmark : IMMEDIATE (or MAILBOX), uncapped, every frame in flight.
+* @return the swapchain image count.
+*/
+static
+uint32_t select_present_config(VulkanContext &ctx,
+                               SurfaceContext &surface,
+                               const VkSurfaceCapabilitiesKHR &capabilities,
+                               const VkPresentModeKHR *modes,
+                               const uint32_t mode_count)
+{
+  const PresentPolicy policy = ctx.app.options.presentPolicy;
+
+  bool bMailbox = false;
+  bool bImmediate = false;
+  for (uint32_t i = 0u; i < mode_count; ++i) {
+    bMailbox |= (modes[i] == VK_PRESENT_MODE_MAILBOX_KHR);
+    bImmediate |= (modes[i] == VK_PRESENT_MODE_IMMEDIATE_KHR);
+  }
+
+  // FIFO is always supported
+  VkPresentModeKHR mode = VK_PRESENT_MODE_FIFO_KHR;
+  uint32_t images = capabilities.minImageCount + 1u;
+  uint32_t framesInFlight = kMaxFramesInFlight;
+
+  switch (policy) {
+    case PRESENT_POLICY_LOW_LATENCY:
+      mode = (bMailbox)   ? VK_PRESENT_MODE_MAILBOX_KHR
+           : (bImmediate) ? VK_PRESENT_MODE_IMMEDIATE_KHR
+                          : VK_PRESENT_MODE_FIFO_KHR;
+      // mailbox needs a spare image to replace the queued one without blocking
+      images = (mode == VK_PRESENT_MODE_MAILBOX_KHR) ? 3u : 2u;
+      framesInFlight = 1u;
+    break;
+
+    case PRESENT_POLICY_POWER_SAVING:
+      mode = VK_PRESENT_MODE_FIFO_KHR;
+    break;
+
+    case PRESENT_POLICY_BENCHMARK:
+      mode = (bImmediate) ? VK_PRESENT_MODE_IMMEDIATE_KHR
+           : (bMailbox)   ? VK_PRESENT_MODE_MAILBOX_KHR
+                          : VK_PRESENT_MODE_FIFO_KHR;
+    break;
+  }
+
+  /* maxImageCount of 0 means no limit */
+  images = std::max(images, capabilities.minImageCount);
+  if (capabilities.maxImageCount > 0u) {
+    images = std::min(images, capabilities.maxImageCount);
+  }
+
+  surface.presentMode = mode;
+  ctx.present.framesInFlight = framesInFlight;
+
+  fprintf(stdout, "present : %s, %u image(s), %u frame(s) in flight\n",
+          present_mode_name(mode), images, framesInFlight);
+
+  return images;
+}
+
+// ----------------------------------------------------------------------------
+
+void setup_swapchain_buffers(VulkanContext &ctx, SurfaceContext &surface) {
+  PROFILE_FUNCTION();
+
   VkResult err;
 
   /* Set swapchains buffers resolutions, try to match with surface resolution */
   // retrieve surface capabilities
   VkSurfaceCapabilitiesKHR capabilities;
   err = 
-  ctx.ext.fpGetPhysicalDeviceSurfaceCapabilitiesKHR(ctx.gpu, ctx.surface, &capabilities);
+  ctx.ext.fpGetPhysicalDeviceSurfaceCapabilitiesKHR(ctx.gpu, surface.surface, &capabilities);
   assert(!err);
 
   VkExtent2D swapchain_extent;
@@ -185,63 +302,61 @@ void setup_swapchain_buffers(VulkanContext &ctx) {
     swapchain_extent.height = ctx.app.height;
   } else {
     swapchain_extent = capabilities.currentExtent;
-    ctx.app.width = capabilities.currentExtent.width;
-    ctx.app.height = capabilities.currentExtent.height;
   }
+  surface.width = swapchain_extent.width;
+  surface.height = swapchain_extent.height;
 
   /* Presentation mode allow the surface to be displayed on screen */
   // retrieve presentation modes of the surface
   uint32_t present_mode_count;
   err = ctx.ext.fpGetPhysicalDeviceSurfacePresentModesKHR(
-    ctx.gpu, ctx.surface, &present_mode_count, nullptr
+    ctx.gpu, surface.surface, &present_mode_count, nullptr
   );
   assert(!err); assert(present_mode_count > 0u);
 
   VkPresentModeKHR *present_modes = new VkPresentModeKHR[present_mode_count];
   err = ctx.ext.fpGetPhysicalDeviceSurfacePresentModesKHR(
-    ctx.gpu, ctx.surface, &present_mode_count, present_modes
+    ctx.gpu, surface.surface, &present_mode_count, present_modes
   );
   assert(!err);
 
-  /* Search for the best available swapchain present mode */
-  VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR; // default
-  for (uint32_t i=0u; i < present_mode_count; ++i) {
-    // Best (lowest latency non tearing mode)
-    if (present_modes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
-      present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
-      break;
-    }
-    // Second best (fastest, with tears)
-    if (present_modes[i] == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-      present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
-    }
-  }
+  /* Present mode, image count and frames in flight of the policy */
+  const uint32_t numSwapchainImages = select_present_config(
+    ctx, surface, capabilities, present_modes, present_mode_count
+  );
+  const VkPresentModeKHR present_mode = surface.presentMode;
   delete [] present_modes;
 
-  /* Number of images tu use on the swachains */
-  uint32_t numSwapchainImages = std::min(capabilities.minImageCount + 1u,
-                                         capabilities.maxImageCount);
-
   /* Transform applied to the surface */
   VkSurfaceTransformFlagBitsKHR preTransform = capabilities.currentTransform;
   if (capabilities.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR) {
     preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
   }
 
+  /* Images are copied from when frames are captured */
+  ctx.swapchainUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  if (capture_requested(ctx.app.options)) {
+    if (capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) {
+      ctx.swapchainUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    } else {
+      fprintf(stderr, "Capture warning : swapchain images cannot be copied from.\n");
+    }
+  }
+
   /* Save current swapchain */
-  VkSwapchainKHR oldSwapchain = ctx.swapchain;
+  VkSwapchainKHR oldSwapchain = surface.swapchain;
 
   /* Create the Swapchain */
   VkSwapchainCreateInfoKHR swapchainInfo;
   swapchainInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
   swapchainInfo.pNext = nullptr;
-  swapchainInfo.surface = ctx.surface;
+  swapchainInfo.surface = surface.surface;
   swapchainInfo.minImageCount = numSwapchainImages;
   swapchainInfo.imageFormat = ctx.format;
   swapchainInfo.imageColorSpace = ctx.color_space;
   swapchainInfo.imageExtent = swapchain_extent;
   swapchainInfo.imageArrayLayers = 1;
-  swapchainInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  swapchainInfo.imageUsage = ctx.swapchainUsage;
   swapchainInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
   swapchainInfo.queueFamilyIndexCount = 0;
   swapchainInfo.pQueueFamilyIndices = nullptr;
@@ -252,32 +367,39 @@ void setup_swapchain_buffers(VulkanContext &ctx) {
   swapchainInfo.oldSwapchain = oldSwapchain;
 
   err = ctx.ext.fpCreateSwapchainKHR(
-    ctx.device, &swapchainInfo, nullptr, &ctx.swapchain
+    ctx.device, &swapchainInfo, nullptr, &surface.swapchain
   );
   assert(!err);
 
 
-  /* Destroy previous swapchain */
+  /* Retire previous swapchain, its images can still be used by frames in flight */
   if (oldSwapchain != VK_NULL_HANDLE) {
-    ctx.ext.fpDestroySwapchainKHR(ctx.device, oldSwapchain, nullptr);
+    SwapchainBuffer *oldBuffers = surface.swapchainBuffers;
+    const uint32_t oldCount = surface.numSwapchainImages;
+
+    defer_deletion(ctx, [&ctx, oldSwapchain, oldBuffers, oldCount] {
+      release_swapchain_buffers(ctx, oldBuffers, oldCount);
+      ctx.ext.fpDestroySwapchainKHR(ctx.device, oldSwapchain, nullptr);
+    });
   }
 
 
   /* Setup swapchain buffers */
   err = ctx.ext.fpGetSwapchainImagesKHR(
-    ctx.device, ctx.swapchain, &ctx.numSwapchainImages, nullptr
+    ctx.device, surface.swapchain, &surface.numSwapchainImages, nullptr
   );
   assert(!err);
 
   // retrieve the images
-  VkImage *swapchainImages = new VkImage[ctx.numSwapchainImages];
+  VkImage *swapchainImages = new VkImage[surface.numSwapchainImages];
   err = ctx.ext.fpGetSwapchainImagesKHR(
-    ctx.device, ctx.swapchain, &ctx.numSwapchainImages, swapchainImages
+    ctx.device, surface.swapchain, &surface.numSwapchainImages, swapchainImages
   );
   assert(!err);
 
   // create swapchains buffers (image, view and command buffer)
-  ctx.swapchainBuffers = new SwapchainBuffer[ctx.numSwapchainImages];
+  surface.swapchainBuffers = new SwapchainBuffer[surface.numSwapchainImages];
+  surface.imageValues.assign(surface.numSwapchainImages, 0u);
 
   // generic ImageView
   VkImageViewCreateInfo colorImageView;
@@ -292,11 +414,11 @@ void setup_swapchain_buffers(VulkanContext &ctx) {
   colorImageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
   colorImageView.flags = 0u;
 
-  for (uint32_t i=0u; i<ctx.numSwapchainImages; ++i) {
+  for (uint32_t i=0u; i<surface.numSwapchainImages; ++i) {
     const VkImage &img = swapchainImages[i];
 
     colorImageView.image = img;
-    ctx.swapchainBuffers[i].image = img;
+    surface.swapchainBuffers[i].image = img;
 
     set_buffer_image_layout(ctx,
                             img,
@@ -305,12 +427,12 @@ void setup_swapchain_buffers(VulkanContext &ctx) {
                             VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
 
     err = vkCreateImageView(
-      ctx.device, &colorImageView, nullptr, &ctx.swapchainBuffers[i].view
+      ctx.device, &colorImageView, nullptr, &surface.swapchainBuffers[i].view
     );
     assert(!err);
   }
 
-  //delete [] swapchainImages; //
+  delete [] swapchainImages;
 
   // ----------
 
@@ -324,85 +446,54 @@ void setup_swapchain_buffers(VulkanContext &ctx) {
   info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
   info.commandBufferCount = 1u;
 
-  for (uint32_t i=0u; i<ctx.numSwapchainImages; ++i) {
-    err = vkAllocateCommandBuffers(ctx.device, &info, &ctx.swapchainBuffers[i].cmd);
+  for (uint32_t i=0u; i<surface.numSwapchainImages; ++i) {
+    err = vkAllocateCommandBuffers(ctx.device, &info, &surface.swapchainBuffers[i].cmd);
     assert(!err);
   }
 }
 
 // ----------------------------------------------------------------------------
 
-void setup_depth_buffer(VulkanContext &ctx) {
-  VkResult err;
-
-  const VkFormat depth_format = VK_FORMAT_D16_UNORM;
-
-  /**/
-  VkImageCreateInfo imageInfo;
-  memset(&imageInfo, 0, sizeof(imageInfo));
-  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-  imageInfo.pNext = nullptr;
-  imageInfo.flags = 0u;
-  imageInfo.imageType = VK_IMAGE_TYPE_2D;
-  imageInfo.format = depth_format;
-  imageInfo.extent = { ctx.app.width, ctx.app.height, 1 };
-  imageInfo.mipLevels = 1u;
-  imageInfo.arrayLayers = 1u;
-  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT; // TODOC
-  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-  imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-
-  ctx.depth.format = depth_format;
-
-  err = vkCreateImage(ctx.device, &imageInfo, nullptr, &ctx.depth.image);
-  assert(!err);
-
-  /* Retrieve memory requirements for the image */
-  VkMemoryRequirements memReqs;
-  vkGetImageMemoryRequirements(ctx.device, ctx.depth.image, &memReqs);
+/* Return the highest sample count up to requested, usable for color and depth */
+static
+VkSampleCountFlagBits select_sample_count(const VulkanContext &ctx, const uint32_t requested) {
+  const VkPhysicalDeviceLimits &limits = ctx.properties.gpu.limits;
+  const VkSampleCountFlags supported =   limits.framebufferColorSampleCounts
+                                       & limits.framebufferDepthSampleCounts;
+
+  uint32_t samples = requested;
+  while ((samples > 1u) && !(supported & samples)) {
+    samples >>= 1u;
+  }
 
-  ctx.depth.allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  ctx.depth.allocateInfo.pNext = nullptr;
-  ctx.depth.allocateInfo.allocationSize = memReqs.size;
-  ctx.depth.allocateInfo.memoryTypeIndex = 0u;
+  if (samples != requested) {
+    fprintf(stderr, "dev warning : MSAA x%u not supported, using x%u.\n", requested, samples);
+  }
+  return static_cast<VkSampleCountFlagBits>(samples);
+}
 
-  bool res = retrieve_memory_type_index(
-    ctx.properties.memory,
-    memReqs.memoryTypeBits,
-    0,
-    &ctx.depth.allocateInfo.memoryTypeIndex
-  );
-  assert(res);
+// ----------------------------------------------------------------------------
 
+/* Return the first depth format usable as attachment, by order of precision */
+static
+VkFormat select_depth_format(const VulkanContext &ctx) {
+  const VkFormat candidates[] = {
+    VK_FORMAT_D32_SFLOAT,
+    VK_FORMAT_D24_UNORM_S8_UINT,
+    VK_FORMAT_D16_UNORM,
+  };
 
-  /* Allocate the memory */
-  err = vkAllocateMemory(ctx.device, &ctx.depth.allocateInfo, nullptr, &ctx.depth.mem);
-  assert(!err);
+  for (const auto &format : candidates) {
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(ctx.gpu, format, &props);
 
-  /* Bind memory */
-  err = vkBindImageMemory(ctx.device, ctx.depth.image, ctx.depth.mem, 0);
-  assert(!err);
+    if (props.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+      return format;
+    }
+  }
 
-  // TODO : set image layout
-  set_buffer_image_layout(ctx,
-                          ctx.depth.image,
-                          VK_IMAGE_ASPECT_DEPTH_BIT,
-                          VK_IMAGE_LAYOUT_UNDEFINED,
-                          VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
-
-  /* Create image view */
-  VkImageViewCreateInfo viewInfo;
-  memset(&viewInfo, 0, sizeof(viewInfo));
-  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-  viewInfo.pNext = nullptr;
-  viewInfo.flags = 0;
-  viewInfo.image = ctx.depth.image;
-  viewInfo.format = depth_format;
-  viewInfo.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1};
-  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-
-  err = vkCreateImageView(ctx.device, &viewInfo, nullptr, &ctx.depth.view);
-  assert(!err);
+  fprintf(stderr, "Vulkan error : no depth format supported as attachment.\n");
+  exit(EXIT_FAILURE);
 }
 
 // ----------------------------------------------------------------------------
@@ -410,6 +501,8 @@ void setup_depth_buffer(VulkanContext &ctx) {
 // XXX rendering issue probably here XXX
 
 void setup_data_buffer(VulkanContext &ctx) {
+  PROFILE_FUNCTION();
+
   /// -----------------------------------------------------
   /// for Vulkan memory management type, see
   /// https://developer.nvidia.com/vulkan-memory-management
@@ -420,27 +513,15 @@ void setup_data_buffer(VulkanContext &ctx) {
   
   // meeeh..
   struct DataLayout_t {
-    mat4x4 mvp;
-    vec4 position[3u];
-    vec4 color[3u];
+    mat4x4 viewProj;
   } data_layout;
 
   const unsigned int dataSize = sizeof(data_layout);
 
-  // -------
-
-  const float attrib_data[] = {
-    // vertex position
-    -1.0f, -1.0f, 0.0f, 1.0f,
-    +1.0f, -1.0f, 0.0f, 1.0f,
-    0.0f, 0.73f, 0.0f, 1.0f,
-
-    // rgba color
-    1.0f, 0.0f, 0.0f, 1.0f,
-    0.0f, 1.0f, 0.0f, 1.0f,
-    0.0f, 0.0f, 1.0f, 1.0f
-  };
-
+  /* Each frame in flight updates its own slice, aligned for dynamic offsets */
+  const VkDeviceSize alignment = ctx.properties.gpu.limits.minUniformBufferOffsetAlignment;
+  const VkDeviceSize sliceSize = (alignment > 0u) ? ((dataSize + alignment - 1u) / alignment) * alignment
+                                                  : dataSize;
 
   /* -- Device data -- */
 
@@ -450,8 +531,8 @@ void setup_data_buffer(VulkanContext &ctx) {
   VkBufferCreateInfo bufferInfo;
   memset(&bufferInfo, 0, sizeof(VkBufferCreateInfo));
   bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-  bufferInfo.size = dataSize;
-  bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+  bufferInfo.size = sliceSize * kMaxFramesInFlight;
+  bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 
   err = vkCreateBuffer(ctx.device, &bufferInfo, nullptr, &ctx.uniformData.buffer);
   assert(!err);
@@ -470,7 +551,7 @@ void setup_data_buffer(VulkanContext &ctx) {
   bool res = retrieve_memory_type_index(
     ctx.properties.memory,
     memReqs.memoryTypeBits,
-    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
     &allocInfo.memoryTypeIndex
   );
   assert(res);
@@ -478,48 +559,72 @@ void setup_data_buffer(VulkanContext &ctx) {
   err = vkAllocateMemory(ctx.device, &allocInfo, nullptr, &ctx.uniformData.mem);
   assert(!err);
 
-
-  /* Copy data from host to device memory */
-  {
-    size_t offset = sizeof(mat4x4);
-
-    void *pData(nullptr);
-    err = vkMapMemory(
-      ctx.device, ctx.uniformData.mem, offset, allocInfo.allocationSize - offset, 0u, (void**)&pData
-    );
-    assert(!err);
-
-    // copy attrib data, skip mvp
-    memcpy(pData, attrib_data, sizeof(attrib_data));
-
-    vkUnmapMemory(ctx.device, ctx.uniformData.mem);
-  }
-  
   /* Bind the buffer to device memory */
   err = vkBindBufferMemory(ctx.device, ctx.uniformData.buffer, ctx.uniformData.mem, 0);
   assert(!err);
 
+  /* Copy data from host to device memory, with the first frame */
+  mat4x4_identity(data_layout.viewProj);
+
+  for (uint32_t i = 0u; i < kMaxFramesInFlight; ++i) {
+    stage_buffer_upload(ctx, ctx.uniformData.buffer, i * sliceSize, &data_layout, dataSize);
+  }
+
   ctx.uniformData.descBufferInfo.buffer = ctx.uniformData.buffer;
   ctx.uniformData.descBufferInfo.offset = 0u;
   ctx.uniformData.descBufferInfo.range = dataSize;
+  ctx.uniformData.sliceSize = sliceSize;
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+* Small data is cheaper to send through push constants, as it is recorded
+* directly into the command buffer, but the draw commands are then recorded
+* again each time it changes. Through the uniform buffer, a moving camera
+* only costs an upload.
+*/
+static
+bool use_push_constants(const VulkanContext &ctx, const uint32_t dataSize) {
+  return !ctx.app.options.uniformCamera
+      && (dataSize <= ctx.properties.gpu.limits.maxPushConstantsSize);
 }
 
 // ----------------------------------------------------------------------------
 
 void setup_descriptor_layout(VulkanContext &ctx) {
+  PROFILE_FUNCTION();
+
   VkResult err;
 
+  /* Select how the camera data (the view projection matrix) is sent */
+  ctx.pushConstants.size = sizeof(mat4x4);
+  ctx.pushConstants.enabled = use_push_constants(ctx, ctx.pushConstants.size);
+  mat4x4_identity(ctx.pushConstants.viewProj);
+
+  VkPushConstantRange push_range;
+  push_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  push_range.offset = 0u;
+  push_range.size = ctx.pushConstants.size;
+
   /* Defines the descriptor set layout binding */
-  const unsigned int bindingCount = 1u;
+  const unsigned int bindingCount = 2u;
   VkDescriptorSetLayoutBinding layout_bind[bindingCount];
 
   // uniform buffer layout (used by Vertex shader stage)
   layout_bind[0u].binding = 0u;
-  layout_bind[0u].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  layout_bind[0u].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
   layout_bind[0u].descriptorCount = 1u;
   layout_bind[0u].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
   layout_bind[0u].pImmutableSamplers = nullptr;
 
+  // texture layout (used by Fragment shader stage)
+  layout_bind[1u].binding = 1u;
+  layout_bind[1u].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  layout_bind[1u].descriptorCount = 1u;
+  layout_bind[1u].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+  layout_bind[1u].pImmutableSamplers = nullptr;
+
 
   /* Create the descriptor set layout */
   VkDescriptorSetLayoutCreateInfo layout_info;
@@ -540,6 +645,8 @@ void setup_descriptor_layout(VulkanContext &ctx) {
   pipeline_info.pNext = nullptr;
   pipeline_info.setLayoutCount = 1u;
   pipeline_info.pSetLayouts = &ctx.descLayout;
+  pipeline_info.pushConstantRangeCount = (ctx.pushConstants.enabled) ? 1u : 0u;
+  pipeline_info.pPushConstantRanges = &push_range;
 
   err = vkCreatePipelineLayout(ctx.device, &pipeline_info, nullptr, &ctx.pipelineLayout);
   assert(!err);
@@ -547,305 +654,79 @@ void setup_descriptor_layout(VulkanContext &ctx) {
 
 // ----------------------------------------------------------------------------
 
-void setup_render_pass(VulkanContext &ctx) {
-  const unsigned int attachmentCount = 2u;
-  VkAttachmentDescription descs[attachmentCount];
-  VkAttachmentReference references[attachmentCount];
-
-  memset(descs, 0, sizeof(VkAttachmentDescription) * attachmentCount);
-  memset(references, 0, sizeof(VkAttachmentReference) * attachmentCount);
-
-  /* color attachment */
-  descs[0u].format          = ctx.format;
-  descs[0u].samples         = VK_SAMPLE_COUNT_1_BIT;
-  descs[0u].loadOp          = VK_ATTACHMENT_LOAD_OP_CLEAR;
-  descs[0u].storeOp         = VK_ATTACHMENT_STORE_OP_STORE;
-  descs[0u].stencilLoadOp   = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-  descs[0u].stencilStoreOp  = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  descs[0u].initialLayout   = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-  descs[0u].finalLayout     = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-  references[0u].attachment = 0u;
-  references[0u].layout     = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-  /* depth attachment */
-  descs[1u].format          = ctx.depth.format;
-  descs[1u].samples         = VK_SAMPLE_COUNT_1_BIT;
-  descs[1u].loadOp          = VK_ATTACHMENT_LOAD_OP_CLEAR;
-  descs[1u].storeOp         = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  descs[1u].stencilLoadOp   = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-  descs[1u].stencilStoreOp  = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  descs[1u].initialLayout   = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-  descs[1u].finalLayout     = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-  references[1u].attachment = 1u;
-  references[1u].layout     = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-  /* Defines subpass */
-  VkSubpassDescription subpass;
-  subpass.flags = 0u;
-  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-  subpass.inputAttachmentCount = 0u;
-  subpass.pInputAttachments = nullptr;
-  subpass.colorAttachmentCount = 1u;
-  subpass.pColorAttachments = &references[0u];
-  subpass.pResolveAttachments = nullptr;
-  subpass.pDepthStencilAttachment = &references[1u];
-  subpass.preserveAttachmentCount = 0u;
-  subpass.pPreserveAttachments = nullptr;
-
-  /* Create the render pass */
-  VkRenderPassCreateInfo info;
-  info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-  info.pNext = nullptr;
-  info.attachmentCount = attachmentCount;
-  info.pAttachments = descs;
-  info.subpassCount = 1u;
-  info.pSubpasses = &subpass;
-  info.dependencyCount = 0u;
-  info.pDependencies = nullptr;
-
-  VkResult err;
-  err = vkCreateRenderPass(ctx.device, &info, nullptr, &ctx.renderPass);
-  assert(!err);
-}
-
-// ----------------------------------------------------------------------------
-
-void setup_framebuffers(VulkanContext &ctx) {
-  assert(ctx.renderPass != VK_NULL_HANDLE);
-  assert(ctx.swapchainBuffers != nullptr);
-
-  VkResult err;
-  VkImageView attachments[2u];
-
-  VkFramebufferCreateInfo info;
-  info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-  info.pNext = nullptr;
-  info.flags = 0;
-  info.renderPass = ctx.renderPass;
-  info.attachmentCount = 2u;
-  info.pAttachments = attachments;
-  info.width = ctx.app.width;
-  info.height = ctx.app.height;
-  info.layers = 1u;
-
-  ctx.framebuffers = new VkFramebuffer[ctx.numSwapchainImages];
-
-  attachments[1u] = ctx.depth.view;
-  for (uint32_t i = 0u; i < ctx.numSwapchainImages; ++i) {
-      attachments[0u] = ctx.swapchainBuffers[i].view;
-      err = vkCreateFramebuffer(ctx.device, &info, nullptr, &ctx.framebuffers[i]);
-      assert(!err);
-  }
-}
-
-// ----------------------------------------------------------------------------
-
+/* Description of the pipeline drawing the triangle */
 static
-char* read_binary_file(const char *filename, size_t &filesize) {
-    FILE *fd = fopen(filename, "rb");
-    if (!fd) {
-      return nullptr;
-    }
-
-    fseek(fd, 0L, SEEK_END);
-    filesize = ftell(fd);
-    fseek(fd, 0L, SEEK_SET);
-
-    char* shader_binary = new char[filesize];
-    size_t ret = fread(shader_binary, filesize, 1u, fd);
-    assert(ret == 1u);
-
-    fclose(fd);
-    return shader_binary;
-}
-
-// ----------------------------------------------------------------------------
-
-static
-VkShaderModule create_shader_module(VkDevice device, const char *filename) {
-    size_t codesize;
-    char* code = read_binary_file(filename, codesize);
-
-    if (code == nullptr) {
-      fprintf(stderr, "Error : shader \"%s\" not found.\n", filename);
-      exit(EXIT_FAILURE);
-    }
-
-    VkResult err;
-
-    VkShaderModuleCreateInfo moduleInfo;
-    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    moduleInfo.pNext = nullptr;
-    moduleInfo.flags = 0;
-    moduleInfo.codeSize = codesize;
-    moduleInfo.pCode = (uint32_t*)code;
-
-    VkShaderModule module;
-    err = vkCreateShaderModule(device, &moduleInfo, nullptr, &module);
-    assert(!err);
-
-    delete [] code;
+PipelineDesc main_pipeline_desc(const VulkanContext &ctx) {
+  PipelineDesc desc;
+
+  // the vertex shader variant must match the camera data path
+  desc.vert_shader = (ctx.pushConstants.enabled) ? SHADERS_DIR "simple.pc.vert.spv"
+                                                 : SHADERS_DIR "simple.vert.spv";
+  desc.frag_shader = SHADERS_DIR "simple.frag.spv";
+
+  // world transform of each instance, a mat4 spanning four attributes
+  desc.bindings.push_back({ 0u, sizeof(InstanceData), VK_VERTEX_INPUT_RATE_INSTANCE });
+  for (uint32_t i = 0u; i < 4u; ++i) {
+    desc.attributes.push_back({
+      i, 0u, VK_FORMAT_R32G32B32A32_SFLOAT, static_cast<uint32_t>(i * sizeof(vec4))
+    });
+  }
 
-    return module;
+  // quantized mesh vertices (see PackedVertex)
+  desc.bindings.push_back({ kMeshVertexBinding, sizeof(PackedVertex), VK_VERTEX_INPUT_RATE_VERTEX });
+  desc.attributes.push_back({
+    4u, kMeshVertexBinding, VK_FORMAT_R16G16B16A16_SNORM, offsetof(PackedVertex, position)
+  });
+  desc.attributes.push_back({
+    5u, kMeshVertexBinding, VK_FORMAT_R16G16_SNORM, offsetof(PackedVertex, normal)
+  });
+  desc.attributes.push_back({
+    6u, kMeshVertexBinding, VK_FORMAT_R8G8B8A8_UNORM, offsetof(PackedVertex, color)
+  });
+
+  desc.samples = ctx.samples;
+  desc.layout = ctx.pipelineLayout;
+  desc.renderPass = ctx.renderPass;
+
+  return desc;
 }
 
 // ----------------------------------------------------------------------------
 
 void setup_pipeline(VulkanContext &ctx) {
-  VkResult err;
+  PROFILE_FUNCTION();
 
-  /* Setup pipeline shader stages */
-  ctx.shader.vert_module = create_shader_module(ctx.device, SHADERS_DIR "simple.vert.spv");
-  ctx.shader.frag_module = create_shader_module(ctx.device, SHADERS_DIR "simple.frag.spv");
-
-  const unsigned int stageCount = 2u;
-  VkPipelineShaderStageCreateInfo shaderStages[stageCount];
-  memset(&shaderStages, 0, stageCount * sizeof(VkPipelineShaderStageCreateInfo));
-
-  shaderStages[0u].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  shaderStages[0u].stage = VK_SHADER_STAGE_VERTEX_BIT;
-  shaderStages[0u].module = ctx.shader.vert_module;
-  shaderStages[0u].pName = "main";
-
-  shaderStages[1u].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  shaderStages[1u].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-  shaderStages[1u].module = ctx.shader.frag_module;
-  shaderStages[1u].pName = "main";
-
-
-  /* Setup pipeline states */
-  struct States_t {
-    VkPipelineVertexInputStateCreateInfo vi;
-    VkPipelineInputAssemblyStateCreateInfo ia;
-    VkPipelineTessellationStateCreateInfo ts;
-    VkPipelineViewportStateCreateInfo vp;
-    VkPipelineRasterizationStateCreateInfo rs;
-    VkPipelineMultisampleStateCreateInfo ms;
-    VkPipelineDepthStencilStateCreateInfo ds;
-    VkPipelineColorBlendStateCreateInfo cb;
-    VkPipelineDynamicStateCreateInfo dynamic;
-  } states;
-  memset(&states, 0, sizeof(States_t));
-
-  // vertex input
-  states.vi.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-
-  // input assembly
-  states.ia.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-  states.ia.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-
-  // tessellation
-  states.ts.sType = VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO;
-
-  // viewport
-  states.vp.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-  states.vp.viewportCount = 1u;
-  states.vp.scissorCount = 1u;
-
-  // rasterization
-  states.rs.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-  states.rs.flags = 0;
-  states.rs.depthClampEnable = VK_FALSE;
-  states.rs.rasterizerDiscardEnable = VK_FALSE;
-  states.rs.polygonMode = VK_POLYGON_MODE_FILL;
-  states.rs.cullMode = VK_CULL_MODE_BACK_BIT;
-  states.rs.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-  states.rs.depthBiasEnable = VK_FALSE;
-  states.rs.lineWidth = 1.0f;
-
-  // multisample
-  states.ms.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-  states.ms.pSampleMask = nullptr;
-  states.ms.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-  // depth stencil
-  states.ds.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-  states.ds.depthTestEnable = VK_TRUE;
-  states.ds.depthWriteEnable = VK_TRUE;
-  states.ds.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-  states.ds.depthBoundsTestEnable = VK_FALSE;
-  states.ds.stencilTestEnable = VK_FALSE;
-  states.ds.back.failOp = VK_STENCIL_OP_KEEP;
-  states.ds.back.passOp = VK_STENCIL_OP_KEEP;
-  states.ds.back.compareOp = VK_COMPARE_OP_ALWAYS;
-  states.ds.front = states.ds.back;
-
-  // color blend
-  VkPipelineColorBlendAttachmentState blendAttachState;
-  memset(&blendAttachState, 0, sizeof(VkPipelineColorBlendAttachmentState));
-  blendAttachState.blendEnable = VK_FALSE;
-  blendAttachState.colorWriteMask =   VK_COLOR_COMPONENT_R_BIT
-                                    | VK_COLOR_COMPONENT_G_BIT
-                                    | VK_COLOR_COMPONENT_B_BIT
-                                    | VK_COLOR_COMPONENT_A_BIT;
-
-  states.cb.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-  states.cb.attachmentCount = 1u;
-  states.cb.pAttachments = &blendAttachState;
-
-  // dynamic states
-  VkDynamicState dynamicStateEnables[VK_DYNAMIC_STATE_RANGE_SIZE];
-  unsigned int dynamicStateCount = 0u;
-  memset(dynamicStateEnables, 0, sizeof(VkDynamicState));
-  dynamicStateEnables[dynamicStateCount++] = VK_DYNAMIC_STATE_VIEWPORT;
-  dynamicStateEnables[dynamicStateCount++] = VK_DYNAMIC_STATE_SCISSOR;
-
-  states.dynamic.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-  states.dynamic.dynamicStateCount = dynamicStateCount;
-  states.dynamic.pDynamicStates = dynamicStateEnables;
-
-
-  /* Create the pipeline cache */
-  VkPipelineCacheCreateInfo pipelineCache;
-  memset(&pipelineCache, 0, sizeof(pipelineCache));
-  pipelineCache.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-
-  err =
-  vkCreatePipelineCache(ctx.device, &pipelineCache, nullptr, &ctx.pipelineCache);
-  assert(!err);
+  /* Pipelines are created and cached by the pipeline manager */
+  assert(ctx.pipelineManager != nullptr);
 
+  const PipelineDesc desc = main_pipeline_desc(ctx);
 
-  /* Create the Graphic Pipeline */
-  VkGraphicsPipelineCreateInfo pipeline;
-  memset(&pipeline, 0, sizeof(pipeline));
-  pipeline.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-  pipeline.stageCount = stageCount;
-  pipeline.pStages = shaderStages;
-  
-  pipeline.pVertexInputState = &states.vi;
-  pipeline.pInputAssemblyState = &states.ia;
-  pipeline.pTessellationState = nullptr;
-  pipeline.pViewportState = &states.vp;
-  pipeline.pRasterizationState = &states.rs;
-  pipeline.pMultisampleState = &states.ms;
-  pipeline.pDepthStencilState = &states.ds;
-  pipeline.pColorBlendState = &states.cb;
-  pipeline.pDynamicState = &states.dynamic;
-
-  pipeline.layout = ctx.pipelineLayout;
-  pipeline.renderPass = ctx.renderPass;
-
-  err = vkCreateGraphicsPipelines(
-    ctx.device, ctx.pipelineCache, 1u, &pipeline, nullptr, &ctx.pipeline
-  );
-  assert(!err);
-
+  /* Captured frames must not depend on the compilation time */
+  const AppOptions &options = ctx.app.options;
+  if (!options.capture.empty() || !options.golden.empty()) {
+    get_pipeline(ctx, desc);
+  }
 
-  /* destroy shader modules */
-  vkDestroyShaderModule(ctx.device, ctx.shader.vert_module, nullptr);
-  vkDestroyShaderModule(ctx.device, ctx.shader.frag_module, nullptr);
+  // compiled on a worker, frames are drawn without it until it is ready
+  // (a cache hit when compiled above)
+  ctx.pipelineHandle = request_pipeline_async(ctx, desc);
+  ctx.pipeline = resolve_pipeline(ctx, ctx.pipelineHandle);
 }
 
 // ----------------------------------------------------------------------------
 
 void setup_descriptor(VulkanContext &ctx) {
+  PROFILE_FUNCTION();
+
   VkResult err;
 
   /* Create descriptor pool */
-  const unsigned int numPoolSize = 1u;
+  const unsigned int numPoolSize = 2u;
   VkDescriptorPoolSize desc_pool_sizes[numPoolSize];
-  desc_pool_sizes[0u].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  desc_pool_sizes[0u].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
   desc_pool_sizes[0u].descriptorCount = 1u;
+  desc_pool_sizes[1u].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  desc_pool_sizes[1u].descriptorCount = 1u;
 
   VkDescriptorPoolCreateInfo desc_pool_info;
   desc_pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -873,24 +754,160 @@ void setup_descriptor(VulkanContext &ctx) {
   err = vkAllocateDescriptorSets(ctx.device, &desc_alloc_info, &ctx.descSet);
   assert(!err);
 
-  VkWriteDescriptorSet write_desc;
-  memset(&write_desc, 0, sizeof(write_desc));
+  /* The texture layout is set by its upload, before the first draw */
+  VkDescriptorImageInfo image_info;
+  image_info.sampler = ctx.sampler;
+  image_info.imageView = ctx.texture.view;
+  image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+  VkWriteDescriptorSet write_desc[2u];
+  memset(write_desc, 0, sizeof(write_desc));
+
+  write_desc[0u].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write_desc[0u].dstSet = ctx.descSet;
+  write_desc[0u].dstBinding = 0u;
+  write_desc[0u].descriptorCount = 1u;
+  write_desc[0u].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+  write_desc[0u].pBufferInfo = &ctx.uniformData.descBufferInfo;
+
+  write_desc[1u].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write_desc[1u].dstSet = ctx.descSet;
+  write_desc[1u].dstBinding = 1u;
+  write_desc[1u].descriptorCount = 1u;
+  write_desc[1u].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  write_desc[1u].pImageInfo = &image_info;
+
+  vkUpdateDescriptorSets(ctx.device, 2u, write_desc, 0, nullptr);
+}
+
+// ----------------------------------------------------------------------------
+
+void setup_texture(VulkanContext &ctx) {
+  PROFILE_FUNCTION();
+
+  /* Texture given on the command line, or a white one */
+  const std::string &filename = ctx.app.options.texture;
+  if (filename.empty() || !load_texture(ctx, filename.c_str(), ctx.texture)) {
+    create_default_texture(ctx, ctx.texture);
+  }
+
+  ctx.sampler = get_sampler(ctx, SamplerDesc());
+}
+
+// ----------------------------------------------------------------------------
+
+/* Record the pipeline states and the instanced draws of the frame */
+static
+void record_draw(VulkanContext &ctx,
+                 const SurfaceContext &surface,
+                 const VkCommandBuffer &cmdBuffer,
+                 const uint32_t uniformSlice) {
+  /* camera data, shared by the pipelines of every material */
+  if (ctx.pushConstants.enabled) {
+    vkCmdPushConstants(
+      cmdBuffer, ctx.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0u, ctx.pushConstants.size, &ctx.pushConstants.viewProj[0][0]
+    );
+  }
+
+  /* set viewport */
+  VkViewport vp;
+  vp.x = 0.0f;
+  vp.y = 0.0f;
+  vp.width = surface.width;
+  vp.height = surface.height;
+  vp.minDepth = 0.0f;
+  vp.maxDepth = 1.0f;
+  vkCmdSetViewport(cmdBuffer, 0u, 1u, &vp);
+
+  /* set scissor */
+  VkRect2D scissor;
+  scissor.offset.x = 0;
+  scissor.offset.y = 0;
+  scissor.extent.width  = surface.width;
+  scissor.extent.height = surface.height;
+  vkCmdSetScissor(cmdBuffer, 0u, 1u, &scissor);
+
+  /* bind the states and set the draw cmds, one per batch of instances */
+  record_draw_list(ctx, cmdBuffer, uniformSlice);
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+* Describe the frame of a surface : the main pass draws the triangle into
+* the swapchain image, or into a multisampled target resolved into it.
+* Surfaces share the swapchain format, so their render passes are compatible
+* and the pipelines created against the primary surface draw into all.
+*/
+static
+void setup_render_graph(VulkanContext &ctx, SurfaceContext &surface) {
+  PROFILE_FUNCTION();
+
+  assert(surface.swapchainBuffers != nullptr);
+  assert(ctx.depthFormat != VK_FORMAT_UNDEFINED);
+
+  surface.renderGraph = new RenderGraph();
+  RenderGraph &graph = *surface.renderGraph;
+
+  /* Swapchain images, one variant per image */
+  std::vector<VkImage> images(surface.numSwapchainImages);
+  std::vector<VkImageView> views(surface.numSwapchainImages);
+  for (uint32_t i = 0u; i < surface.numSwapchainImages; ++i) {
+    images[i] = surface.swapchainBuffers[i].image;
+    views[i] = surface.swapchainBuffers[i].view;
+  }
+  const RGResourceId backbuffer = import_graph_image(
+    graph, "backbuffer", ctx.format, images, views, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+  );
+
+  /* Skip the draw while its pipeline is not compiled (only clear the buffers) */
+  const RGPassId main_pass = add_graph_pass(graph, "main", [&ctx, &surface](VkCommandBuffer cmd) {
+    if (ctx.pipeline != VK_NULL_HANDLE) {
+      record_draw(ctx, surface, cmd, ctx.frameScheduler->slotIndex);
+    }
+  });
+
+  const VkClearColorValue clear_color = {{ 0.35f, 0.40f, 0.50f, 1.0f }};
+  const VkClearDepthStencilValue clear_depth = { 1.0f, 0u };
+
+  /* With MSAA, the multisampled color is resolved into the swapchain image */
+  if (ctx.samples != VK_SAMPLE_COUNT_1_BIT) {
+    const RGResourceId msaa = create_graph_image(graph, "msaa_color", ctx.format, ctx.samples);
+    pass_write_color(graph, main_pass, msaa, &clear_color, backbuffer);
+  } else {
+    pass_write_color(graph, main_pass, backbuffer, &clear_color);
+  }
+
+  /* The primary surface depth is kept after the pass when occlusion culling reads it */
+  RGResourceId depth;
+  if ((&surface == &ctx.surfaces.front()) && ctx.occlusion->enabled) {
+    const OcclusionCuller &occlusion = *ctx.occlusion;
+    depth = import_graph_image(graph, "depth", ctx.depthFormat,
+                               { occlusion.depth }, { occlusion.depthView },
+                               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  } else {
+    depth = create_graph_image(graph, "depth", ctx.depthFormat, ctx.samples);
+  }
+  pass_write_depth(graph, main_pass, depth, &clear_depth);
 
-  write_desc.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-  write_desc.dstSet = ctx.descSet;
-  write_desc.descriptorCount = 1u;
-  write_desc.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  write_desc.pBufferInfo = &ctx.uniformData.descBufferInfo;
+  compile_render_graph(ctx, graph, surface.width, surface.height);
 
-  vkUpdateDescriptorSets(ctx.device, 1u, &write_desc, 0, nullptr);
+  /* Pipelines are created against the main pass of the primary surface */
+  if (&surface == &ctx.surfaces.front()) {
+    ctx.renderPass = graph.passes[main_pass].renderPass;
+  }
 }
 
 // ----------------------------------------------------------------------------
 
-void setup_buffer_draw_cmd(VulkanContext &ctx, const unsigned int buffer_index) {
+void setup_buffer_draw_cmd(VulkanContext &ctx,
+                           SurfaceContext &surface,
+                           const unsigned int buffer_index) {
+  PROFILE_FUNCTION();
+
   VkResult err;
 
-  const VkCommandBuffer &cmdBuffer = ctx.swapchainBuffers[buffer_index].cmd;
+  const VkCommandBuffer &cmdBuffer = surface.swapchainBuffers[buffer_index].cmd;
 
   /* Begin the command buffer */
   VkCommandBufferInheritanceInfo hinfo;
@@ -912,98 +929,27 @@ void setup_buffer_draw_cmd(VulkanContext &ctx, const unsigned int buffer_index)
   err = vkBeginCommandBuffer(cmdBuffer, &cmd_buffer_info);
   assert(!err);
 
-
-  /* Begin the renderpass */
-  const unsigned int numClearValues = 2u;
-  VkClearValue clear_values[numClearValues];
-  // used by the color buffer attachment (first)
-  clear_values[0u].color.float32[0u] = 0.35f;
-  clear_values[0u].color.float32[1u] = 0.40f;
-  clear_values[0u].color.float32[2u] = 0.50f;
-  clear_values[0u].color.float32[3u] = 1.0f;
-  // used by the depth-stencil buffer attachment (second)
-  clear_values[1u].depthStencil.depth = 1.0f;
-  clear_values[1u].depthStencil.stencil = 0u;
-
-  VkRenderPassBeginInfo rp_begin_info;
-  rp_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-  rp_begin_info.pNext = nullptr;
-  rp_begin_info.renderPass = ctx.renderPass;
-  rp_begin_info.framebuffer = ctx.framebuffers[buffer_index];
-  rp_begin_info.renderArea.offset.x = 0u;
-  rp_begin_info.renderArea.offset.y = 0u;
-  rp_begin_info.renderArea.extent.width = ctx.app.width;
-  rp_begin_info.renderArea.extent.height = ctx.app.height;
-  rp_begin_info.clearValueCount = numClearValues;
-  rp_begin_info.pClearValues = clear_values;
-
-  vkCmdBeginRenderPass(cmdBuffer, &rp_begin_info, VK_SUBPASS_CONTENTS_INLINE);
-
-  /**/
-  vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, ctx.pipeline);
-
-  /**/
-  vkCmdBindDescriptorSets(
-    cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, ctx.pipelineLayout, 0, 1, &ctx.descSet, 0, nullptr
-  );
-
-  /* set viewport */
-  VkViewport vp;
-  vp.x = 0.0f;
-  vp.y = 0.0f;
-  vp.width = ctx.app.width;
-  vp.height = ctx.app.height;
-  vp.minDepth = 0.0f;
-  vp.maxDepth = 1.0f;
-  vkCmdSetViewport(cmdBuffer, 0u, 1u, &vp);
-
-  /* set scissor */
-  VkRect2D scissor;
-  scissor.offset.x = 0;
-  scissor.offset.y = 0;
-  scissor.extent.width  = ctx.app.width;
-  scissor.extent.height = ctx.app.height;
-  vkCmdSetScissor(cmdBuffer, 0u, 1u, &scissor);
-
-  /* set the draw cmd */
-  vkCmdDraw(
-    cmdBuffer, 
-    3u,       // vertexCount
-    1u,       // instanceCount
-    0u,       // firstVertex
-    0u        // firstInstance
-  );
-
-  /* End the renderpass */
-  vkCmdEndRenderPass(cmdBuffer);
-
-
-  /* create a memory barrier before surface presentation */
-  VkImageMemoryBarrier presentBarrier;
-  presentBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-  presentBarrier.pNext = nullptr;
-  presentBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-  presentBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-  presentBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-  presentBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-  presentBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  presentBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  presentBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  presentBarrier.subresourceRange.baseMipLevel = 0u;
-  presentBarrier.subresourceRange.levelCount = 1u;
-  presentBarrier.subresourceRange.baseArrayLayer = 0u;
-  presentBarrier.subresourceRange.layerCount = 1u;
-  presentBarrier.image = ctx.swapchainBuffers[buffer_index].image;
-
-  vkCmdPipelineBarrier(
-    cmdBuffer,
-    VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-    0u,                 // dependency flags
-    0u, nullptr,        // memory barriers
-    0u, nullptr,        // buffer memory barriers
-    1u, &presentBarrier // image memory barriers
-  );
+  /* Keep track of the states recorded */
+  SwapchainBuffer &swapchainBuffer = surface.swapchainBuffers[buffer_index];
+  swapchainBuffer.pipeline = ctx.pipeline;
+  swapchainBuffer.uniformSlice = ctx.frameScheduler->slotIndex;
+  swapchainBuffer.drawVersion = ctx.drawList->version;
+
+  /**
+  * The passes of the frame, with the swapchain image as variant.
+  * Layout transitions (to rendering, then presentation) are made by the
+  * render passes. They are counted by the pipeline statistics query of the
+  * surface in the slot.
+  */
+  const uint32_t surface_index = static_cast<uint32_t>(&surface - &ctx.surfaces.front());
+  begin_pipeline_statistics(ctx, cmdBuffer, surface_index, swapchainBuffer.uniformSlice);
+  execute_render_graph(*surface.renderGraph, cmdBuffer, buffer_index);
+  end_pipeline_statistics(ctx, cmdBuffer, surface_index, swapchainBuffer.uniformSlice);
+
+  /* Hi-Z of the primary surface depth, read back into the slot */
+  if ((&surface == &ctx.surfaces.front()) && ctx.occlusion->enabled) {
+    record_occlusion(ctx, cmdBuffer, swapchainBuffer.uniformSlice);
+  }
 
   /* End command buffer */
   err = vkEndCommandBuffer(cmdBuffer);
@@ -1013,6 +959,8 @@ void setup_buffer_draw_cmd(VulkanContext &ctx, const unsigned int buffer_index)
 // ----------------------------------------------------------------------------
 
 void setup_vk_data(VulkanContext &ctx) {
+  PROFILE_FUNCTION();
+
   VkResult err;
 
   /* Create the command pool */
@@ -1020,47 +968,218 @@ void setup_vk_data(VulkanContext &ctx) {
   cmdPool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
   cmdPool_info.pNext = nullptr;
   cmdPool_info.queueFamilyIndex = ctx.selected_queue_index;
-  cmdPool_info.flags = 0u;
+  // draw command buffers are re-recorded when their batches, pipeline,
+  // uniform slice or, with push constants, the camera change
+  cmdPool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
   err = vkCreateCommandPool(ctx.device, &cmdPool_info, nullptr, &ctx.cmdPool);
   assert(!err);
 
   /* Buffer used for initializations */
   //setup_init_cmd_buffer(ctx); //
 
-  /* Swapchain buffers for rendering / display */
-  setup_swapchain_buffers(ctx);
+  /* Resources retired during rendering */
+  init_deletion_queue(ctx);
 
-  /* Depth buffer */
-  setup_depth_buffer(ctx);
+  /* Frame readbacks */
+  init_capture(ctx);
 
-  // ------
+  /* Multisampling and depth format of the render targets */
+  ctx.samples = select_sample_count(ctx, ctx.app.options.msaaSamples);
+  ctx.depthFormat = select_depth_format(ctx);
+
+  /* Samplers shared by textures */
+  init_sampler_cache(ctx);
+
+  /**
+  * The setup steps form a dependency graph, independent steps (file I/O,
+  * buffer allocations, object creations) run concurrently.
+  * Steps using the command pool (swapchain, staging, timestamps, draw
+  * commands) are chained as the pool must be externally synchronized.
+  */
+  TaskGraph graph;
+
+  /* Swapchain buffers for rendering / display, of every surface */
+  TaskId swapchain = add_task(graph, "swapchain_buffers", [&ctx] {
+    for (auto &surface : ctx.surfaces) {
+      setup_swapchain_buffers(ctx, surface);
+    }
+  });
+
+  /* Uploads to device memory (its command buffers use the pool) */
+  TaskId staging = add_task(graph, "staging_ring", [&ctx] {
+    init_staging_ring(ctx);
+  }, {swapchain});
 
   /* Application's geometry data setup */
-  setup_data_buffer(ctx);
+  TaskId data = add_task(graph, "data_buffer", [&ctx] {
+    setup_data_buffer(ctx);
+  }, {staging});
 
   /* Set pipeline input binding layout */
-  setup_descriptor_layout(ctx);
-
-  /* Bind render buffer and their use to pipeline passes */
-  setup_render_pass(ctx);
+  TaskId layout = add_task(graph, "descriptor_layout", [&ctx] {
+    setup_descriptor_layout(ctx);
+  });
+
+  /* Pipeline cache and compilation workers */
+  TaskId pipeline_manager = add_task(graph, "pipeline_manager", [&ctx] {
+    init_pipeline_manager(ctx);
+  });
+
+  /* Shader binaries loading */
+  TaskId shaders = add_task(graph, "shader_modules", [&ctx] {
+    load_shader_modules(ctx, main_pipeline_desc(ctx));
+  }, {pipeline_manager, layout});
+
+  /* Kept depth, Hi-Z pyramid and its reduction pipeline */
+  TaskId occlusion = add_task(graph, "occlusion", [&ctx] {
+    init_occlusion(ctx);
+  }, {swapchain, pipeline_manager});
+
+  /* Passes of the frame, their render passes and attachments, per surface */
+  TaskId render_graph = add_task(graph, "render_graph", [&ctx] {
+    for (auto &surface : ctx.surfaces) {
+      setup_render_graph(ctx, surface);
+    }
+  }, {swapchain, occlusion});
 
   /* Pipeline states, stages and bind layout */
-  setup_pipeline(ctx);
-
+  TaskId pipeline = add_task(graph, "pipeline", [&ctx] {
+    setup_pipeline(ctx);
+  }, {shaders, render_graph});
+
+  /* Texture file loading and upload */
+  TaskId texture = add_task(graph, "texture", [&ctx] {
+    setup_texture(ctx);
+  }, {staging});
+
+  /* Built-in and loaded meshes, uploaded through the staging ring */
+  TaskId meshes = add_task(graph, "meshes", [&ctx] {
+    init_mesh_store(ctx);
+
+    const std::string &filename = ctx.app.options.mesh;
+    if (!filename.empty() && !load_mesh(ctx, filename.c_str(), ctx.scene.mesh)) {
+      ctx.scene.mesh = kTriangleMesh;
+    }
+  }, {staging});
 
   /* Descriptor pool & set for image / texture */
-  setup_descriptor(ctx);
-
-  /**/
-  setup_framebuffers(ctx);
+  TaskId descriptor = add_task(graph, "descriptor", [&ctx] {
+    setup_descriptor(ctx);
+  }, {layout, data, texture});
+
+  /* Frame slots synchronization */
+  TaskId frame_scheduler = add_task(graph, "frame_scheduler", [&ctx] {
+    init_frame_scheduler(ctx);
+  }, {swapchain});
+
+  /* Instance buffer of the draws, and the default material */
+  TaskId draw_list = add_task(graph, "draw_list", [&ctx] {
+    init_draw_list(ctx);
+    add_draw_material(ctx, ctx.pipelineHandle, ctx.descSet);
+  }, {pipeline, descriptor});
+
+  /* Frame timestamps queries (their command buffers use the pool) */
+  TaskId frame_timing = add_task(graph, "frame_timing", [&ctx] {
+    init_frame_timing(ctx);
+  }, {staging});
+
+  add_task(graph, "draw_cmds", [&ctx] {
+    for (auto &surface : ctx.surfaces) {
+      for (uint32_t i = 0u; i < surface.numSwapchainImages; ++i) {
+        setup_buffer_draw_cmd(ctx, surface, i);
+      }
+    }
+  }, {render_graph, pipeline, descriptor, frame_scheduler, frame_timing, draw_list, meshes});
 
-  for (uint32_t i = 0u; i < ctx.numSwapchainImages; ++i) {
-    setup_buffer_draw_cmd(ctx, i);
-  }
+  ThreadPool pool;
+  thread_pool_init(pool);
+  run_task_graph(graph, pool);
+  thread_pool_release(pool);
 
+  print_task_graph_timings(graph, "setup");
 
   //vkDeviceWaitIdle(ctx.device);
   flush_init_cmd(ctx); //
 }
 
+// ----------------------------------------------------------------------------
+
+void release_vk_data(VulkanContext &ctx) {
+  PROFILE_FUNCTION();
+
+  /* Wait for the frames in flight, then for any other pending work */
+  release_frame_scheduler(ctx);
+  vkDeviceWaitIdle(ctx.device);
+
+  /* Latency report and timestamp queries */
+  release_frame_timing(ctx);
+
+  /* Resources retired by the last frames */
+  release_deletion_queue(ctx);
+
+  /* Instance buffer and meshes */
+  release_draw_list(ctx);
+  release_mesh_store(ctx);
+
+  /* Staging ring and frame readbacks */
+  release_staging_ring(ctx);
+  release_capture(ctx);
+
+  /* Pipelines, shader modules and pipeline cache */
+  release_pipeline_manager(ctx);
+  ctx.pipelineHandle = 0u;
+  ctx.pipeline = VK_NULL_HANDLE;
+
+  /* Render passes, framebuffers and attachments of the frame, per surface */
+  for (auto &surface : ctx.surfaces) {
+    release_render_graph(ctx, *surface.renderGraph);
+    delete surface.renderGraph;
+    surface.renderGraph = nullptr;
+  }
+  ctx.renderPass = VK_NULL_HANDLE;
+
+  /* Kept depth and Hi-Z, once the framebuffers using them are gone */
+  release_occlusion(ctx);
+
+  /* Descriptors (the set is freed with its pool) and layouts */
+  vkDestroyDescriptorPool(ctx.device, ctx.descPool, nullptr);
+  ctx.descPool = VK_NULL_HANDLE;
+  ctx.descSet = VK_NULL_HANDLE;
+
+  vkDestroyPipelineLayout(ctx.device, ctx.pipelineLayout, nullptr);
+  vkDestroyDescriptorSetLayout(ctx.device, ctx.descLayout, nullptr);
+  ctx.pipelineLayout = VK_NULL_HANDLE;
+  ctx.descLayout = VK_NULL_HANDLE;
+
+  /* Texture and samplers */
+  release_texture(ctx, ctx.texture);
+  release_sampler_cache(ctx);
+  ctx.sampler = VK_NULL_HANDLE;
+
+  /* Uniform buffer */
+  vkDestroyBuffer(ctx.device, ctx.uniformData.buffer, nullptr);
+  vkFreeMemory(ctx.device, ctx.uniformData.mem, nullptr);
+  ctx.uniformData.buffer = VK_NULL_HANDLE;
+  ctx.uniformData.mem = VK_NULL_HANDLE;
+
+  /* Swapchains */
+  for (auto &surface : ctx.surfaces) {
+    release_swapchain_buffers(ctx, surface.swapchainBuffers, surface.numSwapchainImages);
+    surface.swapchainBuffers = nullptr;
+    surface.numSwapchainImages = 0u;
+    surface.imageValues.clear();
+
+    ctx.ext.fpDestroySwapchainKHR(ctx.device, surface.swapchain, nullptr);
+    surface.swapchain = VK_NULL_HANDLE;
+  }
+
+  /* Command pool */
+  if (ctx.initCmdBuffer != VK_NULL_HANDLE) {
+    vkFreeCommandBuffers(ctx.device, ctx.cmdPool, 1u, &ctx.initCmdBuffer);
+    ctx.initCmdBuffer = VK_NULL_HANDLE;
+  }
+  vkDestroyCommandPool(ctx.device, ctx.cmdPool, nullptr);
+  ctx.cmdPool = VK_NULL_HANDLE;
+}
+
 // ============================================================================
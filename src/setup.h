@@ -6,6 +6,9 @@
 /* Initialize app specific vulkan objects */
 void setup_vk_data(VulkanContext &ctx);
 
+/* Destroy the objects created by setup_vk_data, waiting for the GPU first */
+void release_vk_data(VulkanContext &ctx);
+
 /**/
 void set_buffer_image_layout(VulkanContext &ctx,
                              VkImage image,
@@ -16,4 +19,15 @@ void set_buffer_image_layout(VulkanContext &ctx,
 /**/
 void flush_init_cmd(VulkanContext &ctx);
 
+/* Find a memory type of typeBits with the requirementsMask properties */
+bool retrieve_memory_type_index(const VkPhysicalDeviceMemoryProperties &props,
+                                const uint32_t typeBits,
+                                const VkFlags requirementsMask,
+                                uint32_t *typeIndex);
+
+/* Record the draw commands of a surface's swapchain buffer */
+void setup_buffer_draw_cmd(VulkanContext &ctx,
+                           SurfaceContext &surface,
+                           const unsigned int buffer_index);
+
 #endif  // SETUP_H_
\ No newline at end of file
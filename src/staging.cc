@@ -0,0 +1,403 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include "vulkan/vulkan.h"
+#include "profiler.h"
+#include "setup.h"
+#include "staging.h"
+
+// ============================================================================
+
+static
+uint64_t align_offset(const uint64_t offset, const uint64_t alignment) {
+  return ((offset + alignment - 1u) / alignment) * alignment;
+}
+
+// ----------------------------------------------------------------------------
+
+void init_staging_ring(VulkanContext &ctx, const VkDeviceSize size) {
+  PROFILE_FUNCTION();
+
+  assert(ctx.stagingRing == nullptr);
+  ctx.stagingRing = new StagingRing();
+  StagingRing &ring = *ctx.stagingRing;
+
+  VkResult err;
+
+  ring.size = size;
+
+  /* Host buffer used as copy source */
+  VkBufferCreateInfo bufferInfo;
+  memset(&bufferInfo, 0, sizeof(bufferInfo));
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = size;
+  bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  err = vkCreateBuffer(ctx.device, &bufferInfo, nullptr, &ring.buffer);
+  assert(!err);
+
+  VkMemoryRequirements memReqs;
+  vkGetBufferMemoryRequirements(ctx.device, ring.buffer, &memReqs);
+
+  VkMemoryAllocateInfo allocInfo;
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.pNext = nullptr;
+  allocInfo.allocationSize = memReqs.size;
+  allocInfo.memoryTypeIndex = 0u;
+
+  bool res = retrieve_memory_type_index(
+    ctx.properties.memory,
+    memReqs.memoryTypeBits,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+    &allocInfo.memoryTypeIndex
+  );
+  assert(res);
+
+  err = vkAllocateMemory(ctx.device, &allocInfo, nullptr, &ring.mem);
+  assert(!err);
+
+  err = vkBindBufferMemory(ctx.device, ring.buffer, ring.mem, 0u);
+  assert(!err);
+
+  /* Mapped for the lifetime of the ring */
+  err = vkMapMemory(ctx.device, ring.mem, 0u, size, 0u, (void**)&ring.mapped);
+  assert(!err);
+
+  /* Copy command buffers */
+  VkCommandBufferAllocateInfo cmdInfo;
+  cmdInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  cmdInfo.pNext = nullptr;
+  cmdInfo.commandPool = ctx.cmdPool;
+  cmdInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  cmdInfo.commandBufferCount = kMaxFramesInFlight;
+
+  err = vkAllocateCommandBuffers(ctx.device, &cmdInfo, ring.cmds);
+  assert(!err);
+
+  /* Flush command buffer, reset with its pool */
+  VkCommandPoolCreateInfo poolInfo;
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.pNext = nullptr;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+  poolInfo.queueFamilyIndex = ctx.selected_queue_index;
+
+  err = vkCreateCommandPool(ctx.device, &poolInfo, nullptr, &ring.flushPool);
+  assert(!err);
+
+  cmdInfo.commandPool = ring.flushPool;
+  cmdInfo.commandBufferCount = 1u;
+
+  err = vkAllocateCommandBuffers(ctx.device, &cmdInfo, &ring.flushCmd);
+  assert(!err);
+
+  VkFenceCreateInfo fenceInfo;
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fenceInfo.pNext = nullptr;
+  fenceInfo.flags = 0u;
+
+  err = vkCreateFence(ctx.device, &fenceInfo, nullptr, &ring.flushFence);
+  assert(!err);
+}
+
+// ----------------------------------------------------------------------------
+
+void release_staging_ring(VulkanContext &ctx) {
+  if (ctx.stagingRing == nullptr) {
+    return;
+  }
+  StagingRing &ring = *ctx.stagingRing;
+
+  fprintf(stdout, "staging ring : %llu bytes uploaded, %u stall(s), %u flush(es)\n",
+          (unsigned long long)ring.stats.bytes, ring.stats.stalls, ring.stats.flushes);
+
+  vkFreeCommandBuffers(ctx.device, ctx.cmdPool, kMaxFramesInFlight, ring.cmds);
+  vkDestroyFence(ctx.device, ring.flushFence, nullptr);
+  vkDestroyCommandPool(ctx.device, ring.flushPool, nullptr);
+  vkUnmapMemory(ctx.device, ring.mem);
+  vkDestroyBuffer(ctx.device, ring.buffer, nullptr);
+  vkFreeMemory(ctx.device, ring.mem, nullptr);
+
+  delete ctx.stagingRing;
+  ctx.stagingRing = nullptr;
+}
+
+// ----------------------------------------------------------------------------
+
+/* Release the frames completed by the GPU, return true if any was */
+static
+bool reclaim_staging_frames(VulkanContext &ctx, StagingRing &ring) {
+  if (ring.inflight.empty()) {
+    return false;
+  }
+
+  const uint64_t completed = poll_frame_value(ctx);
+
+  bool bReclaimed = false;
+  while (!ring.inflight.empty() && (ring.inflight.front().value <= completed)) {
+    ring.tail = ring.inflight.front().end;
+    ring.inflight.pop_front();
+    bReclaimed = true;
+  }
+  return bReclaimed;
+}
+
+// ----------------------------------------------------------------------------
+
+/* Record the pending copies into cmd and clear them, the ring must be locked */
+static
+void record_pending_copies(StagingRing &ring, VkCommandBuffer cmd) {
+  VkResult err;
+
+  VkCommandBufferBeginInfo beginInfo;
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.pNext = nullptr;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  beginInfo.pInheritanceInfo = nullptr;
+
+  err = vkBeginCommandBuffer(cmd, &beginInfo);
+  assert(!err);
+
+  /* One copy command per destination buffer */
+  auto &copies = ring.bufferCopies;
+  std::stable_sort(copies.begin(), copies.end(),
+    [](const StagingRing::BufferCopy &a, const StagingRing::BufferCopy &b) {
+      return a.dst < b.dst;
+    }
+  );
+
+  std::vector<VkBufferCopy> regions;
+  regions.reserve(copies.size());
+
+  for (size_t i = 0u; i < copies.size(); ++i) {
+    regions.push_back(copies[i].region);
+
+    if ((i + 1u == copies.size()) || (copies[i + 1u].dst != copies[i].dst)) {
+      vkCmdCopyBuffer(cmd, ring.buffer, copies[i].dst, regions.size(), regions.data());
+      regions.clear();
+    }
+  }
+
+  /* Custom uploads handle their own synchronization */
+  for (const auto &upload : ring.customUploads) {
+    upload.record(cmd, ring.buffer, upload.offset);
+  }
+
+  /* Make the copies visible to the frame draws */
+  VkMemoryBarrier barrier;
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.pNext = nullptr;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask =   VK_ACCESS_INDEX_READ_BIT
+                          | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT
+                          | VK_ACCESS_UNIFORM_READ_BIT
+                          | VK_ACCESS_SHADER_READ_BIT;
+
+  vkCmdPipelineBarrier(
+    cmd,
+    VK_PIPELINE_STAGE_TRANSFER_BIT,
+    VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+                                       | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+    0u,
+    1u, &barrier,
+    0u, nullptr,
+    0u, nullptr
+  );
+
+  err = vkEndCommandBuffer(cmd);
+  assert(!err);
+
+  copies.clear();
+  ring.customUploads.clear();
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+* Submit the pending copies alone and wait for them, the ring must be locked.
+* Only the ring submits while the setup tasks run, and frames are submitted
+* by the thread uploading to the ring, so the queue is not used concurrently.
+*/
+static
+void flush_staging_copies(VulkanContext &ctx, StagingRing &ring) {
+  PROFILE_FUNCTION();
+
+  VkResult err;
+
+  err = vkResetCommandPool(ctx.device, ring.flushPool, 0u);
+  assert(!err);
+
+  record_pending_copies(ring, ring.flushCmd);
+
+  VkSubmitInfo info;
+  memset(&info, 0, sizeof(info));
+  info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  info.commandBufferCount = 1u;
+  info.pCommandBuffers = &ring.flushCmd;
+
+  err = vkQueueSubmit(ctx.queue, 1u, &info, ring.flushFence);
+  assert(!err);
+
+  err = vkWaitForFences(ctx.device, 1u, &ring.flushFence, VK_TRUE, UINT64_MAX);
+  assert(!err);
+
+  err = vkResetFences(ctx.device, 1u, &ring.flushFence);
+  assert(!err);
+}
+
+// ----------------------------------------------------------------------------
+
+/* Allocate a range of the ring, the ring must be locked */
+static
+VkDeviceSize staging_alloc(VulkanContext &ctx,
+                           StagingRing &ring,
+                           const VkDeviceSize size,
+                           const VkDeviceSize alignment) {
+  assert((ring.size % alignment) == 0u);
+  assert(size <= ring.size);
+
+  for (;;) {
+    uint64_t offset = align_offset(ring.head, alignment);
+
+    // allocations do not straddle the end of the buffer
+    if ((offset % ring.size) + size > ring.size) {
+      offset = align_offset(offset, ring.size);
+    }
+
+    if (offset + size - ring.tail <= ring.size) {
+      ring.head = offset + size;
+      return offset % ring.size;
+    }
+
+    if (reclaim_staging_frames(ctx, ring)) {
+      continue;
+    }
+
+    /* Ring full : wait for the oldest frame using it */
+    if (!ring.inflight.empty()) {
+      ++ring.stats.stalls;
+      fprintf(stderr, "dev warning : staging ring full, waiting for frame %llu.\n",
+              (unsigned long long)ring.inflight.front().value);
+
+      PROFILE_ZONE("staging_stall");
+      wait_frame_value(ctx, ring.inflight.front().value);
+      continue;
+    }
+
+    /* or by the pending copies : submit them ahead of their frame */
+    assert(!ring.bRecorded);
+    if (!ring.bufferCopies.empty() || !ring.customUploads.empty()) {
+      ++ring.stats.flushes;
+      flush_staging_copies(ctx, ring);
+    }
+
+    /* Nothing in use, restart at the beginning of the buffer */
+    ring.head = align_offset(ring.head, ring.size);
+    ring.tail = ring.head;
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+void stage_buffer_upload(VulkanContext &ctx,
+                         VkBuffer dst,
+                         const VkDeviceSize dst_offset,
+                         const void *data,
+                         const VkDeviceSize size)
+{
+  assert(ctx.stagingRing != nullptr);
+  StagingRing &ring = *ctx.stagingRing;
+
+  std::lock_guard<std::mutex> lock(ring.mutex);
+
+  /* Data larger than the ring is copied in ring sized ranges */
+  const uint8_t *bytes = static_cast<const uint8_t*>(data);
+
+  for (VkDeviceSize done = 0u; done < size;) {
+    const VkDeviceSize range = std::min(size - done, ring.size);
+
+    const VkDeviceSize offset = staging_alloc(ctx, ring, range, 16u);
+    memcpy(ring.mapped + offset, bytes + done, range);
+
+    StagingRing::BufferCopy copy;
+    copy.dst = dst;
+    copy.region.srcOffset = offset;
+    copy.region.dstOffset = dst_offset + done;
+    copy.region.size = range;
+    ring.bufferCopies.push_back(copy);
+
+    done += range;
+  }
+
+  ring.stats.bytes += size;
+}
+
+// ----------------------------------------------------------------------------
+
+void stage_upload(VulkanContext &ctx,
+                  const VkDeviceSize size,
+                  const VkDeviceSize alignment,
+                  const StagingFillFn &fill,
+                  StagingRecordFn record)
+{
+  assert(ctx.stagingRing != nullptr);
+  StagingRing &ring = *ctx.stagingRing;
+
+  std::lock_guard<std::mutex> lock(ring.mutex);
+
+  const VkDeviceSize offset = staging_alloc(ctx, ring, size, alignment);
+  fill(ring.mapped + offset);
+
+  StagingRing::CustomUpload upload;
+  upload.offset = offset;
+  upload.record = std::move(record);
+  ring.customUploads.push_back(std::move(upload));
+
+  ring.stats.bytes += size;
+}
+
+// ----------------------------------------------------------------------------
+
+VkCommandBuffer record_staging_copies(VulkanContext &ctx) {
+  StagingRing &ring = *ctx.stagingRing;
+
+  std::lock_guard<std::mutex> lock(ring.mutex);
+
+  if (ring.bufferCopies.empty() && ring.customUploads.empty()) {
+    return VK_NULL_HANDLE;
+  }
+
+  PROFILE_FUNCTION();
+
+  /* The command buffer of the slot is free since begin_frame */
+  VkCommandBuffer cmd = ring.cmds[ctx.frameScheduler->slotIndex];
+  record_pending_copies(ring, cmd);
+
+  ring.recordedEnd = ring.head;
+  ring.bRecorded = true;
+
+  return cmd;
+}
+
+// ----------------------------------------------------------------------------
+
+void end_staging_frame(VulkanContext &ctx, const uint64_t value) {
+  StagingRing &ring = *ctx.stagingRing;
+
+  std::lock_guard<std::mutex> lock(ring.mutex);
+
+  if (!ring.bRecorded) {
+    return;
+  }
+
+  StagingRing::Frame frame;
+  frame.value = value;
+  frame.end = ring.recordedEnd;
+  ring.inflight.push_back(frame);
+
+  ring.bRecorded = false;
+}
+
+// ============================================================================
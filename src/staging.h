@@ -0,0 +1,116 @@
+#ifndef STAGING_H_
+#define STAGING_H_
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "common.h"
+#include "frame_scheduler.h"
+
+/* Default size of the staging ring */
+const VkDeviceSize kStagingRingSize = 8u * 1024u * 1024u;
+
+/* Write the data of a custom upload to its mapped ring range */
+typedef std::function<void(uint8_t *dst)> StagingFillFn;
+
+/* Record the commands reading a custom upload from the ring buffer */
+typedef std::function<void(VkCommandBuffer cmd, VkBuffer src, VkDeviceSize src_offset)> StagingRecordFn;
+
+/**
+* Persistently mapped host buffer, through which data is uploaded to device
+* local memory.
+* Allocations are made on monotonic offsets (wrapped on the buffer size) and
+* released when the frame value of their copies is completed by the GPU.
+* The copies of a frame are batched in a single command buffer, submitted
+* ahead of the frame's draw commands. When they fill the ring by themselves
+* (eg. during setup), they are flushed : submitted alone and waited for.
+*/
+struct StagingRing {
+  struct BufferCopy {
+    VkBuffer dst;
+    VkBufferCopy region;
+  };
+
+  struct Frame {
+    uint64_t value;       // frame value of the copies
+    uint64_t end;         // offset past the frame's last allocation
+  };
+
+  std::mutex mutex;
+
+  VkBuffer buffer = VK_NULL_HANDLE;
+  VkDeviceMemory mem = VK_NULL_HANDLE;
+  uint8_t *mapped = nullptr;
+  VkDeviceSize size = 0u;
+
+  uint64_t head = 0u;     // next allocation offset
+  uint64_t tail = 0u;     // oldest offset still used by the GPU
+  uint64_t recordedEnd = 0u;  // head when the frame copies were recorded
+  std::deque<Frame> inflight;
+
+  struct CustomUpload {
+    VkDeviceSize offset;
+    StagingRecordFn record;
+  };
+
+  /* copies of the current frame */
+  std::vector<BufferCopy> bufferCopies;
+  std::vector<CustomUpload> customUploads;
+
+  /* one command buffer per frame slot */
+  VkCommandBuffer cmds[kMaxFramesInFlight];
+  bool bRecorded = false;
+
+  /* flush of the copies, with its own pool as it can happen on setup tasks */
+  VkCommandPool flushPool = VK_NULL_HANDLE;
+  VkCommandBuffer flushCmd = VK_NULL_HANDLE;
+  VkFence flushFence = VK_NULL_HANDLE;
+
+  struct {
+    uint32_t stalls = 0u;
+    uint32_t flushes = 0u;
+    VkDeviceSize bytes = 0u;
+  } stats;
+};
+
+/**/
+void init_staging_ring(VulkanContext &ctx, const VkDeviceSize size = kStagingRingSize);
+
+/* Destroy the ring, the device must be idle */
+void release_staging_ring(VulkanContext &ctx);
+
+/**
+* Copy data to a buffer range with the next frame.
+* Waits for older frames when the ring is full (reported as a stall), data
+* larger than the ring is split in ring sized copies.
+*/
+void stage_buffer_upload(VulkanContext &ctx,
+                         VkBuffer dst,
+                         const VkDeviceSize dst_offset,
+                         const void *data,
+                         const VkDeviceSize size);
+
+/**
+* Upload size bytes written by fill, and read by the commands of record
+* (eg. image copies and layout transitions) with the next frame.
+* src_offset is a multiple of alignment, size must not exceed the ring size
+* (larger uploads are split by the caller, eg. per mip level).
+*/
+void stage_upload(VulkanContext &ctx,
+                  const VkDeviceSize size,
+                  const VkDeviceSize alignment,
+                  const StagingFillFn &fill,
+                  StagingRecordFn record);
+
+/**
+* Record the pending copies of the frame.
+* @return the command buffer to submit first, or VK_NULL_HANDLE when empty.
+*/
+VkCommandBuffer record_staging_copies(VulkanContext &ctx);
+
+/* Tag the frame allocations with the value of their submission */
+void end_staging_frame(VulkanContext &ctx, const uint64_t value);
+
+#endif  // STAGING_H_
@@ -0,0 +1,121 @@
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <map>
+
+#include "task_graph.h"
+
+// ============================================================================
+
+TaskId add_task(TaskGraph &graph,
+                const char *name,
+                std::function<void()> fn,
+                std::initializer_list<TaskId> dependencies)
+{
+  const TaskId id = static_cast<TaskId>(graph.tasks.size());
+
+  TaskGraph::Task task;
+  task.name = name;
+  task.fn = std::move(fn);
+  task.num_dependencies = static_cast<uint32_t>(dependencies.size());
+  graph.tasks.push_back(std::move(task));
+
+  for (TaskId dep : dependencies) {
+    // dependencies must be added first, which keeps the graph acyclic
+    assert(dep < id);
+    graph.tasks[dep].dependents.push_back(id);
+  }
+
+  return id;
+}
+
+// ----------------------------------------------------------------------------
+
+void run_task_graph(TaskGraph &graph, ThreadPool &pool) {
+  typedef std::chrono::steady_clock Clock;
+
+  if (graph.tasks.empty()) {
+    return;
+  }
+
+  /* Shared execution state */
+  struct {
+    std::mutex mutex;
+    std::condition_variable cv_done;
+    std::vector<uint32_t> remaining_deps;
+    size_t remaining_tasks;
+    Clock::time_point start;
+  } state;
+  state.remaining_tasks = graph.tasks.size();
+  state.start = Clock::now();
+  state.remaining_deps.reserve(graph.tasks.size());
+  for (const auto &task : graph.tasks) {
+    state.remaining_deps.push_back(task.num_dependencies);
+  }
+
+  /* Run a task then schedule the dependents it unlocked */
+  std::function<void(TaskId)> schedule;
+  schedule = [&graph, &pool, &state, &schedule](TaskId id) {
+    thread_pool_submit(pool, [&graph, &state, &schedule, id] {
+      TaskGraph::Task &task = graph.tasks[id];
+
+      const Clock::time_point t0 = Clock::now();
+      task.fn();
+      const Clock::time_point t1 = Clock::now();
+
+      typedef std::chrono::duration<double, std::milli> Milliseconds;
+      task.start_ms = Milliseconds(t0 - state.start).count();
+      task.duration_ms = Milliseconds(t1 - t0).count();
+      task.thread = std::this_thread::get_id();
+
+      std::vector<TaskId> ready;
+      {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        for (TaskId dep : task.dependents) {
+          if (--state.remaining_deps[dep] == 0u) {
+            ready.push_back(dep);
+          }
+        }
+      }
+      for (TaskId dep : ready) {
+        schedule(dep);
+      }
+
+      std::lock_guard<std::mutex> lock(state.mutex);
+      if (--state.remaining_tasks == 0u) {
+        state.cv_done.notify_one();
+      }
+    });
+  };
+
+  /* Start with the tasks without dependencies */
+  for (TaskId id = 0u; id < graph.tasks.size(); ++id) {
+    if (graph.tasks[id].num_dependencies == 0u) {
+      schedule(id);
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(state.mutex);
+  state.cv_done.wait(lock, [&state] { return state.remaining_tasks == 0u; });
+}
+
+// ----------------------------------------------------------------------------
+
+void print_task_graph_timings(const TaskGraph &graph, const char *label) {
+  /* Threads are numbered by order of appearance */
+  std::map<std::thread::id, unsigned int> thread_index;
+  double total_ms = 0.0;
+
+  fprintf(stdout, "[%s] %-24s %10s %10s %7s\n", label, "task", "start(ms)", "time(ms)", "thread");
+  for (const auto &task : graph.tasks) {
+    auto it = thread_index.insert(std::make_pair(task.thread, thread_index.size()));
+    fprintf(stdout, "[%s] %-24s %10.3f %10.3f %7u\n",
+            label, task.name, task.start_ms, task.duration_ms, it.first->second);
+
+    const double end_ms = task.start_ms + task.duration_ms;
+    total_ms = (end_ms > total_ms) ? end_ms : total_ms;
+  }
+  fprintf(stdout, "[%s] total %.3f ms\n", label, total_ms);
+}
+
+// ============================================================================
@@ -0,0 +1,42 @@
+#ifndef TASK_GRAPH_H_
+#define TASK_GRAPH_H_
+
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <vector>
+
+#include "thread_pool.h"
+
+typedef uint32_t TaskId;
+
+/* Set of tasks with dependencies, executed on a thread pool */
+struct TaskGraph {
+  struct Task {
+    const char *name;
+    std::function<void()> fn;
+    std::vector<TaskId> dependents;   // tasks waiting on this one
+    uint32_t num_dependencies = 0u;
+
+    /* timings relative to the start of the graph, in milliseconds */
+    double start_ms = 0.0;
+    double duration_ms = 0.0;
+    std::thread::id thread;
+  };
+
+  std::vector<Task> tasks;
+};
+
+/* Add a task run once all of its dependencies have completed */
+TaskId add_task(TaskGraph &graph,
+                const char *name,
+                std::function<void()> fn,
+                std::initializer_list<TaskId> dependencies = {});
+
+/* Run every task of the graph on the pool and block until they are done */
+void run_task_graph(TaskGraph &graph, ThreadPool &pool);
+
+/* Print the per-task timings of the last run */
+void print_task_graph_timings(const TaskGraph &graph, const char *label);
+
+#endif  // TASK_GRAPH_H_
@@ -0,0 +1,769 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "vulkan/vulkan.h"
+#include "hash.h"
+#include "profiler.h"
+#include "setup.h"
+#include "staging.h"
+#include "texture.h"
+
+// ============================================================================
+
+/* Mip levels of a texture file, pointing to its mapped content */
+struct TextureData {
+  VkFormat format = VK_FORMAT_UNDEFINED;
+  uint32_t width = 0u;
+  uint32_t height = 0u;
+  std::vector<const uint8_t*> levels;
+  std::vector<VkDeviceSize> levelSizes;
+};
+
+// ----------------------------------------------------------------------------
+
+/* Return the size of a 4x4 texel block for BC formats, 0 otherwise */
+static
+uint32_t block_size(const VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+      return 8u;
+
+    case VK_FORMAT_BC2_UNORM_BLOCK:
+    case VK_FORMAT_BC2_SRGB_BLOCK:
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+      return 16u;
+
+    default:
+      return 0u;
+  };
+}
+
+// ----------------------------------------------------------------------------
+
+static
+VkDeviceSize level_size(const VkFormat format, const uint32_t width, const uint32_t height) {
+  const uint32_t block = block_size(format);
+  if (block > 0u) {
+    return VkDeviceSize(std::max(1u, (width + 3u) / 4u))
+         * VkDeviceSize(std::max(1u, (height + 3u) / 4u))
+         * block;
+  }
+  // uncompressed formats are all 32bits
+  return VkDeviceSize(width) * height * 4u;
+}
+
+// ----------------------------------------------------------------------------
+
+/* Fill the levels from consecutive data, return false if it overflows */
+static
+bool read_levels(const uint8_t *data,
+                 const uint8_t *end,
+                 const uint32_t levelCount,
+                 TextureData &out) {
+  for (uint32_t i = 0u; i < levelCount; ++i) {
+    const uint32_t w = std::max(1u, out.width >> i);
+    const uint32_t h = std::max(1u, out.height >> i);
+    const VkDeviceSize size = level_size(out.format, w, h);
+
+    if (VkDeviceSize(end - data) < size) {
+      return false;
+    }
+    out.levels.push_back(data);
+    out.levelSizes.push_back(size);
+    data += size;
+  }
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+
+/* Return false, with an error, for an empty extent or more levels than its chain */
+static
+bool check_texture_extent(const uint32_t width,
+                          const uint32_t height,
+                          const uint32_t levelCount) {
+  if ((width == 0u) || (height == 0u)) {
+    fprintf(stderr, "Texture error : empty texture extent (%ux%u).\n", width, height);
+    return false;
+  }
+
+  uint32_t maxLevels = 1u;
+  for (uint32_t extent = std::max(width, height); extent > 1u; extent >>= 1u) {
+    ++maxLevels;
+  }
+  if (levelCount > maxLevels) {
+    fprintf(stderr, "Texture error : %u mip levels for a %ux%u texture.\n",
+            levelCount, width, height);
+    return false;
+  }
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+// KTX (version 1)
+// ----------------------------------------------------------------------------
+
+struct KTXHeader {
+  uint8_t identifier[12u];
+  uint32_t endianness;
+  uint32_t glType;
+  uint32_t glTypeSize;
+  uint32_t glFormat;
+  uint32_t glInternalFormat;
+  uint32_t glBaseInternalFormat;
+  uint32_t pixelWidth;
+  uint32_t pixelHeight;
+  uint32_t pixelDepth;
+  uint32_t numberOfArrayElements;
+  uint32_t numberOfFaces;
+  uint32_t numberOfMipmapLevels;
+  uint32_t bytesOfKeyValueData;
+};
+
+static
+VkFormat ktx_format(const uint32_t glInternalFormat) {
+  switch (glInternalFormat) {
+    case 0x8058: return VK_FORMAT_R8G8B8A8_UNORM;       // GL_RGBA8
+    case 0x8C43: return VK_FORMAT_R8G8B8A8_SRGB;        // GL_SRGB8_ALPHA8
+    case 0x83F0: return VK_FORMAT_BC1_RGB_UNORM_BLOCK;  // GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+    case 0x83F1: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK; // GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+    case 0x83F2: return VK_FORMAT_BC2_UNORM_BLOCK;      // GL_COMPRESSED_RGBA_S3TC_DXT3_EXT
+    case 0x83F3: return VK_FORMAT_BC3_UNORM_BLOCK;      // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+    case 0x8E8C: return VK_FORMAT_BC7_UNORM_BLOCK;      // GL_COMPRESSED_RGBA_BPTC_UNORM
+    case 0x8E8D: return VK_FORMAT_BC7_SRGB_BLOCK;       // GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+    default:     return VK_FORMAT_UNDEFINED;
+  };
+}
+
+static
+bool parse_ktx(const uint8_t *bytes, const size_t size, TextureData &out) {
+  static const uint8_t kIdentifier[12u] = {
+    0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'
+  };
+
+  KTXHeader header;
+  if ((size < sizeof(header)) || memcmp(bytes, kIdentifier, sizeof(kIdentifier))) {
+    return false;
+  }
+  memcpy(&header, bytes, sizeof(header));
+
+  if (header.endianness != 0x04030201) {
+    fprintf(stderr, "Texture error : big endian KTX files are not supported.\n");
+    return false;
+  }
+  if (  (header.pixelDepth > 1u) || (header.numberOfArrayElements > 0u)
+     || (header.numberOfFaces != 1u)) {
+    fprintf(stderr, "Texture error : only 2D KTX textures are supported.\n");
+    return false;
+  }
+
+  out.format = ktx_format(header.glInternalFormat);
+  out.width = header.pixelWidth;
+  out.height = header.pixelHeight;
+
+  if (out.format == VK_FORMAT_UNDEFINED) {
+    fprintf(stderr, "Texture error : unsupported KTX internal format 0x%x.\n",
+            header.glInternalFormat);
+    return false;
+  }
+
+  const uint32_t levelCount = std::max(1u, header.numberOfMipmapLevels);
+  if (!check_texture_extent(out.width, out.height, levelCount)) {
+    return false;
+  }
+
+  /* Offsets are checked against the bytes left, never past the end */
+  if (header.bytesOfKeyValueData > size - sizeof(header)) {
+    return false;
+  }
+  const uint8_t *data = bytes + sizeof(header) + header.bytesOfKeyValueData;
+  VkDeviceSize left = size - sizeof(header) - header.bytesOfKeyValueData;
+
+  /* each level is prefixed by its size, and padded to 4 bytes */
+  for (uint32_t i = 0u; i < levelCount; ++i) {
+    uint32_t imageSize;
+    if (left < sizeof(imageSize)) {
+      return false;
+    }
+    memcpy(&imageSize, data, sizeof(imageSize));
+    data += sizeof(imageSize);
+    left -= sizeof(imageSize);
+
+    const uint32_t w = std::max(1u, out.width >> i);
+    const uint32_t h = std::max(1u, out.height >> i);
+    const VkDeviceSize expected = level_size(out.format, w, h);
+
+    if ((imageSize < expected) || (left < imageSize)) {
+      return false;
+    }
+    out.levels.push_back(data);
+    out.levelSizes.push_back(expected);
+
+    // the padding of the last level may be missing
+    const VkDeviceSize padded = std::min(VkDeviceSize((imageSize + 3ull) & ~3ull), left);
+    data += padded;
+    left -= padded;
+  }
+
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+// DDS
+// ----------------------------------------------------------------------------
+
+struct DDSPixelFormat {
+  uint32_t size;
+  uint32_t flags;
+  uint32_t fourCC;
+  uint32_t rgbBitCount;
+  uint32_t rMask;
+  uint32_t gMask;
+  uint32_t bMask;
+  uint32_t aMask;
+};
+
+struct DDSHeader {
+  uint32_t size;
+  uint32_t flags;
+  uint32_t height;
+  uint32_t width;
+  uint32_t pitchOrLinearSize;
+  uint32_t depth;
+  uint32_t mipMapCount;
+  uint32_t reserved1[11u];
+  DDSPixelFormat ddspf;
+  uint32_t caps;
+  uint32_t caps2;
+  uint32_t caps3;
+  uint32_t caps4;
+  uint32_t reserved2;
+};
+
+struct DDSHeaderDX10 {
+  uint32_t dxgiFormat;
+  uint32_t resourceDimension;
+  uint32_t miscFlag;
+  uint32_t arraySize;
+  uint32_t miscFlags2;
+};
+
+static
+uint32_t fourcc(const char code[4u]) {
+  return uint32_t(code[0u])         | (uint32_t(code[1u]) << 8u)
+       | (uint32_t(code[2u]) << 16u) | (uint32_t(code[3u]) << 24u);
+}
+
+static
+VkFormat dxgi_format(const uint32_t dxgiFormat) {
+  switch (dxgiFormat) {
+    case 28: return VK_FORMAT_R8G8B8A8_UNORM;       // DXGI_FORMAT_R8G8B8A8_UNORM
+    case 29: return VK_FORMAT_R8G8B8A8_SRGB;        // DXGI_FORMAT_R8G8B8A8_UNORM_SRGB
+    case 87: return VK_FORMAT_B8G8R8A8_UNORM;       // DXGI_FORMAT_B8G8R8A8_UNORM
+    case 91: return VK_FORMAT_B8G8R8A8_SRGB;        // DXGI_FORMAT_B8G8R8A8_UNORM_SRGB
+    case 71: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK; // DXGI_FORMAT_BC1_UNORM
+    case 72: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;  // DXGI_FORMAT_BC1_UNORM_SRGB
+    case 74: return VK_FORMAT_BC2_UNORM_BLOCK;      // DXGI_FORMAT_BC2_UNORM
+    case 75: return VK_FORMAT_BC2_SRGB_BLOCK;       // DXGI_FORMAT_BC2_UNORM_SRGB
+    case 77: return VK_FORMAT_BC3_UNORM_BLOCK;      // DXGI_FORMAT_BC3_UNORM
+    case 78: return VK_FORMAT_BC3_SRGB_BLOCK;       // DXGI_FORMAT_BC3_UNORM_SRGB
+    case 98: return VK_FORMAT_BC7_UNORM_BLOCK;      // DXGI_FORMAT_BC7_UNORM
+    case 99: return VK_FORMAT_BC7_SRGB_BLOCK;       // DXGI_FORMAT_BC7_UNORM_SRGB
+    default: return VK_FORMAT_UNDEFINED;
+  };
+}
+
+static
+VkFormat dds_format(const DDSPixelFormat &pf) {
+  const uint32_t kFourCC = 0x4u;
+  const uint32_t kRGB    = 0x40u;
+
+  if (pf.flags & kFourCC) {
+    if (pf.fourCC == fourcc("DXT1")) return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+    if (pf.fourCC == fourcc("DXT3")) return VK_FORMAT_BC2_UNORM_BLOCK;
+    if (pf.fourCC == fourcc("DXT5")) return VK_FORMAT_BC3_UNORM_BLOCK;
+  } else if ((pf.flags & kRGB) && (pf.rgbBitCount == 32u)) {
+    if (pf.rMask == 0x000000ffu) return VK_FORMAT_R8G8B8A8_UNORM;
+    if (pf.rMask == 0x00ff0000u) return VK_FORMAT_B8G8R8A8_UNORM;
+  }
+  return VK_FORMAT_UNDEFINED;
+}
+
+static
+bool parse_dds(const uint8_t *bytes, const size_t size, TextureData &out) {
+  DDSHeader header;
+  if ((size < 4u + sizeof(header)) || memcmp(bytes, "DDS ", 4u)) {
+    return false;
+  }
+  memcpy(&header, bytes + 4u, sizeof(header));
+
+  const uint8_t *end = bytes + size;
+  const uint8_t *data = bytes + 4u + sizeof(header);
+
+  if ((header.ddspf.flags & 0x4u) && (header.ddspf.fourCC == fourcc("DX10"))) {
+    DDSHeaderDX10 dx10;
+    if (VkDeviceSize(end - data) < sizeof(dx10)) {
+      return false;
+    }
+    memcpy(&dx10, data, sizeof(dx10));
+    data += sizeof(dx10);
+
+    if (dx10.arraySize > 1u) {
+      fprintf(stderr, "Texture error : DDS texture arrays are not supported.\n");
+      return false;
+    }
+    out.format = dxgi_format(dx10.dxgiFormat);
+  } else {
+    out.format = dds_format(header.ddspf);
+  }
+
+  if (out.format == VK_FORMAT_UNDEFINED) {
+    fprintf(stderr, "Texture error : unsupported DDS pixel format.\n");
+    return false;
+  }
+
+  out.width = header.width;
+  out.height = header.height;
+
+  const uint32_t levelCount = std::max(1u, header.mipMapCount);
+  if (!check_texture_extent(out.width, out.height, levelCount)) {
+    return false;
+  }
+
+  return read_levels(data, end, levelCount, out);
+}
+
+// ----------------------------------------------------------------------------
+// Image creation and upload
+// ----------------------------------------------------------------------------
+
+static
+void create_texture_image(VulkanContext &ctx,
+                          const VkFormat format,
+                          const uint32_t width,
+                          const uint32_t height,
+                          const uint32_t mipLevels,
+                          Texture &texture) {
+  VkResult err;
+
+  VkImageCreateInfo imageInfo;
+  memset(&imageInfo, 0, sizeof(imageInfo));
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.format = format;
+  imageInfo.extent = { width, height, 1u };
+  imageInfo.mipLevels = mipLevels;
+  imageInfo.arrayLayers = 1u;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.usage =   VK_IMAGE_USAGE_SAMPLED_BIT
+                    | VK_IMAGE_USAGE_TRANSFER_DST_BIT
+                    | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;    // mip generation
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+  err = vkCreateImage(ctx.device, &imageInfo, nullptr, &texture.image);
+  assert(!err);
+
+  VkMemoryRequirements memReqs;
+  vkGetImageMemoryRequirements(ctx.device, texture.image, &memReqs);
+
+  VkMemoryAllocateInfo allocInfo;
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.pNext = nullptr;
+  allocInfo.allocationSize = memReqs.size;
+  allocInfo.memoryTypeIndex = 0u;
+
+  bool res = retrieve_memory_type_index(
+    ctx.properties.memory,
+    memReqs.memoryTypeBits,
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+    &allocInfo.memoryTypeIndex
+  );
+  assert(res);
+
+  err = vkAllocateMemory(ctx.device, &allocInfo, nullptr, &texture.mem);
+  assert(!err);
+
+  err = vkBindImageMemory(ctx.device, texture.image, texture.mem, 0u);
+  assert(!err);
+
+  VkImageViewCreateInfo viewInfo;
+  memset(&viewInfo, 0, sizeof(viewInfo));
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = texture.image;
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format = format;
+  viewInfo.components = { VK_COMPONENT_SWIZZLE_R,
+                          VK_COMPONENT_SWIZZLE_G,
+                          VK_COMPONENT_SWIZZLE_B,
+                          VK_COMPONENT_SWIZZLE_A };
+  viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0u, mipLevels, 0u, 1u};
+
+  err = vkCreateImageView(ctx.device, &viewInfo, nullptr, &texture.view);
+  assert(!err);
+
+  texture.format = format;
+  texture.width = width;
+  texture.height = height;
+  texture.mipLevels = mipLevels;
+}
+
+// ----------------------------------------------------------------------------
+
+static
+void image_barrier(VkCommandBuffer cmd,
+                   VkImage image,
+                   const uint32_t baseLevel,
+                   const uint32_t levelCount,
+                   VkImageLayout oldLayout,
+                   VkImageLayout newLayout,
+                   VkAccessFlags srcAccess,
+                   VkAccessFlags dstAccess,
+                   VkPipelineStageFlags srcStage,
+                   VkPipelineStageFlags dstStage) {
+  VkImageMemoryBarrier barrier;
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.pNext = nullptr;
+  barrier.srcAccessMask = srcAccess;
+  barrier.dstAccessMask = dstAccess;
+  barrier.oldLayout = oldLayout;
+  barrier.newLayout = newLayout;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, baseLevel, levelCount, 0u, 1u};
+
+  vkCmdPipelineBarrier(cmd, srcStage, dstStage, 0u, 0u, nullptr, 0u, nullptr, 1u, &barrier);
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+* Copy a region of a provided level from the staging buffer. The first copy
+* moves every level to the transfer layout, the last one generates the
+* missing levels by successive blits, then makes them all readable by shaders.
+*/
+static
+void record_texture_copy(VkCommandBuffer cmd,
+                         VkBuffer src,
+                         const VkBufferImageCopy &region,
+                         const Texture &texture,
+                         const uint32_t copiedLevels,
+                         const bool bFirst,
+                         const bool bLast) {
+  const uint32_t mipLevels = texture.mipLevels;
+
+  if (bFirst) {
+    image_barrier(cmd, texture.image, 0u, mipLevels,
+                  VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                  0u, VK_ACCESS_TRANSFER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+  }
+
+  /* Regions are disjoint, copies need no barrier between them */
+  vkCmdCopyBufferToImage(cmd, src, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         1u, &region);
+
+  if (!bLast) {
+    return;
+  }
+
+  /* Each level is downsampled from the previous one */
+  for (uint32_t i = copiedLevels; i < mipLevels; ++i) {
+    image_barrier(cmd, texture.image, i - 1u, 1u,
+                  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                  VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                  VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+    VkImageBlit blit;
+    blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i - 1u, 0u, 1u};
+    blit.srcOffsets[0u] = {0, 0, 0};
+    blit.srcOffsets[1u] = { int32_t(std::max(1u, texture.width >> (i - 1u))),
+                            int32_t(std::max(1u, texture.height >> (i - 1u))), 1 };
+    blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0u, 1u};
+    blit.dstOffsets[0u] = {0, 0, 0};
+    blit.dstOffsets[1u] = { int32_t(std::max(1u, texture.width >> i)),
+                            int32_t(std::max(1u, texture.height >> i)), 1 };
+
+    vkCmdBlitImage(cmd,
+                   texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   1u, &blit, VK_FILTER_LINEAR);
+  }
+
+  /* Blit sources are in TRANSFER_SRC, the others in TRANSFER_DST */
+  const uint32_t srcLevels = mipLevels - copiedLevels;
+  if (srcLevels > 0u) {
+    image_barrier(cmd, texture.image, copiedLevels - 1u, srcLevels,
+                  VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                  VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT,
+                  VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+  }
+
+  const uint32_t dstBase = (srcLevels > 0u) ? mipLevels - 1u : 0u;
+  const uint32_t dstLevels = (srcLevels > 0u) ? 1u : mipLevels;
+  image_barrier(cmd, texture.image, dstBase, dstLevels,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+}
+
+// ----------------------------------------------------------------------------
+
+/* Create the texture image and upload its levels with the next frame */
+static
+void upload_texture(VulkanContext &ctx, const TextureData &data, Texture &texture) {
+  PROFILE_FUNCTION();
+
+  const uint32_t copiedLevels = data.levels.size();
+  const uint32_t block = block_size(data.format);
+
+  /* Generate the missing mip levels when linear blits are supported */
+  uint32_t mipLevels = copiedLevels;
+  if ((copiedLevels == 1u) && (block == 0u)) {
+    const VkFormatFeatureFlags kBlitFeatures =   VK_FORMAT_FEATURE_BLIT_SRC_BIT
+                                               | VK_FORMAT_FEATURE_BLIT_DST_BIT
+                                               | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(ctx.gpu, data.format, &props);
+
+    if ((props.optimalTilingFeatures & kBlitFeatures) == kBlitFeatures) {
+      uint32_t extent = std::max(data.width, data.height);
+      while (extent > 1u) {
+        extent >>= 1u;
+        ++mipLevels;
+      }
+    }
+  }
+
+  create_texture_image(ctx, data.format, data.width, data.height, mipLevels, texture);
+
+  /**
+  * Each level is a separate upload, levels larger than the staging ring are
+  * split in bands of rows (of blocks for BC formats), so that the ring only
+  * needs to hold one band at a time.
+  */
+  const VkDeviceSize kAlignment = 16u;
+  const VkDeviceSize ringSize = ctx.stagingRing->size;
+  const uint32_t rowTexels = (block > 0u) ? 4u : 1u;
+
+  const Texture target = texture;
+
+  for (uint32_t i = 0u; i < copiedLevels; ++i) {
+    const uint32_t w = std::max(1u, data.width >> i);
+    const uint32_t h = std::max(1u, data.height >> i);
+    const uint32_t rows = (h + rowTexels - 1u) / rowTexels;
+    const VkDeviceSize rowSize = data.levelSizes[i] / rows;
+
+    const uint32_t bandRows = static_cast<uint32_t>(std::min<VkDeviceSize>(rows, ringSize / rowSize));
+    assert(bandRows > 0u);
+
+    for (uint32_t row = 0u; row < rows; row += bandRows) {
+      const uint32_t count = std::min(bandRows, rows - row);
+      const uint8_t *src = data.levels[i] + row * rowSize;
+      const VkDeviceSize size = count * rowSize;
+
+      VkBufferImageCopy region;
+      memset(&region, 0, sizeof(region));
+      region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0u, 1u};
+      region.imageOffset = { 0, int32_t(row * rowTexels), 0 };
+      region.imageExtent = { w, std::min(count * rowTexels, h - row * rowTexels), 1u };
+
+      const bool bFirst = (i == 0u) && (row == 0u);
+      const bool bLast = (i + 1u == copiedLevels) && (row + count == rows);
+
+      stage_upload(ctx, size, kAlignment,
+        [src, size](uint8_t *dst) {
+          memcpy(dst, src, size);
+        },
+        [region, target, copiedLevels, bFirst, bLast](VkCommandBuffer cmd,
+                                                      VkBuffer src,
+                                                      VkDeviceSize src_offset) {
+          VkBufferImageCopy copy = region;
+          copy.bufferOffset = src_offset;
+          record_texture_copy(cmd, src, copy, target, copiedLevels, bFirst, bLast);
+        }
+      );
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+bool load_texture(VulkanContext &ctx, const char *filename, Texture &texture) {
+  PROFILE_FUNCTION();
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Texture error : cannot open \"%s\".\n", filename);
+    return false;
+  }
+
+  struct stat st;
+  if ((fstat(fd, &st) < 0) || (st.st_size == 0)) {
+    fprintf(stderr, "Texture error : cannot read \"%s\".\n", filename);
+    close(fd);
+    return false;
+  }
+
+  /* The file content is read directly from the page cache */
+  const size_t size = st.st_size;
+  void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (mapped == MAP_FAILED) {
+    fprintf(stderr, "Texture error : cannot map \"%s\".\n", filename);
+    return false;
+  }
+
+  const uint8_t *bytes = static_cast<const uint8_t*>(mapped);
+
+  TextureData data;
+  bool bLoaded = parse_ktx(bytes, size, data) || parse_dds(bytes, size, data);
+
+  if (!bLoaded) {
+    fprintf(stderr, "Texture error : \"%s\" is not a valid KTX or DDS file.\n", filename);
+  } else {
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(ctx.gpu, data.format, &props);
+
+    if (!(props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+      fprintf(stderr, "Texture error : format of \"%s\" cannot be sampled on this device.\n",
+              filename);
+      bLoaded = false;
+    }
+  }
+
+  if (bLoaded) {
+    upload_texture(ctx, data, texture);
+  }
+
+  munmap(mapped, size);
+
+  return bLoaded;
+}
+
+// ----------------------------------------------------------------------------
+
+void create_default_texture(VulkanContext &ctx, Texture &texture) {
+  static const uint8_t kWhite[4u] = { 0xff, 0xff, 0xff, 0xff };
+
+  TextureData data;
+  data.format = VK_FORMAT_R8G8B8A8_UNORM;
+  data.width = 1u;
+  data.height = 1u;
+  data.levels.push_back(kWhite);
+  data.levelSizes.push_back(sizeof(kWhite));
+
+  upload_texture(ctx, data, texture);
+}
+
+// ----------------------------------------------------------------------------
+
+void release_texture(VulkanContext &ctx, Texture &texture) {
+  vkDestroyImageView(ctx.device, texture.view, nullptr);
+  vkDestroyImage(ctx.device, texture.image, nullptr);
+  vkFreeMemory(ctx.device, texture.mem, nullptr);
+  texture = Texture();
+}
+
+// ----------------------------------------------------------------------------
+// Samplers
+// ----------------------------------------------------------------------------
+
+static
+uint64_t hash_sampler_desc(const SamplerDesc &desc) {
+  uint64_t h = kHashSeed;
+  h = hash_value(desc.magFilter, h);
+  h = hash_value(desc.minFilter, h);
+  h = hash_value(desc.mipmapMode, h);
+  h = hash_value(desc.addressModeU, h);
+  h = hash_value(desc.addressModeV, h);
+  h = hash_value(desc.addressModeW, h);
+  h = hash_value(desc.mipLodBias, h);
+  h = hash_value(desc.minLod, h);
+  h = hash_value(desc.maxLod, h);
+  h = hash_value(desc.borderColor, h);
+  return h;
+}
+
+// ----------------------------------------------------------------------------
+
+void init_sampler_cache(VulkanContext &ctx) {
+  assert(ctx.samplerCache == nullptr);
+  ctx.samplerCache = new SamplerCache();
+}
+
+// ----------------------------------------------------------------------------
+
+VkSampler get_sampler(VulkanContext &ctx, const SamplerDesc &desc) {
+  assert(ctx.samplerCache != nullptr);
+  SamplerCache &cache = *ctx.samplerCache;
+
+  const uint64_t key = hash_sampler_desc(desc);
+
+  std::lock_guard<std::mutex> lock(cache.mutex);
+
+  auto it = cache.samplers.find(key);
+  if (it != cache.samplers.end()) {
+    return it->second;
+  }
+
+  VkSamplerCreateInfo info;
+  memset(&info, 0, sizeof(info));
+  info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  info.magFilter = desc.magFilter;
+  info.minFilter = desc.minFilter;
+  info.mipmapMode = desc.mipmapMode;
+  info.addressModeU = desc.addressModeU;
+  info.addressModeV = desc.addressModeV;
+  info.addressModeW = desc.addressModeW;
+  info.mipLodBias = desc.mipLodBias;
+  info.anisotropyEnable = VK_FALSE;
+  info.maxAnisotropy = 1.0f;
+  info.compareEnable = VK_FALSE;
+  info.compareOp = VK_COMPARE_OP_NEVER;
+  info.minLod = desc.minLod;
+  info.maxLod = desc.maxLod;
+  info.borderColor = desc.borderColor;
+  info.unnormalizedCoordinates = VK_FALSE;
+
+  VkSampler sampler;
+  VkResult err = vkCreateSampler(ctx.device, &info, nullptr, &sampler);
+  assert(!err);
+
+  cache.samplers[key] = sampler;
+  return sampler;
+}
+
+// ----------------------------------------------------------------------------
+
+void release_sampler_cache(VulkanContext &ctx) {
+  if (ctx.samplerCache == nullptr) {
+    return;
+  }
+
+  for (auto &it : ctx.samplerCache->samplers) {
+    vkDestroySampler(ctx.device, it.second, nullptr);
+  }
+
+  delete ctx.samplerCache;
+  ctx.samplerCache = nullptr;
+}
+
+// ============================================================================
@@ -0,0 +1,52 @@
+#ifndef TEXTURE_H_
+#define TEXTURE_H_
+
+#include <mutex>
+#include <unordered_map>
+
+#include "common.h"
+
+/* Sampler parameters, samplers are shared between identical descriptions */
+struct SamplerDesc {
+  VkFilter magFilter = VK_FILTER_LINEAR;
+  VkFilter minFilter = VK_FILTER_LINEAR;
+  VkSamplerMipmapMode mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+  VkSamplerAddressMode addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  VkSamplerAddressMode addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  VkSamplerAddressMode addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  float mipLodBias = 0.0f;
+  float minLod = 0.0f;
+  float maxLod = 1000.0f;   // ie. VK_LOD_CLAMP_NONE
+  VkBorderColor borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+};
+
+/* Samplers keyed by the hash of their description */
+struct SamplerCache {
+  std::mutex mutex;
+  std::unordered_map<uint64_t, VkSampler> samplers;
+};
+
+/**
+* Load a KTX (v1) or DDS texture, uncompressed RGBA8 / BGRA8 or BC1-3 / BC7.
+* The file is memory mapped and its levels are copied to the staging ring,
+* missing mip levels of uncompressed formats are generated by blits.
+* @return false if the file could not be loaded.
+*/
+bool load_texture(VulkanContext &ctx, const char *filename, Texture &texture);
+
+/* Create a 1x1 opaque white texture */
+void create_default_texture(VulkanContext &ctx, Texture &texture);
+
+/* Destroy a texture, the GPU must be done with it */
+void release_texture(VulkanContext &ctx, Texture &texture);
+
+/**/
+void init_sampler_cache(VulkanContext &ctx);
+
+/* Return the sampler matching desc, created on first request */
+VkSampler get_sampler(VulkanContext &ctx, const SamplerDesc &desc);
+
+/**/
+void release_sampler_cache(VulkanContext &ctx);
+
+#endif  // TEXTURE_H_
@@ -0,0 +1,83 @@
+#include <cassert>
+
+#include "thread_pool.h"
+
+// ============================================================================
+
+static
+void worker_loop(ThreadPool &pool) {
+  std::unique_lock<std::mutex> lock(pool.mutex);
+
+  while (true) {
+    pool.cv_jobs.wait(lock, [&pool] { return pool.stop || !pool.jobs.empty(); });
+
+    if (pool.jobs.empty()) {
+      // stop requested and nothing left to do
+      return;
+    }
+
+    std::function<void()> job = std::move(pool.jobs.front());
+    pool.jobs.pop_front();
+
+    lock.unlock();
+    job();
+    lock.lock();
+
+    if (--pool.pending == 0u) {
+      pool.cv_idle.notify_all();
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+void thread_pool_init(ThreadPool &pool, unsigned int num_threads) {
+  assert(pool.workers.empty());
+
+  if (num_threads == 0u) {
+    num_threads = std::thread::hardware_concurrency();
+  }
+  num_threads = (num_threads > 0u) ? num_threads : 1u;
+
+  pool.stop = false;
+  pool.workers.reserve(num_threads);
+  for (unsigned int i = 0u; i < num_threads; ++i) {
+    pool.workers.push_back(std::thread(worker_loop, std::ref(pool)));
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+void thread_pool_submit(ThreadPool &pool, std::function<void()> job) {
+  assert(!pool.workers.empty());
+  {
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    pool.jobs.push_back(std::move(job));
+    ++pool.pending;
+  }
+  pool.cv_jobs.notify_one();
+}
+
+// ----------------------------------------------------------------------------
+
+void thread_pool_wait(ThreadPool &pool) {
+  std::unique_lock<std::mutex> lock(pool.mutex);
+  pool.cv_idle.wait(lock, [&pool] { return pool.pending == 0u; });
+}
+
+// ----------------------------------------------------------------------------
+
+void thread_pool_release(ThreadPool &pool) {
+  {
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    pool.stop = true;
+  }
+  pool.cv_jobs.notify_all();
+
+  for (auto &worker : pool.workers) {
+    worker.join();
+  }
+  pool.workers.clear();
+}
+
+// ============================================================================
@@ -0,0 +1,35 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Fixed set of worker threads consuming a FIFO of jobs */
+struct ThreadPool {
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> jobs;
+
+  std::mutex mutex;
+  std::condition_variable cv_jobs;  // signaled when jobs are pushed or on stop
+  std::condition_variable cv_idle;  // signaled when no job is left
+  unsigned int pending = 0u;        // jobs queued or running
+  bool stop = false;
+};
+
+/* Start the workers, a count of 0 uses the hardware concurrency */
+void thread_pool_init(ThreadPool &pool, unsigned int num_threads = 0u);
+
+/* Queue a job to be run by one of the workers */
+void thread_pool_submit(ThreadPool &pool, std::function<void()> job);
+
+/* Block until every submitted job has completed */
+void thread_pool_wait(ThreadPool &pool);
+
+/* Finish the remaining jobs and join the workers */
+void thread_pool_release(ThreadPool &pool);
+
+#endif  // THREAD_POOL_H_
@@ -0,0 +1,87 @@
+/**
+* Plans a multi-pass render graph on the CPU, without any device, and checks
+* its culling and the sharing of its transient images : the frame graph of
+* the application has a single pass, which exercises neither.
+*   render_graph_test
+*/
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "render_graph.h"
+
+// ============================================================================
+
+static
+bool expect(const bool bCondition, const char *what) {
+  if (!bCondition) {
+    fprintf(stderr, "Render graph test error : %s.\n", what);
+  }
+  return bCondition;
+}
+
+// ============================================================================
+
+int main() {
+  RenderGraph graph;
+
+  /* Placeholder swapchain, the plan does not use its image */
+  const RGResourceId backbuffer = import_graph_image(
+    graph, "backbuffer", VK_FORMAT_B8G8R8A8_UNORM,
+    { VK_NULL_HANDLE }, { VK_NULL_HANDLE }, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+  );
+  const RGResourceId albedo = create_graph_image(graph, "albedo", VK_FORMAT_R8G8B8A8_UNORM,
+                                                 VK_SAMPLE_COUNT_1_BIT);
+  const RGResourceId light = create_graph_image(graph, "light", VK_FORMAT_R16G16B16A16_SFLOAT,
+                                                VK_SAMPLE_COUNT_1_BIT);
+  const RGResourceId blurred = create_graph_image(graph, "blurred", VK_FORMAT_R8G8B8A8_UNORM,
+                                                  VK_SAMPLE_COUNT_1_BIT);
+
+  const VkClearColorValue clear = {{ 0.0f, 0.0f, 0.0f, 0.0f }};
+
+  const RGPassId gbuffer = add_graph_pass(graph, "gbuffer", nullptr);
+  pass_write_color(graph, gbuffer, albedo, &clear);
+
+  /* Cleared again by the next pass before being read : culled */
+  const RGPassId stale = add_graph_pass(graph, "stale", nullptr);
+  pass_write_color(graph, stale, light, &clear);
+
+  const RGPassId lighting = add_graph_pass(graph, "lighting", nullptr);
+  pass_read_texture(graph, lighting, albedo);
+  pass_write_color(graph, lighting, light, &clear);
+
+  const RGPassId blur = add_graph_pass(graph, "blur", nullptr);
+  pass_read_texture(graph, blur, light);
+  pass_write_color(graph, blur, blurred, &clear);
+
+  const RGPassId composite = add_graph_pass(graph, "composite", nullptr);
+  pass_read_texture(graph, composite, blurred);
+  pass_write_color(graph, composite, backbuffer, &clear);
+
+  const uint32_t culled = plan_render_graph(graph);
+
+  const RenderGraph::Resource *res = graph.resources.data();
+
+  bool bValid = true;
+  bValid &= expect(culled == 1u, "one pass culled");
+  bValid &= expect(graph.passes[stale].bCulled, "overwritten pass culled");
+  bValid &= expect(!graph.passes[gbuffer].bCulled && !graph.passes[lighting].bCulled
+                && !graph.passes[blur].bCulled && !graph.passes[composite].bCulled,
+                   "contributing passes kept");
+
+  /* albedo is dead once blurred is written, they share their backing image */
+  bValid &= expect(graph.images.size() == 2u, "two images for three transients");
+  bValid &= expect(res[albedo].physical == res[blurred].physical,
+                   "disjoint lifetimes share an image");
+  bValid &= expect(res[albedo].physical != res[light].physical,
+                   "overlapping lifetimes do not share an image");
+  bValid &= expect(res[backbuffer].physical == kRGNone, "imported image not backed");
+
+  /* the culled pass does not extend the lifetime of its image */
+  bValid &= expect(res[light].firstUse == lighting, "culled use skipped");
+
+  fprintf(stdout, "render graph test : %s\n", (bValid) ? "passed" : "failed");
+  return (bValid) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// ============================================================================
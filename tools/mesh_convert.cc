@@ -0,0 +1,191 @@
+/**
+* Offline converter of Wavefront OBJ meshes to the binary mesh format read
+* by the application (see src/mesh_format.h) :
+*   mesh_convert <input.obj> <output.mesh>
+* Supports positions (with optional "v x y z r g b" vertex colors), normals
+* and polygonal faces, triangulated as fans. Texture coordinates are ignored.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mesh_format.h"
+
+// ============================================================================
+
+/* Resolve a 1-based, or negative relative, OBJ index */
+static
+bool resolve_obj_index(const long index, const size_t count, uint32_t &out) {
+  const long resolved = (index < 0) ? long(count) + index : index - 1;
+  if ((resolved < 0) || (size_t(resolved) >= count)) {
+    return false;
+  }
+  out = static_cast<uint32_t>(resolved);
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+
+static
+bool parse_obj(const char *filename, MeshSource &source) {
+  FILE *fd = fopen(filename, "r");
+  if (fd == nullptr) {
+    fprintf(stderr, "Mesh error : cannot open \"%s\".\n", filename);
+    return false;
+  }
+
+  std::vector<float> positions, normals, colors;
+  bool bColors = false;
+
+  /* Vertices are unique (position, normal) pairs */
+  std::unordered_map<uint64_t, uint32_t> vertices;
+  std::vector<uint32_t> face;
+
+  char line[1024u];
+  uint32_t lineno = 0u;
+  bool bValid = true;
+
+  while (bValid && fgets(line, sizeof(line), fd)) {
+    ++lineno;
+
+    if (!strncmp(line, "v ", 2u)) {
+      float v[7u] = { 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+      const int n = sscanf(line + 2u, "%f %f %f %f %f %f", &v[0u], &v[1u], &v[2u],
+                                                          &v[3u], &v[4u], &v[5u]);
+      bValid = (n >= 3);
+      bColors |= (n >= 6);
+      positions.insert(positions.end(), v, v + 3u);
+      colors.insert(colors.end(), v + 3u, v + 7u);
+    } else if (!strncmp(line, "vn ", 3u)) {
+      float n[3u];
+      bValid = (sscanf(line + 3u, "%f %f %f", &n[0u], &n[1u], &n[2u]) == 3);
+      normals.insert(normals.end(), n, n + 3u);
+    } else if (!strncmp(line, "f ", 2u)) {
+      face.clear();
+
+      char *saveptr = nullptr;
+      for (char *tok = strtok_r(line + 2u, " \t\r\n", &saveptr);
+           bValid && (tok != nullptr);
+           tok = strtok_r(nullptr, " \t\r\n", &saveptr))
+      {
+        // v, v/t, v//n or v/t/n
+        long vi = 0, ni = 0;
+        char *end = nullptr;
+        vi = strtol(tok, &end, 10);
+        if (*end == '/') {
+          char *slash = strchr(end + 1, '/');
+          if (slash != nullptr) {
+            ni = strtol(slash + 1, nullptr, 10);
+          }
+        }
+
+        uint32_t p = 0u, n = UINT32_MAX;
+        bValid = resolve_obj_index(vi, positions.size() / 3u, p)
+              && ((ni == 0) || resolve_obj_index(ni, normals.size() / 3u, n));
+        if (!bValid) {
+          break;
+        }
+
+        const uint64_t key = (uint64_t(n) << 32u) | p;
+        auto it = vertices.find(key);
+        if (it == vertices.end()) {
+          const uint32_t index = static_cast<uint32_t>(source.positions.size() / 3u);
+          it = vertices.emplace(key, index).first;
+
+          source.positions.insert(source.positions.end(), &positions[3u * p], &positions[3u * p] + 3u);
+          source.colors.insert(source.colors.end(), &colors[4u * p], &colors[4u * p] + 4u);
+          if (n != UINT32_MAX) {
+            source.normals.insert(source.normals.end(), &normals[3u * n], &normals[3u * n] + 3u);
+          }
+        }
+        face.push_back(it->second);
+      }
+
+      /* Fan triangulation */
+      for (size_t i = 2u; bValid && (i < face.size()); ++i) {
+        source.indices.push_back(face[0u]);
+        source.indices.push_back(face[i - 1u]);
+        source.indices.push_back(face[i]);
+      }
+    }
+  }
+  fclose(fd);
+
+  if (!bValid) {
+    fprintf(stderr, "Mesh error : \"%s\" line %u is invalid.\n", filename, lineno);
+    return false;
+  }
+
+  /* Normals are computed when missing on some vertices, colors when absent */
+  if (source.normals.size() != source.positions.size()) {
+    source.normals.clear();
+  }
+  if (!bColors) {
+    source.colors.clear();
+  }
+
+  if (source.indices.empty()) {
+    fprintf(stderr, "Mesh error : no faces in \"%s\".\n", filename);
+    return false;
+  }
+
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    fprintf(stdout, "usage : %s <input.obj> <output.mesh>\n", argv[0u]);
+    return EXIT_FAILURE;
+  }
+
+  MeshSource source;
+  if (!parse_obj(argv[1u], source)) {
+    return EXIT_FAILURE;
+  }
+
+  const uint32_t sourceVertexCount = static_cast<uint32_t>(source.positions.size() / 3u);
+  const float acmr_before = compute_acmr(source.indices, sourceVertexCount, 16u);
+
+  MeshData mesh;
+  build_mesh_data(source, mesh);
+
+  std::vector<uint8_t> bytes;
+  serialize_mesh(mesh, bytes);
+
+  FILE *fd = fopen(argv[2u], "wb");
+  if ((fd == nullptr) || (fwrite(bytes.data(), 1u, bytes.size(), fd) != bytes.size())) {
+    fprintf(stderr, "Mesh error : cannot write \"%s\".\n", argv[2u]);
+    if (fd != nullptr) {
+      fclose(fd);
+    }
+    return EXIT_FAILURE;
+  }
+  fclose(fd);
+
+  const size_t floatSize = mesh.vertices.size() * (3u + 3u + 4u) * sizeof(float)
+                         + mesh.indices.size() * sizeof(uint32_t);
+
+  const std::vector<uint32_t> lod0(mesh.indices.begin(),
+                                   mesh.indices.begin() + mesh.lods[0u].indexCount);
+
+  fprintf(stdout, "mesh : %zu vertices, %zu triangles\n",
+          mesh.vertices.size(), lod0.size() / 3u);
+  fprintf(stdout, "acmr : %.3f -> %.3f (FIFO 16)\n",
+          acmr_before, compute_acmr(lod0, mesh.vertices.size(), 16u));
+  for (uint32_t i = 0u; i < mesh.lods.size(); ++i) {
+    fprintf(stdout, "lod %u : %u triangles, error %.4f\n",
+            i, mesh.lods[i].indexCount / 3u, mesh.lods[i].error);
+  }
+  fprintf(stdout, "size : %.1f KiB (%.1f KiB unquantized)\n",
+          bytes.size() / 1024.0, floatSize / 1024.0);
+
+  return EXIT_SUCCESS;
+}
+
+// ============================================================================